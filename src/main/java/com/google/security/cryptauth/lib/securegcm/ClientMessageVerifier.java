@@ -0,0 +1,74 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import com.google.security.cryptauth.lib.securemessage.PreparedPublicKey;
+import com.google.security.cryptauth.lib.securemessage.PreparedSecretKey;
+import java.security.InvalidKeyException;
+import java.security.NoSuchAlgorithmException;
+import java.security.PublicKey;
+import java.security.SignatureException;
+import javax.crypto.SecretKey;
+
+/**
+ * Verifies and decrypts the messages a single client sends with {@link
+ * TransportCryptoOps#signcryptClientMessage}, for servers that receive many messages from the same
+ * device.
+ *
+ * <p>Unlike {@link TransportCryptoOps#verifydecryptClientMessage(byte[], PublicKey, SecretKey)},
+ * the signature engine is looked up and initialized with the user's public key only once per
+ * thread, and the decryption sub-key is only derived from the master key once. Instances are
+ * thread safe.
+ */
+public final class ClientMessageVerifier {
+
+  private final PreparedPublicKey userPublicKey;
+  private final PreparedSecretKey masterKey;
+
+  /**
+   * @param userPublicKey the public key the client signs its messages with
+   * @param masterKey the key shared with the client
+   * @throws InvalidKeyException if {@code userPublicKey} is of an unsupported type
+   */
+  public ClientMessageVerifier(PublicKey userPublicKey, SecretKey masterKey)
+      throws InvalidKeyException {
+    if ((userPublicKey == null) || (masterKey == null)) {
+      throw new NullPointerException();
+    }
+    SigType sigType = TransportCryptoOps.getSigTypeFor(userPublicKey);
+    this.userPublicKey = new PreparedPublicKey(userPublicKey, sigType);
+    this.masterKey = new PreparedSecretKey(masterKey);
+  }
+
+  public PublicKey getUserPublicKey() {
+    return userPublicKey.getPublicKey();
+  }
+
+  /**
+   * Recovers a secure {@link Payload} sent by the client.
+   *
+   * @see TransportCryptoOps#verifydecryptClientMessage(byte[], PublicKey, SecretKey)
+   */
+  public Payload verifydecrypt(byte[] signcryptedClientMessage)
+      throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
+    if (signcryptedClientMessage == null) {
+      throw new NullPointerException();
+    }
+    return TransportCryptoOps.verifydecryptClientMessage(
+        signcryptedClientMessage, userPublicKey, userPublicKey.getSigType(), masterKey);
+  }
+}
@@ -24,7 +24,6 @@ import java.io.UnsupportedEncodingException;
 import java.security.InvalidKeyException;
 import java.security.NoSuchAlgorithmException;
 import java.security.SignatureException;
-import java.util.Arrays;
 import javax.crypto.SecretKey;
 import javax.crypto.spec.SecretKeySpec;
 
@@ -204,36 +203,45 @@ public abstract class D2DConnectionContext {
    * @return a resumed context from a saved session.
    */
   public static D2DConnectionContext fromSavedSession(byte[] savedSessionInfo) {
-    if (savedSessionInfo == null || savedSessionInfo.length == 0) {
+    if (savedSessionInfo == null) {
+      throw new IllegalArgumentException("savedSessionInfo null or too short");
+    }
+    return fromSavedSession(savedSessionInfo, 0, savedSessionInfo.length);
+  }
+
+  /**
+   * Like {@link #fromSavedSession(byte[])}, but reads the saved session info from {@code length}
+   * bytes of {@code buffer} starting at {@code offset}, without copying it out first.
+   */
+  static D2DConnectionContext fromSavedSession(byte[] buffer, int offset, int length) {
+    if (length == 0) {
       throw new IllegalArgumentException("savedSessionInfo null or too short");
     }
 
-    int protocolVersion = savedSessionInfo[0] & 0xff;
+    int protocolVersion = buffer[offset] & 0xff;
 
     switch (protocolVersion) {
       case 0:
         // Version 0 has a 1 byte protocol version, a 4 byte sequence number,
         // and 32 bytes of AES key (1 + 4 + 32 = 37)
-        if (savedSessionInfo.length != 37) {
-          throw new IllegalArgumentException("Incorrect data length (" + savedSessionInfo.length
+        if (length != 37) {
+          throw new IllegalArgumentException("Incorrect data length (" + length
               + ") for v0 protocol");
         }
-        int sequenceNumber = bytesToSignedInt(Arrays.copyOfRange(savedSessionInfo, 1, 5));
-        SecretKey sharedKey = new SecretKeySpec(Arrays.copyOfRange(savedSessionInfo, 5, 37), "AES");
+        int sequenceNumber = bytesToSignedInt(buffer, offset + 1);
+        SecretKey sharedKey = new SecretKeySpec(buffer, offset + 5, 32, "AES");
         return new D2DConnectionContextV0(sharedKey, sequenceNumber);
 
       case 1:
         // Version 1 has a 1 byte protocol version, two 4 byte sequence numbers,
         // and two 32 byte AES keys (1 + 4 + 4 + 32 + 32 = 73)
-        if (savedSessionInfo.length != 73) {
+        if (length != 73) {
           throw new IllegalArgumentException("Incorrect data length for v1 protocol");
         }
-        int encodeSequenceNumber = bytesToSignedInt(Arrays.copyOfRange(savedSessionInfo, 1, 5));
-        int decodeSequenceNumber = bytesToSignedInt(Arrays.copyOfRange(savedSessionInfo, 5, 9));
-        SecretKey encodeKey =
-            new SecretKeySpec(Arrays.copyOfRange(savedSessionInfo, 9, 41), "AES");
-        SecretKey decodeKey =
-            new SecretKeySpec(Arrays.copyOfRange(savedSessionInfo, 41, 73), "AES");
+        int encodeSequenceNumber = bytesToSignedInt(buffer, offset + 1);
+        int decodeSequenceNumber = bytesToSignedInt(buffer, offset + 5);
+        SecretKey encodeKey = new SecretKeySpec(buffer, offset + 9, 32, "AES");
+        SecretKey decodeKey = new SecretKeySpec(buffer, offset + 41, 32, "AES");
         return new D2DConnectionContextV1(encodeKey, decodeKey, encodeSequenceNumber,
             decodeSequenceNumber);
 
@@ -252,10 +260,17 @@ public abstract class D2DConnectionContext {
           + bytes.length + " bytes");
     }
 
-    return ((bytes[0] << 24) & 0xff000000)
-        |  ((bytes[1] << 16) & 0x00ff0000)
-        |  ((bytes[2] << 8)  & 0x0000ff00)
-        |   (bytes[3]        & 0x000000ff);
+    return bytesToSignedInt(bytes, 0);
+  }
+
+  /**
+   * Convert the 4 bytes at {@code offset} in big-endian representation into a signed int.
+   */
+  static int bytesToSignedInt(byte[] bytes, int offset) {
+    return ((bytes[offset] << 24) & 0xff000000)
+        |  ((bytes[offset + 1] << 16) & 0x00ff0000)
+        |  ((bytes[offset + 2] << 8)  & 0x0000ff00)
+        |   (bytes[offset + 3]        & 0x000000ff);
   }
 
   /**
@@ -14,6 +14,7 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
 import java.io.ByteArrayOutputStream;
 import java.io.IOException;
 import java.security.MessageDigest;
@@ -51,7 +52,7 @@ public class D2DConnectionContextV0 extends D2DConnectionContext {
           "Connection has not been correctly initialized; shared key is null");
     }
 
-    MessageDigest md = MessageDigest.getInstance("SHA-256");
+    MessageDigest md = CryptoOps.getBackend().getMessageDigest("SHA-256");
     md.update(D2DCryptoOps.SALT);
     return md.digest(sharedKey.getEncoded());
   }
@@ -14,6 +14,7 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
 import java.io.ByteArrayOutputStream;
 import java.io.IOException;
 import java.security.MessageDigest;
@@ -71,7 +72,7 @@ public class D2DConnectionContextV1 extends D2DConnectionContext {
     byte[] firstKeyBytes = encodeKeyHash < decodeKeyHash ? encodeKeyBytes : decodeKeyBytes;
     byte[] secondKeyBytes = firstKeyBytes == encodeKeyBytes ? decodeKeyBytes : encodeKeyBytes;
 
-    MessageDigest md = MessageDigest.getInstance("SHA-256");
+    MessageDigest md = CryptoOps.getBackend().getMessageDigest("SHA-256");
     md.update(D2DCryptoOps.SALT);
     md.update(firstKeyBytes);
     md.update(secondKeyBytes);
@@ -71,12 +71,17 @@ class D2DCryptoOps {
    * @param publicDhKey the key the recipient will need to derive the shared DH secret.
    *   This key will be added to the {@link ResponderHello} in the header.
    * @param protocolVersion the protocol version to include in the proto
+   * @param compressPublicDhKey whether to send {@code publicDhKey} in compressed form, which
+   *   should only be done if the initiator said it accepts compressed keys
    */
   static byte[] signcryptMessageAndResponderHello(
-      Payload payload, SecretKey sharedKey, PublicKey publicDhKey, int protocolVersion)
+      Payload payload, SecretKey sharedKey, PublicKey publicDhKey, int protocolVersion,
+      boolean compressPublicDhKey)
       throws InvalidKeyException, NoSuchAlgorithmException {
     ResponderHello.Builder responderHello = ResponderHello.newBuilder();
-    responderHello.setPublicDhKey(PublicKeyProtoUtil.encodePublicKey(publicDhKey));
+    responderHello.setPublicDhKey(compressPublicDhKey
+        ? PublicKeyProtoUtil.encodeCompressedPublicKey(publicDhKey)
+        : PublicKeyProtoUtil.encodePublicKey(publicDhKey));
     responderHello.setProtocolVersion(protocolVersion);
     return signcryptPayload(payload, sharedKey, responderHello.build().toByteArray());
   }
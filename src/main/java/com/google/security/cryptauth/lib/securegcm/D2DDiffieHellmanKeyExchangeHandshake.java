@@ -71,6 +71,7 @@ public class D2DDiffieHellmanKeyExchangeHandshake implements D2DHandshakeContext
   private State handshakeState;
   private boolean isInitiator;
   private int protocolVersionToUse;
+  private boolean initiatorAcceptsCompressedPublicKey;
 
   private enum State {
     // Initiator state
@@ -94,6 +95,7 @@ public class D2DDiffieHellmanKeyExchangeHandshake implements D2DHandshakeContext
     handshakeState = state;
     isInitiator = state == State.INITIATOR_START;
     protocolVersionToUse = D2DConnectionContextV1.PROTOCOL_VERSION;
+    initiatorAcceptsCompressedPublicKey = false;
   }
 
   /**
@@ -124,6 +126,7 @@ public class D2DDiffieHellmanKeyExchangeHandshake implements D2DHandshakeContext
         return InitiatorHello.newBuilder()
             .setPublicDhKey(PublicKeyProtoUtil.encodePublicKey(ourKeyPair.getPublic()))
             .setProtocolVersion(protocolVersionToUse)
+            .setAcceptsCompressedPublicKey(true)
             .build()
             .toByteArray();
 
@@ -188,7 +191,8 @@ public class D2DDiffieHellmanKeyExchangeHandshake implements D2DHandshakeContext
               deviceToDeviceMessage.toByteArray()),
           responderEncodeKey,
           ourKeyPair.getPublic(),
-          protocolVersionToUse);
+          protocolVersionToUse,
+          initiatorAcceptsCompressedPublicKey);
     } catch (InvalidKeyException|NoSuchAlgorithmException e) {
       throw new HandshakeException(e);
     }
@@ -264,6 +268,7 @@ public class D2DDiffieHellmanKeyExchangeHandshake implements D2DHandshakeContext
         }
 
         theirPublicKey = PublicKeyProtoUtil.parsePublicKey(initiatorHelloProto.getPublicDhKey());
+        initiatorAcceptsCompressedPublicKey = initiatorHelloProto.getAcceptsCompressedPublicKey();
 
         // Downgrade to protocol version 0 if needed for backwards compatibility.
         int protocolVersion = initiatorHelloProto.getProtocolVersion();
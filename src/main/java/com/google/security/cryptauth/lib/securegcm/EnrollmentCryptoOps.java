@@ -14,11 +14,16 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.common.base.Supplier;
+import com.google.protobuf.ByteString;
+import com.google.protobuf.CodedInputStream;
 import com.google.protobuf.InvalidProtocolBufferException;
+import com.google.protobuf.WireFormat;
 import com.google.security.annotations.SuppressInsecureCipherModeCheckerPendingReview;
 import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmDeviceInfo;
 import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmMetadata;
 import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
 import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
@@ -26,15 +31,19 @@ import com.google.security.cryptauth.lib.securemessage.SecureMessageBuilder;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageParser;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.HeaderAndBody;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.SecureMessage;
+import java.io.IOException;
 import java.security.InvalidKeyException;
 import java.security.KeyPair;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
 import java.security.PrivateKey;
+import java.security.Provider;
 import java.security.PublicKey;
 import java.security.SignatureException;
 import java.security.spec.InvalidKeySpecException;
 import java.util.Arrays;
+import java.util.concurrent.Executor;
+import javax.annotation.Nullable;
 import javax.crypto.KeyAgreement;
 import javax.crypto.SecretKey;
 
@@ -76,22 +85,127 @@ public class EnrollmentCryptoOps {
    */
   private static final String LEGACY_KA_ALG = "DH";
 
+  /**
+   * Encoded tags of the {@link GcmDeviceInfo} fields checked before the rest is decoded.
+   */
+  private static final int USER_PUBLIC_KEY_TAG =
+      (GcmDeviceInfo.USER_PUBLIC_KEY_FIELD_NUMBER << 3) | WireFormat.WIRETYPE_LENGTH_DELIMITED;
+  private static final int DEVICE_MASTER_KEY_HASH_TAG =
+      (GcmDeviceInfo.DEVICE_MASTER_KEY_HASH_FIELD_NUMBER << 3)
+          | WireFormat.WIRETYPE_LENGTH_DELIMITED;
+
+  /**
+   * If set, legacy key agreement key pairs are taken from here instead of being generated on
+   * demand.
+   */
+  @Nullable private static volatile KeyPairPool legacyKeyPairPool = null;
+
+  /**
+   * If set, (non-legacy) P-256 key agreement key pairs are taken from here instead of being
+   * generated on demand.
+   */
+  @Nullable private static volatile KeyPairPool ecKeyPairPool = null;
+
+  /**
+   * If set, master keys derived by {@link #doKeyAgreement(PrivateKey, PublicKey)} are cached here.
+   */
+  @Nullable private static volatile KeyAgreementCache keyAgreementCache = null;
+
+  /**
+   * Installs a pool of pre-generated Diffie-Hellman key pairs (i.e., a {@link KeyPairPool} backed
+   * by {@link PublicKeyProtoUtil#generateDh2048KeyPair()}) to be used by {@link
+   * #generateEnrollmentKeyAgreementKeyPair(boolean)} for legacy enrollments. Passing {@code null}
+   * reverts to generating every key pair on demand.
+   */
+  public static void setLegacyKeyPairPool(@Nullable KeyPairPool pool) {
+    legacyKeyPairPool = pool;
+  }
+
+  /**
+   * Installs a pool of pre-generated P-256 key pairs, to be used by {@link
+   * #generateEnrollmentKeyAgreementKeyPair(boolean)} for non-legacy enrollments. Passing {@code
+   * null} reverts to generating every key pair on demand.
+   */
+  public static void setEcKeyPairPool(@Nullable KeyPairPool pool) {
+    ecKeyPairPool = pool;
+  }
+
+  /**
+   * Creates a {@link KeyPairPool} of enrollment key agreement key pairs, suitable for {@link
+   * #setEcKeyPairPool(KeyPairPool)} or (if {@code isLegacy}) {@link
+   * #setLegacyKeyPairPool(KeyPairPool)}.
+   *
+   * @see KeyPairPool#KeyPairPool(Supplier, int, int, Executor)
+   */
+  public static KeyPairPool newEnrollmentKeyPairPool(
+      final boolean isLegacy, int lowWatermark, int capacity, Executor executor) {
+    return new KeyPairPool(
+        new Supplier<KeyPair>() {
+          @Override
+          public KeyPair get() {
+            return isLegacy
+                ? PublicKeyProtoUtil.generateDh2048KeyPair()
+                : PublicKeyProtoUtil.generateEcP256KeyPair();
+          }
+        },
+        lowWatermark,
+        capacity,
+        executor);
+  }
+
+  /**
+   * Installs a cache of the master keys derived by {@link #doKeyAgreement(PrivateKey, PublicKey)},
+   * so that repeated agreements between the same pair of keys skip the public key operation.
+   * Passing {@code null} disables caching.
+   */
+  public static void setKeyAgreementCache(@Nullable KeyAgreementCache cache) {
+    keyAgreementCache = cache;
+  }
+
   /**
    * Used by both the client and server to perform a key exchange.
    *
    * @return a {@link SecretKey} derived from the key exchange
    * @throws InvalidKeyException if either of the input keys is of the wrong type
    */
-  @SuppressInsecureCipherModeCheckerPendingReview // b/32143855
   public static SecretKey doKeyAgreement(PrivateKey myKey, PublicKey peerKey)
       throws InvalidKeyException {
+    KeyAgreementCache cache = keyAgreementCache;
+    ByteString fingerprint = (cache == null) ? null : KeyAgreementCache.fingerprint(myKey, peerKey);
+    if (fingerprint != null) {
+      SecretKey cached = cache.get(fingerprint);
+      if (cached != null) {
+        return cached;
+      }
+    }
+
+    byte[] masterKey = computeMasterKey(myKey, peerKey);
+    if (fingerprint != null) {
+      cache.put(fingerprint, masterKey);
+    }
+    SecretKey result = KeyEncoding.parseMasterKey(masterKey);
+    Arrays.fill(masterKey, (byte) 0);
+    return result;
+  }
+
+  /**
+   * @return the raw bytes of the master key derived from a key exchange between {@code myKey} and
+   *   {@code peerKey}
+   */
+  @SuppressInsecureCipherModeCheckerPendingReview // b/32143855
+  private static byte[] computeMasterKey(PrivateKey myKey, PublicKey peerKey)
+      throws InvalidKeyException {
     String alg = KA_ALG;
+    Provider provider = CryptoOps.getEcProvider();
     if (KeyEncoding.isLegacyPrivateKey(myKey)) {
       alg = LEGACY_KA_ALG;
+      provider = null;
     }
     KeyAgreement agreement;
     try {
-      agreement = KeyAgreement.getInstance(alg);
+      agreement = (provider == null)
+          ? CryptoOps.getBackend().getKeyAgreement(alg)
+          : KeyAgreement.getInstance(alg, provider);
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException(e);
     }
@@ -101,14 +215,19 @@ public class EnrollmentCryptoOps {
     byte[] agreedKey = agreement.generateSecret();
 
     // Derive a 256-bit AES key by using sha256 on the Diffie-Hellman output
-    return KeyEncoding.parseMasterKey(sha256(agreedKey));
+    byte[] masterKey = sha256(agreedKey);
+    Arrays.fill(agreedKey, (byte) 0);
+    return masterKey;
   }
 
   public static KeyPair generateEnrollmentKeyAgreementKeyPair(boolean isLegacy) {
-    if (isLegacy) {
-      return PublicKeyProtoUtil.generateDh2048KeyPair();
+    KeyPairPool pool = isLegacy ? legacyKeyPairPool : ecKeyPairPool;
+    if (pool != null) {
+      return pool.take();
     }
-    return PublicKeyProtoUtil.generateEcP256KeyPair();
+    return isLegacy
+        ? PublicKeyProtoUtil.generateDh2048KeyPair()
+        : PublicKeyProtoUtil.generateEcP256KeyPair();
   }
 
   /**
@@ -181,50 +300,139 @@ public class EnrollmentCryptoOps {
       throw new NullPointerException();
     }
 
-    HeaderAndBody outerHeaderAndBody;
-    GcmMetadata outerMetadata;
-    HeaderAndBody innerHeaderAndBody;
-    byte[] encodedUserPublicKey;
-    GcmDeviceInfo enrollmentInfo;
-    try {
-      SecureMessage outerMsg = SecureMessage.parseFrom(enrollmentMessage);
+    EnrollmentDecryption decryption =
+        new EnrollmentDecryption(enrollmentMessage, masterKey, isLegacy);
+    decryption.parseOuterMessage();
+    decryption.verifyAndDecryptOuterMessage();
+    decryption.parseUserPublicKey();
+    decryption.verifyInnerMessage();
+    return decryption.decodeDeviceInfo();
+  }
+
+  /**
+   * The steps of {@link #decryptEnrollmentMessage(byte[], SecretKey, boolean)}, which must be run
+   * in order. Split up so that {@link EnrollmentPipeline} can run each step on its own threads.
+   */
+  static final class EnrollmentDecryption {
+    private final byte[] enrollmentMessage;
+    private final SecretKey masterKey;
+    private final boolean isLegacy;
+
+    private SecureMessage outerMsg;
+    private HeaderAndBody outerHeaderAndBody;
+    private GcmMetadata outerMetadata;
+    private SecureMessage innerMsg;
+    private ByteString encodedUserPublicKey;
+    private PublicKey userPublicKey;
+    private HeaderAndBody innerHeaderAndBody;
+
+    EnrollmentDecryption(byte[] enrollmentMessage, SecretKey masterKey, boolean isLegacy) {
+      this.enrollmentMessage = enrollmentMessage;
+      this.masterKey = masterKey;
+      this.isLegacy = isLegacy;
+    }
+
+    void parseOuterMessage() throws SignatureException {
+      try {
+        outerMsg = SecureMessage.parseFrom(enrollmentMessage);
+      } catch (InvalidProtocolBufferException e) {
+        throw new SignatureException(e);
+      }
+    }
+
+    void verifyAndDecryptOuterMessage()
+        throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
       outerHeaderAndBody = SecureMessageParser.parseSignCryptedMessage(
           outerMsg, masterKey, OUTER_SIG_TYPE, masterKey, OUTER_ENC_TYPE);
-      outerMetadata = GcmMetadata.parseFrom(outerHeaderAndBody.getHeader().getPublicMetadata());
+      try {
+        outerMetadata = GcmMetadata.parseFrom(outerHeaderAndBody.getHeader().getPublicMetadata());
+      } catch (InvalidProtocolBufferException e) {
+        throw new SignatureException(e);
+      }
+    }
 
-      SecureMessage innerMsg = SecureMessage.parseFrom(outerHeaderAndBody.getBody());
-      encodedUserPublicKey = SecureMessageParser.getUnverifiedHeader(innerMsg)
-          .getVerificationKeyId().toByteArray();
-      PublicKey userPublicKey = KeyEncoding.parseUserPublicKey(encodedUserPublicKey);
+    void parseUserPublicKey() throws SignatureException {
+      try {
+        // The inner message is a view of the decrypted outer body, rather than a copy of it
+        innerMsg = SecureMessageParser.parseNestedMessage(outerHeaderAndBody.getBody());
+        encodedUserPublicKey =
+            SecureMessageParser.getUnverifiedHeader(innerMsg).getVerificationKeyId();
+        userPublicKey = KeyEncoding.parseUserPublicKey(encodedUserPublicKey.toByteArray());
+      } catch (InvalidProtocolBufferException e) {
+        throw new SignatureException(e);
+      } catch (InvalidKeySpecException e) {
+        throw new SignatureException(e);
+      }
+    }
+
+    void verifyInnerMessage()
+        throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
       SigType sigType = isLegacy ? LEGACY_INNER_SIG_TYPE : INNER_SIG_TYPE;
       innerHeaderAndBody = SecureMessageParser.parseSignedCleartextMessage(
           innerMsg, userPublicKey, sigType);
-      enrollmentInfo = GcmDeviceInfo.parseFrom(innerHeaderAndBody.getBody());
-    } catch (InvalidProtocolBufferException e) {
-      throw new SignatureException(e);
-    } catch (InvalidKeySpecException e) {
-      throw new SignatureException(e);
     }
 
-    boolean verified =
-           (outerMetadata.getType() == PayloadType.ENROLLMENT.getType())
-        && (outerMetadata.getVersion() <= SecureGcmConstants.SECURE_GCM_VERSION)
-        && outerHeaderAndBody.getHeader().getVerificationKeyId().isEmpty()
-        && innerHeaderAndBody.getHeader().getPublicMetadata().isEmpty()
-        // Verify the encoded public key we used matches the encoded public key key being enrolled
-        && Arrays.equals(encodedUserPublicKey, enrollmentInfo.getUserPublicKey().toByteArray())
-        && Arrays.equals(getMasterKeyHash(masterKey),
-            enrollmentInfo.getDeviceMasterKeyHash().toByteArray());
+    GcmDeviceInfo decodeDeviceInfo() throws SignatureException {
+      ByteString encodedDeviceInfo = innerHeaderAndBody.getBody();
+      boolean verified =
+             (outerMetadata.getType() == PayloadType.ENROLLMENT.getType())
+          && (outerMetadata.getVersion() <= SecureGcmConstants.SECURE_GCM_VERSION)
+          && outerHeaderAndBody.getHeader().getVerificationKeyId().isEmpty()
+          && innerHeaderAndBody.getHeader().getPublicMetadata().isEmpty()
+          // Verify the encoded public key we used matches the encoded public key being enrolled,
+          // before paying to decode the rest of the enrollment request
+          && deviceInfoKeysMatch(
+              encodedDeviceInfo, encodedUserPublicKey, getMasterKeyHash(masterKey));
+      if (!verified) {
+        throw new SignatureException();
+      }
+      TransportCryptoOps.checkNotReplayed(
+          encodedUserPublicKey, outerHeaderAndBody.getHeader().getIv());
 
-    if (verified) {
-      return enrollmentInfo;
+      try {
+        return GcmDeviceInfo.parseFrom(encodedDeviceInfo);
+      } catch (InvalidProtocolBufferException e) {
+        throw new SignatureException(e);
+      }
+    }
+  }
+
+  /**
+   * Checks the {@code user_public_key} and {@code device_master_key_hash} fields of an encoded
+   * {@link GcmDeviceInfo}, skipping over the rest of it. As when parsing, the last occurrence of a
+   * repeated field wins.
+   *
+   * @return false if either field doesn't match, or {@code encodedDeviceInfo} is malformed
+   */
+  // @VisibleForTesting
+  static boolean deviceInfoKeysMatch(
+      ByteString encodedDeviceInfo, ByteString userPublicKey, byte[] masterKeyHash) {
+    ByteString actualUserPublicKey = null;
+    ByteString actualMasterKeyHash = ByteString.EMPTY;
+    CodedInputStream input = encodedDeviceInfo.newCodedInput();
+    input.enableAliasing(true);
+    try {
+      for (int tag = input.readTag(); tag != 0; tag = input.readTag()) {
+        if (tag == USER_PUBLIC_KEY_TAG) {
+          actualUserPublicKey = input.readBytes();
+        } else if (tag == DEVICE_MASTER_KEY_HASH_TAG) {
+          actualMasterKeyHash = input.readBytes();
+        } else if (!input.skipField(tag)) {
+          return false;  // An unmatched end group tag
+        }
+      }
+    } catch (InvalidProtocolBufferException e) {
+      return false;
+    } catch (IOException e) {
+      throw new AssertionError(e);  // Reading from memory
     }
-    throw new SignatureException();
+    return userPublicKey.equals(actualUserPublicKey)
+        && Arrays.equals(masterKeyHash, actualMasterKeyHash.toByteArray());
   }
 
   static byte[] sha256(byte[] input) {
     try {
-      MessageDigest sha256 = MessageDigest.getInstance("SHA-256");
+      MessageDigest sha256 = CryptoOps.getBackend().getMessageDigest("SHA-256");
       return sha256.digest(input);
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException(e);  // Shouldn't happen
@@ -0,0 +1,320 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.util.concurrent.ListenableFuture;
+import com.google.common.util.concurrent.SettableFuture;
+import com.google.common.util.concurrent.Uninterruptibles;
+import com.google.security.cryptauth.lib.securegcm.EnrollmentCryptoOps.EnrollmentDecryption;
+import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmDeviceInfo;
+import java.io.Closeable;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.EnumMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.atomic.AtomicLong;
+import javax.crypto.SecretKey;
+
+/**
+ * Runs {@link EnrollmentCryptoOps#decryptEnrollmentMessage(byte[], SecretKey, boolean)} for many
+ * messages in parallel, as a pipeline of {@link Stage}s connected by bounded queues, each with
+ * its own worker threads.
+ *
+ * <p>Each message gets its own result future, which fails with the same exception (or error) that
+ * {@code decryptEnrollmentMessage} would have thrown. {@link #submit(byte[], SecretKey, boolean)}
+ * blocks while the first queue is full, so a burst of enrollments can't exhaust memory.
+ *
+ * <p>The workers are daemon threads that run until {@link #close()} is called.
+ */
+public class EnrollmentPipeline implements Closeable {
+
+  /**
+   * The steps of decrypting an enrollment message, in order.
+   */
+  public enum Stage {
+    /** Parses the outer {@code SecureMessage}. */
+    PARSE,
+    /** Verifies the outer HMAC and decrypts the body with the master key. */
+    OUTER_VERIFY_AND_DECRYPT,
+    /** Parses the inner {@code SecureMessage} and the user public key it names. */
+    USER_KEY_PARSE,
+    /** Verifies the inner ECDSA or RSA signature. */
+    SIGNATURE_VERIFY,
+    /** Decodes the {@link GcmDeviceInfo} and checks it against the outer message. */
+    DEVICE_INFO_DECODE,
+  }
+
+  private final Map<Stage, StageRunner> stages = new EnumMap<>(Stage.class);
+  private final List<Thread> workers = new ArrayList<>();
+  private volatile boolean closed = false;
+
+  /**
+   * Creates a pipeline with the same number of workers for every stage, and starts it.
+   *
+   * @param queueCapacity the number of messages that can wait in front of each stage
+   */
+  public EnrollmentPipeline(int queueCapacity, int workersPerStage) {
+    this(queueCapacity, uniformWorkers(workersPerStage));
+  }
+
+  /**
+   * Creates a pipeline and starts it.
+   *
+   * @param queueCapacity the number of messages that can wait in front of each stage
+   * @param workersPerStage the number of worker threads for each stage. Stages that aren't
+   *   listed get one worker.
+   */
+  public EnrollmentPipeline(int queueCapacity, Map<Stage, Integer> workersPerStage) {
+    if (workersPerStage == null) {
+      throw new NullPointerException();
+    }
+    if (queueCapacity < 1) {
+      throw new IllegalArgumentException("Queue capacity must be positive");
+    }
+    for (Stage stage : Stage.values()) {
+      stages.put(stage, new StageRunner(stage, queueCapacity));
+    }
+    for (Stage stage : Stage.values()) {
+      Integer workerCount = workersPerStage.get(stage);
+      int count = (workerCount == null) ? 1 : workerCount;
+      if (count < 1) {
+        throw new IllegalArgumentException("Every stage needs at least one worker");
+      }
+      for (int i = 0; i < count; i++) {
+        Thread worker = new Thread(stages.get(stage), "enrollment-" + stage + "-" + i);
+        worker.setDaemon(true);
+        workers.add(worker);
+      }
+    }
+    for (Thread worker : workers) {
+      worker.start();
+    }
+  }
+
+  /**
+   * Queues {@code enrollmentMessage} for decryption, waiting for space in the first queue if
+   * necessary.
+   *
+   * @return the decrypted enrollment request, or the exception that decrypting it threw
+   * @throws RejectedExecutionException if the pipeline has been closed
+   * @see EnrollmentCryptoOps#decryptEnrollmentMessage(byte[], SecretKey, boolean)
+   */
+  public ListenableFuture<GcmDeviceInfo> submit(
+      byte[] enrollmentMessage, SecretKey masterKey, boolean isLegacy)
+      throws InterruptedException {
+    if ((enrollmentMessage == null) || (masterKey == null)) {
+      throw new NullPointerException();
+    }
+    if (closed) {
+      throw new RejectedExecutionException("Pipeline is closed");
+    }
+    Job job = new Job(new EnrollmentDecryption(enrollmentMessage, masterKey, isLegacy));
+    stages.get(Stage.PARSE).queue.put(job);
+    if (closed) {
+      cancelQueuedJobs();  // Raced with close()
+    }
+    return job.result;
+  }
+
+  /**
+   * @return the counters for {@code stage}
+   */
+  public StageMetrics getMetrics(Stage stage) {
+    return stages.get(stage).metrics;
+  }
+
+  /**
+   * Stops the workers, and waits for them to finish the message they are working on. Messages
+   * that haven't been fully processed have their results cancelled.
+   */
+  @Override
+  public void close() {
+    closed = true;
+    for (Thread worker : workers) {
+      worker.interrupt();
+    }
+    for (Thread worker : workers) {
+      Uninterruptibles.joinUninterruptibly(worker);
+    }
+    cancelQueuedJobs();
+  }
+
+  private void cancelQueuedJobs() {
+    for (StageRunner stage : stages.values()) {
+      List<Job> abandoned = new ArrayList<>();
+      stage.queue.drainTo(abandoned);
+      for (Job job : abandoned) {
+        job.result.cancel(false);
+      }
+    }
+  }
+
+  /**
+   * Counters for one stage, updated as messages pass through it.
+   */
+  public static final class StageMetrics {
+    private final AtomicLong processedCount = new AtomicLong();
+    private final AtomicLong failureCount = new AtomicLong();
+    private final AtomicLong busyNanos = new AtomicLong();
+    private final BlockingQueue<?> queue;
+
+    StageMetrics(BlockingQueue<?> queue) {
+      this.queue = queue;
+    }
+
+    /**
+     * @return the number of messages this stage has finished with, successfully or not
+     */
+    public long getProcessedCount() {
+      return processedCount.get();
+    }
+
+    /**
+     * @return the number of messages rejected by this stage
+     */
+    public long getFailureCount() {
+      return failureCount.get();
+    }
+
+    /**
+     * @return the total time this stage's workers have spent processing messages
+     */
+    public long getBusyNanos() {
+      return busyNanos.get();
+    }
+
+    /**
+     * @return the number of messages per second a single worker of this stage processes, or 0 if
+     *   it hasn't processed any. Comparing this across stages shows where to add workers.
+     */
+    public double getMessagesPerWorkerSecond() {
+      long nanos = busyNanos.get();
+      return (nanos == 0) ? 0 : processedCount.get() * 1e9 / nanos;
+    }
+
+    /**
+     * @return the number of messages waiting for this stage
+     */
+    public int getQueueSize() {
+      return queue.size();
+    }
+  }
+
+  private static final class Job {
+    final EnrollmentDecryption decryption;
+    final SettableFuture<GcmDeviceInfo> result = SettableFuture.create();
+
+    Job(EnrollmentDecryption decryption) {
+      this.decryption = decryption;
+    }
+  }
+
+  /**
+   * The queue in front of one stage, and the loop run by each of its workers.
+   */
+  private final class StageRunner implements Runnable {
+    final Stage stage;
+    final BlockingQueue<Job> queue;
+    final StageMetrics metrics;
+
+    StageRunner(Stage stage, int queueCapacity) {
+      this.stage = stage;
+      this.queue = new ArrayBlockingQueue<>(queueCapacity);
+      this.metrics = new StageMetrics(queue);
+    }
+
+    @Override
+    public void run() {
+      while (!closed) {
+        Job job;
+        try {
+          job = queue.take();
+        } catch (InterruptedException e) {
+          return;
+        }
+        if (process(job)) {
+          continue;
+        }
+        try {
+          stages.get(Stage.values()[stage.ordinal() + 1]).queue.put(job);
+        } catch (InterruptedException e) {
+          job.result.cancel(false);
+          return;
+        }
+      }
+    }
+
+    /**
+     * @return true if {@code job} has its result, and false if it needs the next stage
+     */
+    private boolean process(Job job) {
+      EnrollmentDecryption decryption = job.decryption;
+      long start = System.nanoTime();
+      GcmDeviceInfo result = null;
+      Throwable failure = null;
+      try {
+        switch (stage) {
+          case PARSE:
+            decryption.parseOuterMessage();
+            break;
+          case OUTER_VERIFY_AND_DECRYPT:
+            decryption.verifyAndDecryptOuterMessage();
+            break;
+          case USER_KEY_PARSE:
+            decryption.parseUserPublicKey();
+            break;
+          case SIGNATURE_VERIFY:
+            decryption.verifyInnerMessage();
+            break;
+          case DEVICE_INFO_DECODE:
+            result = decryption.decodeDeviceInfo();
+            if (result == null) {
+              throw new IllegalStateException("No device info decoded");
+            }
+            break;
+        }
+      } catch (Throwable t) {
+        // Errors too (e.g., from a broken provider), so that the worker keeps running and the
+        // message's result is still completed
+        failure = t;
+      }
+      // Update the metrics before completing the result, so that callers see them
+      metrics.busyNanos.addAndGet(System.nanoTime() - start);
+      metrics.processedCount.incrementAndGet();
+      if (failure != null) {
+        metrics.failureCount.incrementAndGet();
+        job.result.setException(failure);
+        return true;
+      }
+      if (result != null) {
+        job.result.set(result);
+        return true;
+      }
+      return false;
+    }
+  }
+
+  private static Map<Stage, Integer> uniformWorkers(int workersPerStage) {
+    Map<Stage, Integer> workers = new EnumMap<>(Stage.class);
+    for (Stage stage : Stage.values()) {
+      workers.put(stage, workersPerStage);
+    }
+    return Collections.unmodifiableMap(workers);
+  }
+}
@@ -0,0 +1,69 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securemessage.PreparedSecretKey;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+import javax.annotation.Nullable;
+import javax.crypto.SecretKey;
+
+/**
+ * A thread safe {@link MasterKeyStore} backed by a hash map.
+ *
+ * <p>Keys are stored as {@link PreparedSecretKey}s, so the sub-keys derived from each master key
+ * are only computed for the first message that uses it.
+ */
+public class InMemoryMasterKeyStore implements MasterKeyStore {
+
+  private final ConcurrentMap<ByteString, PreparedSecretKey> keys = new ConcurrentHashMap<>();
+
+  /**
+   * Adds {@code masterKey} under {@code keyHandle}, replacing any key already stored there.
+   */
+  public void put(byte[] keyHandle, SecretKey masterKey) {
+    if ((keyHandle == null) || (masterKey == null)) {
+      throw new NullPointerException();
+    }
+    keys.put(ByteString.copyFrom(keyHandle), new PreparedSecretKey(masterKey));
+  }
+
+  /**
+   * Removes the key stored under {@code keyHandle}, if there is one.
+   */
+  public void remove(byte[] keyHandle) {
+    if (keyHandle == null) {
+      throw new NullPointerException();
+    }
+    keys.remove(ByteString.copyFrom(keyHandle));
+  }
+
+  /**
+   * @return the number of keys in the store
+   */
+  public int size() {
+    return keys.size();
+  }
+
+  @Override
+  @Nullable
+  public SecretKey getMasterKey(ByteString keyHandle) {
+    if (keyHandle == null) {
+      throw new NullPointerException();
+    }
+    return keys.get(keyHandle);
+  }
+}
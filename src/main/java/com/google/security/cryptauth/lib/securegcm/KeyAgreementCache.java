@@ -0,0 +1,189 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.annotations.VisibleForTesting;
+import com.google.common.base.Ticker;
+import com.google.common.cache.Cache;
+import com.google.common.cache.CacheBuilder;
+import com.google.common.cache.RemovalListener;
+import com.google.common.cache.RemovalNotification;
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.security.PrivateKey;
+import java.security.PublicKey;
+import java.util.Arrays;
+import java.util.concurrent.TimeUnit;
+import javax.annotation.Nullable;
+import javax.crypto.SecretKey;
+
+/**
+ * A bounded, thread safe cache of the master keys derived by {@link
+ * EnrollmentCryptoOps#doKeyAgreement(PrivateKey, PublicKey)}, for servers that repeatedly agree
+ * on a key between the same long-term key pairs.
+ *
+ * <p>Entries are keyed by a SHA-256 fingerprint of both keys, so no key material is kept in the
+ * cache keys. The cached master keys are zeroized as soon as they are evicted, expire or are
+ * invalidated.
+ *
+ * @see EnrollmentCryptoOps#setKeyAgreementCache(KeyAgreementCache)
+ */
+public class KeyAgreementCache {
+
+  /**
+   * Domain separation for the fingerprints used as cache keys.
+   */
+  private static final byte[] FINGERPRINT_PREFIX = {'K', 'A', 'C', '1'};
+
+  private final Cache<ByteString, MasterKeyEntry> cache;
+
+  /**
+   * @param maximumSize the maximum number of master keys to retain
+   * @param expireAfterWrite how long a derived master key may be served from the cache
+   * @param unit the unit of {@code expireAfterWrite}
+   */
+  public KeyAgreementCache(long maximumSize, long expireAfterWrite, TimeUnit unit) {
+    this(maximumSize, expireAfterWrite, unit, Ticker.systemTicker());
+  }
+
+  @VisibleForTesting
+  KeyAgreementCache(long maximumSize, long expireAfterWrite, TimeUnit unit, Ticker ticker) {
+    if (maximumSize < 0 || expireAfterWrite < 0) {
+      throw new IllegalArgumentException("Cache limits must not be negative");
+    }
+    this.cache = CacheBuilder.newBuilder()
+        .maximumSize(maximumSize)
+        .expireAfterWrite(expireAfterWrite, unit)
+        .ticker(ticker)
+        .recordStats()
+        .removalListener(new RemovalListener<ByteString, MasterKeyEntry>() {
+          @Override
+          public void onRemoval(RemovalNotification<ByteString, MasterKeyEntry> notification) {
+            MasterKeyEntry entry = notification.getValue();
+            if (entry != null) {
+              entry.destroy();
+            }
+          }
+        })
+        .build();
+  }
+
+  /**
+   * @return the fingerprint identifying the agreement between {@code myKey} and {@code peerKey},
+   *   or null if either key can't be fingerprinted (in which case the agreement isn't cached)
+   */
+  @Nullable
+  static ByteString fingerprint(PrivateKey myKey, PublicKey peerKey) {
+    byte[] encodedMyKey;
+    byte[] encodedPeerKey;
+    try {
+      encodedMyKey = KeyEncoding.encodeKeyAgreementPrivateKey(myKey);
+      encodedPeerKey = KeyEncoding.encodeKeyAgreementPublicKey(peerKey);
+    } catch (IllegalArgumentException | ClassCastException e) {
+      return null;  // Unsupported key type; doKeyAgreement will report the problem
+    }
+    if ((encodedMyKey == null) || (encodedPeerKey == null)) {
+      return null;  // e.g., a key held in hardware
+    }
+    try {
+      MessageDigest sha256 = CryptoOps.getBackend().getMessageDigest("SHA-256");
+      sha256.update(FINGERPRINT_PREFIX);
+      sha256.update(intToBytes(encodedMyKey.length));
+      sha256.update(encodedMyKey);
+      sha256.update(encodedPeerKey);
+      Arrays.fill(encodedMyKey, (byte) 0);
+      return ByteString.copyFrom(sha256.digest());
+    } catch (NoSuchAlgorithmException e) {
+      throw new RuntimeException(e);  // Shouldn't happen
+    }
+  }
+
+  /**
+   * @return the cached master key for {@code fingerprint}, or null if there is none
+   */
+  @Nullable
+  SecretKey get(ByteString fingerprint) {
+    MasterKeyEntry entry = cache.getIfPresent(fingerprint);
+    return (entry == null) ? null : entry.toSecretKey();
+  }
+
+  /**
+   * Caches a copy of {@code masterKey} under {@code fingerprint}.
+   */
+  void put(ByteString fingerprint, byte[] masterKey) {
+    cache.put(fingerprint, new MasterKeyEntry(masterKey.clone()));
+  }
+
+  /**
+   * @return the number of key agreements that were served from the cache
+   */
+  public long getHitCount() {
+    return cache.stats().hitCount();
+  }
+
+  /**
+   * @return the number of key agreements that had to be computed
+   */
+  public long getMissCount() {
+    return cache.stats().missCount();
+  }
+
+  /**
+   * @return the approximate number of master keys currently held
+   */
+  public long size() {
+    return cache.size();
+  }
+
+  /**
+   * Discards (and zeroizes) all cached master keys.
+   */
+  public void invalidateAll() {
+    cache.invalidateAll();
+  }
+
+  private static byte[] intToBytes(int value) {
+    return new byte[] {
+      (byte) (value >>> 24), (byte) (value >>> 16), (byte) (value >>> 8), (byte) value
+    };
+  }
+
+  /**
+   * Holds the raw bytes of a cached master key until it is destroyed. Synchronized so that a
+   * reader never sees a partially zeroized key.
+   */
+  private static final class MasterKeyEntry {
+    @Nullable private byte[] masterKey;
+
+    MasterKeyEntry(byte[] masterKey) {
+      this.masterKey = masterKey;
+    }
+
+    @Nullable
+    synchronized SecretKey toSecretKey() {
+      // Returns a copy, since SecretKeySpec clones its input
+      return (masterKey == null) ? null : KeyEncoding.parseMasterKey(masterKey);
+    }
+
+    synchronized void destroy() {
+      if (masterKey != null) {
+        Arrays.fill(masterKey, (byte) 0);
+        masterKey = null;
+      }
+    }
+  }
+}
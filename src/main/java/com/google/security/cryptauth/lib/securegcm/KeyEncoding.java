@@ -15,6 +15,8 @@
 package com.google.security.cryptauth.lib.securegcm;
 
 import com.google.protobuf.InvalidProtocolBufferException;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
+import com.google.security.cryptauth.lib.securemessage.PublicKeyCache;
 import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
 import java.security.KeyFactory;
@@ -25,6 +27,7 @@ import java.security.interfaces.ECPrivateKey;
 import java.security.interfaces.ECPublicKey;
 import java.security.spec.InvalidKeySpecException;
 import java.security.spec.PKCS8EncodedKeySpec;
+import javax.annotation.Nullable;
 import javax.crypto.SecretKey;
 import javax.crypto.interfaces.DHPrivateKey;
 import javax.crypto.spec.SecretKeySpec;
@@ -37,6 +40,11 @@ public class KeyEncoding {
 
   private static boolean simulateLegacyCryptoRequired = false;
 
+  /**
+   * Optional cache of previously parsed public keys, or {@code null} to always parse from scratch.
+   */
+  @Nullable private static volatile PublicKeyCache publicKeyCache = null;
+
   /**
    * The JCA algorithm name to use when encoding/decoding symmetric keys.
    */
@@ -148,11 +156,23 @@ public class KeyEncoding {
     simulateLegacyCryptoRequired = forceLegacy;
   }
 
+  /**
+   * Installs a {@link PublicKeyCache} to be consulted by all of the {@code parse*PublicKey}
+   * methods of this class. Passing {@code null} turns caching off again (the default).
+   */
+  public static void setPublicKeyCache(@Nullable PublicKeyCache cache) {
+    publicKeyCache = cache;
+  }
+
   private static byte[] encodePublicKey(PublicKey pk) {
     return PublicKeyProtoUtil.encodePublicKey(pk).toByteArray();
   }
 
   private static PublicKey parsePublicKey(byte[] keyBytes) throws InvalidKeySpecException {
+    PublicKeyCache cache = publicKeyCache;
+    if (cache != null) {
+      return cache.parsePublicKey(keyBytes);
+    }
     try {
       return PublicKeyProtoUtil.parsePublicKey(GenericPublicKey.parseFrom(keyBytes));
     } catch (InvalidProtocolBufferException e) {
@@ -164,7 +184,7 @@ public class KeyEncoding {
 
   static KeyFactory getEcKeyFactory() {
     try {
-      return KeyFactory.getInstance("EC");
+      return CryptoOps.getBackend().getKeyFactory("EC");
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException(e);  // No ECDH provider available
     }
@@ -172,7 +192,7 @@ public class KeyEncoding {
 
   static KeyFactory getRsaKeyFactory() {
     try {
-      return KeyFactory.getInstance("RSA");
+      return CryptoOps.getBackend().getKeyFactory("RSA");
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException(e);  // No RSA provider available
     }
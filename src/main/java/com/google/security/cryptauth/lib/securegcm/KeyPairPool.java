@@ -0,0 +1,160 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.base.Supplier;
+import java.security.KeyPair;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.Executor;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicLong;
+
+/**
+ * A thread safe pool of freshly generated key pairs, refilled in the background, so that
+ * expensive key generation can happen off of the request path.
+ *
+ * <p>Every key pair is handed out at most once. If the pool runs dry, {@link #take()} falls back
+ * to generating a key pair on the calling thread, so callers never wait for the refill.
+ *
+ * <p>A refill starts once fewer than the low watermark of key pairs are ready, and runs until the
+ * pool is back at its capacity (the high watermark).
+ */
+public class KeyPairPool {
+
+  private final Supplier<KeyPair> generator;
+  private final Executor executor;
+  private final BlockingQueue<KeyPair> pool;
+  private final int lowWatermark;
+  private final AtomicBoolean refillScheduled = new AtomicBoolean(false);
+  private final AtomicLong hitCount = new AtomicLong();
+  private final AtomicLong missCount = new AtomicLong();
+
+  private final Runnable refill = new Runnable() {
+    @Override
+    public void run() {
+      try {
+        while (pool.remainingCapacity() > 0) {
+          if (!pool.offer(generator.get())) {
+            break;
+          }
+        }
+      } finally {
+        refillScheduled.set(false);
+      }
+      // A take() may have raced with the end of the loop above
+      if (pool.size() < lowWatermark) {
+        scheduleRefill();
+      }
+    }
+  };
+
+  /**
+   * Creates a pool and starts filling it.
+   *
+   * @param generator creates new key pairs, e.g.
+   *   {@code PublicKeyProtoUtil.generateDh2048KeyPair()}. Called from {@code executor}, and from
+   *   threads calling {@link #take()} when the pool is empty.
+   * @param capacity the number of key pairs to keep ready
+   * @param executor runs the background refill
+   */
+  public KeyPairPool(Supplier<KeyPair> generator, int capacity, Executor executor) {
+    this(generator, capacity, capacity, executor);
+  }
+
+  /**
+   * Creates a pool that is only refilled once it runs low, and starts filling it.
+   *
+   * @param generator creates new key pairs. Called from {@code executor}, and from threads
+   *   calling {@link #take()} when the pool is empty.
+   * @param lowWatermark a refill starts when fewer than this many key pairs are ready. Must be at
+   *   least 1, since otherwise the pool would never be refilled.
+   * @param capacity the number of key pairs a refill generates up to
+   * @param executor runs the background refill
+   */
+  public KeyPairPool(
+      Supplier<KeyPair> generator, int lowWatermark, int capacity, Executor executor) {
+    if ((generator == null) || (executor == null)) {
+      throw new NullPointerException();
+    }
+    if (capacity < 1) {
+      throw new IllegalArgumentException("Capacity must be positive");
+    }
+    if ((lowWatermark < 1) || (lowWatermark > capacity)) {
+      throw new IllegalArgumentException("Low watermark must be between 1 and the capacity");
+    }
+    this.generator = generator;
+    this.executor = executor;
+    this.pool = new ArrayBlockingQueue<>(capacity);
+    this.lowWatermark = lowWatermark;
+    scheduleRefill();
+  }
+
+  /**
+   * @return a key pair that has never been returned before, taken from the pool if one is ready
+   */
+  public KeyPair take() {
+    KeyPair keyPair = pool.poll();
+    if (pool.size() < lowWatermark) {
+      scheduleRefill();
+    }
+    if (keyPair != null) {
+      hitCount.incrementAndGet();
+      return keyPair;
+    }
+    missCount.incrementAndGet();
+    return generator.get();
+  }
+
+  /**
+   * @return the number of key pairs currently ready
+   */
+  public int size() {
+    return pool.size();
+  }
+
+  /**
+   * @return the number of key pairs a refill generates up to
+   */
+  public int getCapacity() {
+    return pool.size() + pool.remainingCapacity();
+  }
+
+  /**
+   * @return the number of calls to {@link #take()} that were served from the pool
+   */
+  public long getHitCount() {
+    return hitCount.get();
+  }
+
+  /**
+   * @return the number of calls to {@link #take()} that had to generate a key pair themselves
+   */
+  public long getMissCount() {
+    return missCount.get();
+  }
+
+  private void scheduleRefill() {
+    if (refillScheduled.compareAndSet(false, true)) {
+      try {
+        executor.execute(refill);
+      } catch (RejectedExecutionException e) {
+        // The executor is shutting down; take() keeps working by generating key pairs inline
+        refillScheduled.set(false);
+      }
+    }
+  }
+}
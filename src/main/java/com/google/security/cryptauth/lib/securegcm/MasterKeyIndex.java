@@ -0,0 +1,478 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.channels.Channels;
+import java.nio.channels.ReadableByteChannel;
+import java.nio.channels.WritableByteChannel;
+import java.util.concurrent.locks.StampedLock;
+import javax.annotation.Nullable;
+import javax.crypto.SecretKey;
+
+/**
+ * A compact index from {@link EnrollmentCryptoOps#getMasterKeyHash(SecretKey)} to the master key
+ * and its key handle, for servers that keep track of a very large number of devices.
+ *
+ * <p>Entries live outside of the Java heap, in open addressing hash tables held in direct {@link
+ * ByteBuffer}s, so the index adds almost nothing to garbage collection work. The index is divided
+ * into {@link #SHARDS} shards, each with its own lock for writers. Readers don't lock: they read
+ * optimistically and only retry (under the lock) if a writer changed the shard meanwhile.
+ *
+ * <p>{@link #writeTo(OutputStream)} saves the tables as they are, so {@link #readFrom(InputStream)}
+ * can restore them with bulk copies rather than by re-inserting every entry.
+ *
+ * <p>Master keys must be 32 bytes (as AES-256 keys are), and key handles at most {@link
+ * #MAX_KEY_HANDLE_LENGTH} bytes. Note that the master keys are kept, and saved, in the clear.
+ */
+public final class MasterKeyIndex {
+
+  /**
+   * Number of independently locked shards.
+   */
+  public static final int SHARDS = 16;
+
+  /**
+   * The longest key handle that can be stored.
+   */
+  public static final int MAX_KEY_HANDLE_LENGTH = 62;
+
+  // Slot layout: state, key handle length, master key hash, master key, key handle
+  private static final int HASH_LENGTH = 32;
+  private static final int KEY_LENGTH = 32;
+  private static final int STATE_OFFSET = 0;
+  private static final int HANDLE_LENGTH_OFFSET = 1;
+  private static final int HASH_OFFSET = 2;
+  private static final int KEY_OFFSET = HASH_OFFSET + HASH_LENGTH;
+  private static final int HANDLE_OFFSET = KEY_OFFSET + KEY_LENGTH;
+  private static final int SLOT_SIZE = HANDLE_OFFSET + MAX_KEY_HANDLE_LENGTH;
+
+  private static final byte EMPTY = 0;
+  private static final byte FULL = 1;
+  private static final byte DELETED = 2;
+
+  private static final int MIN_SLOTS_PER_SHARD = 16;
+
+  /**
+   * Identifies (and versions) the snapshot format.
+   */
+  private static final int SNAPSHOT_MAGIC = 0x4d4b4931;  // "MKI1"
+
+  /**
+   * A master key and its key handle, as found in the index.
+   */
+  public static final class Entry {
+    private final SecretKey masterKey;
+    private final byte[] keyHandle;
+
+    Entry(SecretKey masterKey, byte[] keyHandle) {
+      this.masterKey = masterKey;
+      this.keyHandle = keyHandle;
+    }
+
+    public SecretKey getMasterKey() {
+      return masterKey;
+    }
+
+    public byte[] getKeyHandle() {
+      return keyHandle;
+    }
+  }
+
+  private final Shard[] shards = new Shard[SHARDS];
+
+  /**
+   * @param expectedSize the number of entries to size the tables for. The tables grow as needed,
+   *   but growing a shard blocks its writers while it is rehashed.
+   */
+  public MasterKeyIndex(int expectedSize) {
+    if (expectedSize < 0) {
+      throw new IllegalArgumentException("Expected size must not be negative");
+    }
+    int slots = slotsFor(expectedSize / SHARDS + 1);
+    for (int i = 0; i < SHARDS; i++) {
+      shards[i] = new Shard(slots);
+    }
+  }
+
+  private MasterKeyIndex(Shard[] shards) {
+    System.arraycopy(shards, 0, this.shards, 0, SHARDS);
+  }
+
+  /**
+   * Adds {@code masterKey} and {@code keyHandle} under {@link
+   * EnrollmentCryptoOps#getMasterKeyHash(SecretKey)}, replacing any entry already there.
+   *
+   * @throws IllegalArgumentException if {@code masterKey} isn't 32 bytes long, or {@code
+   *   keyHandle} is too long
+   */
+  public void put(SecretKey masterKey, byte[] keyHandle) {
+    if ((masterKey == null) || (keyHandle == null)) {
+      throw new NullPointerException();
+    }
+    byte[] encodedKey = masterKey.getEncoded();
+    if ((encodedKey == null) || (encodedKey.length != KEY_LENGTH)) {
+      throw new IllegalArgumentException("Master key must be " + KEY_LENGTH + " bytes");
+    }
+    if (keyHandle.length > MAX_KEY_HANDLE_LENGTH) {
+      throw new IllegalArgumentException("Key handle is longer than " + MAX_KEY_HANDLE_LENGTH);
+    }
+    byte[] hash = EnrollmentCryptoOps.getMasterKeyHash(masterKey);
+    shardFor(hash).put(hash, encodedKey, keyHandle);
+  }
+
+  /**
+   * @param masterKeyHash the hash computed by {@link EnrollmentCryptoOps#getMasterKeyHash}
+   * @return the entry stored under {@code masterKeyHash}, or null if there isn't one
+   */
+  @Nullable
+  public Entry get(byte[] masterKeyHash) {
+    checkHash(masterKeyHash);
+    return shardFor(masterKeyHash).get(masterKeyHash);
+  }
+
+  /**
+   * @return true if an entry was removed
+   */
+  public boolean remove(byte[] masterKeyHash) {
+    checkHash(masterKeyHash);
+    return shardFor(masterKeyHash).remove(masterKeyHash);
+  }
+
+  /**
+   * @return the number of entries in the index
+   */
+  public long size() {
+    long size = 0;
+    for (Shard shard : shards) {
+      size += shard.size();
+    }
+    return size;
+  }
+
+  /**
+   * Saves a snapshot of the index to {@code out}. Writers are blocked one shard at a time while
+   * it is copied.
+   */
+  public void writeTo(OutputStream out) throws IOException {
+    DataOutputStream data = new DataOutputStream(out);
+    data.writeInt(SNAPSHOT_MAGIC);
+    data.writeInt(SHARDS);
+    data.writeInt(SLOT_SIZE);
+    for (Shard shard : shards) {
+      shard.writeTo(data);
+    }
+    data.flush();
+  }
+
+  /**
+   * Loads an index saved by {@link #writeTo(OutputStream)}.
+   *
+   * @throws IOException if {@code in} doesn't hold a valid snapshot
+   */
+  public static MasterKeyIndex readFrom(InputStream in) throws IOException {
+    DataInputStream data = new DataInputStream(in);
+    if ((data.readInt() != SNAPSHOT_MAGIC)
+        || (data.readInt() != SHARDS)
+        || (data.readInt() != SLOT_SIZE)) {
+      throw new IOException("Not a master key index snapshot");
+    }
+    Shard[] shards = new Shard[SHARDS];
+    for (int i = 0; i < SHARDS; i++) {
+      shards[i] = Shard.readFrom(data);
+    }
+    return new MasterKeyIndex(shards);
+  }
+
+  private Shard shardFor(byte[] hash) {
+    return shards[hash[0] & (SHARDS - 1)];
+  }
+
+  private static void checkHash(byte[] masterKeyHash) {
+    if (masterKeyHash == null) {
+      throw new NullPointerException();
+    }
+    if (masterKeyHash.length != HASH_LENGTH) {
+      throw new IllegalArgumentException("Master key hashes are " + HASH_LENGTH + " bytes");
+    }
+  }
+
+  /**
+   * @return a power of two number of slots that holds {@code entries} below the maximum load
+   */
+  private static int slotsFor(int entries) {
+    int slots = MIN_SLOTS_PER_SHARD;
+    while (slots - slots / 4 <= entries) {
+      if (slots > (Integer.MAX_VALUE / SLOT_SIZE) / 2) {
+        throw new IllegalStateException("Too many entries for one shard");
+      }
+      slots *= 2;
+    }
+    return slots;
+  }
+
+  /**
+   * One open addressing (linear probing) hash table. Writers hold the lock's write lock; readers
+   * use optimistic reads, so every read of {@link #table} must tolerate a concurrent write.
+   */
+  private static final class Shard {
+    final StampedLock lock = new StampedLock();
+    // Only replaced by writers, but read optimistically
+    volatile ByteBuffer table;
+    int slots;
+    int size;
+    int deleted;
+
+    Shard(int slots) {
+      this.table = ByteBuffer.allocateDirect(slots * SLOT_SIZE);
+      this.slots = slots;
+    }
+
+    @Nullable
+    Entry get(byte[] hash) {
+      long stamp = lock.tryOptimisticRead();
+      if (stamp != 0) {
+        Entry result = find(table, hash);
+        if (lock.validate(stamp)) {
+          return result;
+        }
+      }
+      stamp = lock.readLock();
+      try {
+        return find(table, hash);
+      } finally {
+        lock.unlockRead(stamp);
+      }
+    }
+
+    void put(byte[] hash, byte[] key, byte[] keyHandle) {
+      long stamp = lock.writeLock();
+      try {
+        int slot = indexOf(table, hash);
+        if (slot < 0) {
+          if (size + deleted + 1 > slots - slots / 4) {
+            rehash(slotsFor(size + 1));
+          }
+          slot = freeSlotFor(table, hash);
+          if (table.get(slot * SLOT_SIZE + STATE_OFFSET) == DELETED) {
+            deleted--;
+          }
+          size++;
+        }
+        int offset = slot * SLOT_SIZE;
+        table.put(offset + STATE_OFFSET, FULL);
+        table.put(offset + HANDLE_LENGTH_OFFSET, (byte) keyHandle.length);
+        putBytes(table, offset + HASH_OFFSET, hash);
+        putBytes(table, offset + KEY_OFFSET, key);
+        putBytes(table, offset + HANDLE_OFFSET, keyHandle);
+      } finally {
+        lock.unlockWrite(stamp);
+      }
+    }
+
+    boolean remove(byte[] hash) {
+      long stamp = lock.writeLock();
+      try {
+        int slot = indexOf(table, hash);
+        if (slot < 0) {
+          return false;
+        }
+        int offset = slot * SLOT_SIZE;
+        table.put(offset + STATE_OFFSET, DELETED);
+        for (int i = HANDLE_LENGTH_OFFSET; i < SLOT_SIZE; i++) {
+          table.put(offset + i, (byte) 0);  // Don't leave the master key behind
+        }
+        size--;
+        deleted++;
+        return true;
+      } finally {
+        lock.unlockWrite(stamp);
+      }
+    }
+
+    int size() {
+      long stamp = lock.readLock();
+      try {
+        return size;
+      } finally {
+        lock.unlockRead(stamp);
+      }
+    }
+
+    /**
+     * Moves the entries into a new table with {@code newSlots} slots, dropping deleted ones.
+     */
+    private void rehash(int newSlots) {
+      ByteBuffer oldTable = table;
+      ByteBuffer newTable = ByteBuffer.allocateDirect(newSlots * SLOT_SIZE);
+      int oldSlots = slots;
+      slots = newSlots;
+      byte[] hash = new byte[HASH_LENGTH];
+      for (int slot = 0; slot < oldSlots; slot++) {
+        int offset = slot * SLOT_SIZE;
+        if (oldTable.get(offset + STATE_OFFSET) != FULL) {
+          continue;
+        }
+        getBytes(oldTable, offset + HASH_OFFSET, hash);
+        int newOffset = freeSlotFor(newTable, hash) * SLOT_SIZE;
+        for (int i = 0; i < SLOT_SIZE; i++) {
+          newTable.put(newOffset + i, oldTable.get(offset + i));
+        }
+      }
+      deleted = 0;
+      table = newTable;
+      // The old table is zeroed, and freed along with its buffer
+      for (int i = 0; i < oldSlots * SLOT_SIZE; i++) {
+        oldTable.put(i, (byte) 0);
+      }
+    }
+
+    /**
+     * @return the entry stored under {@code hash}, or null if there is none (or {@code t} was
+     *   read while being written)
+     */
+    @Nullable
+    private static Entry find(ByteBuffer t, byte[] hash) {
+      int slot = indexOf(t, hash);
+      if (slot < 0) {
+        return null;
+      }
+      int offset = slot * SLOT_SIZE;
+      int handleLength = t.get(offset + HANDLE_LENGTH_OFFSET);
+      if ((handleLength < 0) || (handleLength > MAX_KEY_HANDLE_LENGTH)) {
+        return null;  // Torn read
+      }
+      byte[] key = new byte[KEY_LENGTH];
+      getBytes(t, offset + KEY_OFFSET, key);
+      byte[] keyHandle = new byte[handleLength];
+      getBytes(t, offset + HANDLE_OFFSET, keyHandle);
+      return new Entry(KeyEncoding.parseMasterKey(key), keyHandle);
+    }
+
+    /**
+     * @return the slot holding {@code hash}, or -1 if there is none
+     */
+    private static int indexOf(ByteBuffer t, byte[] hash) {
+      int slots = t.capacity() / SLOT_SIZE;
+      int mask = slots - 1;
+      int slot = startSlot(hash) & mask;
+      for (int probes = 0; probes < slots; probes++, slot = (slot + 1) & mask) {
+        int offset = slot * SLOT_SIZE;
+        byte state = t.get(offset + STATE_OFFSET);
+        if (state == EMPTY) {
+          return -1;
+        }
+        if ((state == FULL) && hashEquals(t, offset + HASH_OFFSET, hash)) {
+          return slot;
+        }
+      }
+      return -1;
+    }
+
+    /**
+     * @return the first empty or deleted slot on the probe sequence of {@code hash}
+     */
+    private static int freeSlotFor(ByteBuffer t, byte[] hash) {
+      int slots = t.capacity() / SLOT_SIZE;
+      int mask = slots - 1;
+      int slot = startSlot(hash) & mask;
+      for (int probes = 0; probes < slots; probes++, slot = (slot + 1) & mask) {
+        if (t.get(slot * SLOT_SIZE + STATE_OFFSET) != FULL) {
+          return slot;
+        }
+      }
+      // Only possible if a corrupt snapshot was loaded
+      throw new IllegalStateException("No free slot in master key index");
+    }
+
+    /**
+     * The hash is already uniformly distributed; byte 0 is used to pick the shard.
+     */
+    private static int startSlot(byte[] hash) {
+      return ((hash[1] & 0xff) << 24) | ((hash[2] & 0xff) << 16)
+          | ((hash[3] & 0xff) << 8) | (hash[4] & 0xff);
+    }
+
+    private static boolean hashEquals(ByteBuffer t, int offset, byte[] hash) {
+      for (int i = 0; i < HASH_LENGTH; i++) {
+        if (t.get(offset + i) != hash[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    void writeTo(DataOutputStream out) throws IOException {
+      long stamp = lock.readLock();
+      try {
+        out.writeInt(slots);
+        out.writeInt(size);
+        out.writeInt(deleted);
+        out.flush();
+        ByteBuffer view = table.duplicate();
+        view.clear();
+        WritableByteChannel channel = Channels.newChannel(out);
+        while (view.hasRemaining()) {
+          channel.write(view);
+        }
+      } finally {
+        lock.unlockRead(stamp);
+      }
+    }
+
+    static Shard readFrom(DataInputStream in) throws IOException {
+      int slots = in.readInt();
+      int size = in.readInt();
+      int deleted = in.readInt();
+      if ((slots < MIN_SLOTS_PER_SHARD)
+          || (Integer.bitCount(slots) != 1)
+          || (slots > Integer.MAX_VALUE / SLOT_SIZE)
+          || (size < 0)
+          || (deleted < 0)
+          || (size + deleted >= slots)) {
+        throw new IOException("Corrupt master key index snapshot");
+      }
+      Shard shard = new Shard(slots);
+      shard.size = size;
+      shard.deleted = deleted;
+      ByteBuffer table = shard.table;
+      ReadableByteChannel channel = Channels.newChannel(in);
+      while (table.hasRemaining()) {
+        if (channel.read(table) < 0) {
+          throw new IOException("Truncated master key index snapshot");
+        }
+      }
+      table.clear();
+      return shard;
+    }
+  }
+
+  private static void putBytes(ByteBuffer t, int offset, byte[] bytes) {
+    for (int i = 0; i < bytes.length; i++) {
+      t.put(offset + i, bytes[i]);
+    }
+  }
+
+  private static void getBytes(ByteBuffer t, int offset, byte[] bytes) {
+    for (int i = 0; i < bytes.length; i++) {
+      bytes[i] = t.get(offset + i);
+    }
+  }
+}
@@ -0,0 +1,35 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.protobuf.ByteString;
+import javax.annotation.Nullable;
+import javax.crypto.SecretKey;
+
+/**
+ * Looks up master keys by the key handles that refer to them.
+ *
+ * @see TransportCryptoOps#verifydecryptServerMessage(byte[], MasterKeyStore)
+ * @see InMemoryMasterKeyStore
+ */
+public interface MasterKeyStore {
+
+  /**
+   * @param keyHandle the {@code verification_key_id} of an incoming message
+   * @return the master key named by {@code keyHandle}, or null if there isn't one
+   */
+  @Nullable
+  SecretKey getMasterKey(ByteString keyHandle);
+}
@@ -0,0 +1,359 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.annotations.VisibleForTesting;
+import com.google.common.base.Ticker;
+import com.google.common.collect.ImmutableList;
+import com.google.common.hash.BloomFilter;
+import com.google.common.hash.Funnels;
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.Collections;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicLong;
+import javax.annotation.Nullable;
+
+/**
+ * Detects replayed messages within a sliding time window, by remembering a fingerprint of each
+ * message's key id and nonce (its IV).
+ *
+ * <p>Time is divided into buckets of {@code window / BUCKETS_PER_WINDOW}. The newest two buckets
+ * hold their fingerprints exactly; older buckets are compacted into {@link BloomFilter}s, which
+ * take a couple of bytes per message but may report a fresh message as a replay. A bucket also
+ * ends early once it holds {@code entriesPerBucket} fingerprints, which bounds the memory held
+ * exactly. Only fresh messages are recorded, so replays don't fill the buckets. Fingerprints older
+ * than the window are forgotten, so callers must reject older messages by other means.
+ *
+ * <p>Each filter is sized for {@link #FILTER_CAPACITY_BUCKETS} full buckets, with a false positive
+ * probability of {@code falsePositiveProbability / MAX_FILTERS}. Buckets from the same time
+ * interval share a filter until it is full, and then start another. A filter never holds more
+ * than it is sized for, and there are never more than {@link #MAX_FILTERS} of them, so the chance
+ * of rejecting a fresh message stays within {@code falsePositiveProbability} and the memory used
+ * is bounded, however fast messages arrive. If every filter is full, the guard fails closed:
+ * {@link #checkAndRecord} rejects every message until the oldest filter leaves the window.
+ *
+ * <p>Lookups don't lock; only moving on to a new bucket does. This class is thread safe.
+ *
+ * @see TransportCryptoOps#setReplayGuard(ReplayGuard)
+ */
+public class ReplayGuard {
+
+  /**
+   * Number of buckets the window is divided into.
+   */
+  static final int BUCKETS_PER_WINDOW = 8;
+
+  /**
+   * The most Bloom filters kept: enough for one per bucket interval that overlaps the window.
+   */
+  static final int MAX_FILTERS = BUCKETS_PER_WINDOW + 1;
+
+  /**
+   * Number of full buckets that each Bloom filter is sized for.
+   */
+  static final int FILTER_CAPACITY_BUCKETS = 4;
+
+  /**
+   * Number of fingerprint bytes kept, which is plenty to avoid accidental collisions.
+   */
+  private static final int FINGERPRINT_LENGTH = 16;
+
+  /**
+   * Domain separation for the fingerprints.
+   */
+  private static final byte[] FINGERPRINT_PREFIX = {'R', 'P', 'G', '1'};
+
+  private final Ticker ticker;
+  private final long bucketNanos;
+  private final int entriesPerBucket;
+  private final long filterCapacity;
+  private final double filterFalsePositiveProbability;
+  private final AtomicLong replayCount = new AtomicLong();
+  private final AtomicLong overflowCount = new AtomicLong();
+  private final Object rotationLock = new Object();
+
+  private volatile Generation generation;
+
+  /**
+   * @param window how long a message is remembered for
+   * @param unit the unit of {@code window}
+   * @param entriesPerBucket the most messages to remember exactly in each bucket
+   * @param falsePositiveProbability the chance that a fresh message is mistaken for a replay
+   */
+  public ReplayGuard(
+      long window, TimeUnit unit, int entriesPerBucket, double falsePositiveProbability) {
+    this(window, unit, entriesPerBucket, falsePositiveProbability, Ticker.systemTicker());
+  }
+
+  @VisibleForTesting
+  ReplayGuard(
+      long window,
+      TimeUnit unit,
+      int entriesPerBucket,
+      double falsePositiveProbability,
+      Ticker ticker) {
+    if ((window <= 0) || (entriesPerBucket <= 0)) {
+      throw new IllegalArgumentException("Window and bucket size must be positive");
+    }
+    if (!(falsePositiveProbability > 0.0) || !(falsePositiveProbability < 1.0)) {
+      throw new IllegalArgumentException("False positive probability must be in (0, 1)");
+    }
+    this.ticker = ticker;
+    this.bucketNanos = Math.max(1, unit.toNanos(window) / BUCKETS_PER_WINDOW);
+    this.entriesPerBucket = entriesPerBucket;
+    this.filterCapacity = (long) entriesPerBucket * FILTER_CAPACITY_BUCKETS;
+    this.filterFalsePositiveProbability = falsePositiveProbability / MAX_FILTERS;
+    long index = currentIndex();
+    this.generation = new Generation(
+        new Bucket(index), new Bucket(index - 1), ImmutableList.<CompactedBucket>of(), false);
+  }
+
+  /**
+   * Records a message, unless it has been seen before.
+   *
+   * @param keyId identifies the key the message was verified with
+   * @param nonce a value unique to the message, such as its IV
+   * @return true if the message is fresh, and false if it is (probably) a replay, or if every
+   *   filter is full
+   */
+  public boolean checkAndRecord(ByteString keyId, ByteString nonce) {
+    if ((keyId == null) || (nonce == null)) {
+      throw new NullPointerException();
+    }
+    ByteString fingerprint = fingerprint(keyId, nonce);
+    Generation current = currentGeneration();
+    if (current.saturated) {
+      overflowCount.incrementAndGet();
+      return false;
+    }
+    // Check the older buckets first, so that only fresh messages are added to the newest one
+    boolean fresh = !current.previous.contains(fingerprint)
+        && !current.mightContainCompacted(fingerprint)
+        && current.newest.add(fingerprint);
+    // A racing rotation may have started a new bucket, which this message isn't in
+    Generation latest = generation;
+    if (latest != current) {
+      fresh &= !latest.newest.contains(fingerprint);
+    }
+    if (!fresh) {
+      replayCount.incrementAndGet();
+    }
+    return fresh;
+  }
+
+  /**
+   * @return the number of messages rejected as replays
+   */
+  public long getReplayCount() {
+    return replayCount.get();
+  }
+
+  /**
+   * @return the number of messages rejected because every filter was full
+   */
+  public long getOverflowCount() {
+    return overflowCount.get();
+  }
+
+  /**
+   * @return the number of Bloom filters holding compacted buckets
+   */
+  @VisibleForTesting
+  int getCompactedBucketCount() {
+    return generation.compacted.size();
+  }
+
+  private long currentIndex() {
+    return ticker.read() / bucketNanos;
+  }
+
+  private Generation currentGeneration() {
+    Generation current = generation;
+    long index = currentIndex();
+    if ((current.newest.index >= index) && (current.newest.size() < entriesPerBucket)) {
+      return current;
+    }
+    synchronized (rotationLock) {
+      current = generation;
+      if ((current.newest.index >= index) && (current.newest.size() < entriesPerBucket)) {
+        return current;
+      }
+      // The oldest bucket that still overlaps the window
+      long oldestIndex = index - BUCKETS_PER_WINDOW;
+      ImmutableList.Builder<CompactedBucket> compacted = ImmutableList.builder();
+      for (CompactedBucket bucket : current.compacted) {
+        if (bucket.index >= oldestIndex) {
+          compacted.add(bucket);
+        }
+      }
+      ImmutableList<CompactedBucket> kept = compacted.build();
+      if ((current.previous.index >= oldestIndex) && (current.previous.size() > 0)) {
+        kept = compact(current.previous, kept);
+        if (kept == null) {
+          // Every filter is full, and the previous bucket can't be forgotten yet
+          if (!current.saturated) {
+            generation =
+                new Generation(current.newest, current.previous, current.compacted, true);
+          }
+          return generation;
+        }
+      }
+      Bucket previous =
+          (current.newest.index >= oldestIndex) ? current.newest : new Bucket(index - 1);
+      generation = new Generation(
+          new Bucket(Math.max(index, current.newest.index)), previous, kept, false);
+      return generation;
+    }
+  }
+
+  /**
+   * @return {@code compacted} with the fingerprints of {@code bucket} added, either to the filter
+   *   of its time interval if that has room, or to a new filter. Filters in use by readers are
+   *   never modified, so an existing filter is copied first. Null if a new filter is needed but
+   *   there are already {@link #MAX_FILTERS}.
+   */
+  @Nullable
+  private ImmutableList<CompactedBucket> compact(
+      Bucket bucket, ImmutableList<CompactedBucket> compacted) {
+    int size = bucket.size();
+    // Bucket indexes only grow, so a filter for the same interval can only be the last one
+    CompactedBucket last = compacted.isEmpty() ? null : compacted.get(compacted.size() - 1);
+    boolean merge = (last != null)
+        && (last.index == bucket.index)
+        && (last.count + size <= filterCapacity);
+    if (!merge && (compacted.size() >= MAX_FILTERS)) {
+      return null;
+    }
+    BloomFilter<byte[]> filter = merge
+        ? last.filter.copy()
+        : BloomFilter.create(
+            Funnels.byteArrayFunnel(), filterCapacity, filterFalsePositiveProbability);
+    for (ByteString fingerprint : bucket.fingerprints) {
+      filter.put(fingerprint.toByteArray());
+    }
+    ImmutableList.Builder<CompactedBucket> result = ImmutableList.builder();
+    result.addAll(merge ? compacted.subList(0, compacted.size() - 1) : compacted);
+    long count = merge ? last.count + size : size;
+    return result.add(new CompactedBucket(bucket.index, filter, count)).build();
+  }
+
+  @VisibleForTesting
+  static ByteString fingerprint(ByteString keyId, ByteString nonce) {
+    try {
+      MessageDigest sha256 = CryptoOps.getBackend().getMessageDigest("SHA-256");
+      sha256.update(FINGERPRINT_PREFIX);
+      sha256.update(intToBytes(keyId.size()));
+      sha256.update(keyId.asReadOnlyByteBuffer());
+      sha256.update(nonce.asReadOnlyByteBuffer());
+      return ByteString.copyFrom(sha256.digest(), 0, FINGERPRINT_LENGTH);
+    } catch (NoSuchAlgorithmException e) {
+      throw new RuntimeException(e);  // Shouldn't happen
+    }
+  }
+
+  private static byte[] intToBytes(int value) {
+    return new byte[] {
+      (byte) (value >>> 24), (byte) (value >>> 16), (byte) (value >>> 8), (byte) value
+    };
+  }
+
+  /**
+   * The buckets in use at some point in time. Replaced, rather than modified, when a new bucket is
+   * started.
+   */
+  private static final class Generation {
+    final Bucket newest;
+    final Bucket previous;
+    final ImmutableList<CompactedBucket> compacted;
+    /**
+     * Whether the newest bucket is full but every filter is too, so no more messages can be
+     * recorded.
+     */
+    final boolean saturated;
+
+    Generation(
+        Bucket newest,
+        Bucket previous,
+        ImmutableList<CompactedBucket> compacted,
+        boolean saturated) {
+      this.newest = newest;
+      this.previous = previous;
+      this.compacted = compacted;
+      this.saturated = saturated;
+    }
+
+    boolean mightContainCompacted(ByteString fingerprint) {
+      if (compacted.isEmpty()) {
+        return false;
+      }
+      byte[] bytes = fingerprint.toByteArray();
+      for (CompactedBucket bucket : compacted) {
+        if (bucket.filter.mightContain(bytes)) {
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+
+  /**
+   * The fingerprints recorded in a bucket, held exactly.
+   */
+  private static final class Bucket {
+    final long index;
+    final Set<ByteString> fingerprints =
+        Collections.newSetFromMap(new ConcurrentHashMap<ByteString, Boolean>());
+
+    Bucket(long index) {
+      this.index = index;
+    }
+
+    boolean add(ByteString fingerprint) {
+      return fingerprints.add(fingerprint);
+    }
+
+    boolean contains(ByteString fingerprint) {
+      return fingerprints.contains(fingerprint);
+    }
+
+    int size() {
+      return fingerprints.size();
+    }
+  }
+
+  /**
+   * The fingerprints of one or more buckets from the same interval, compacted into a Bloom filter
+   * that is no longer modified.
+   */
+  private static final class CompactedBucket {
+    final long index;
+    final BloomFilter<byte[]> filter;
+    /**
+     * The number of fingerprints put into {@link #filter}.
+     */
+    final long count;
+
+    CompactedBucket(long index, BloomFilter<byte[]> filter, long count) {
+      this.index = index;
+      this.filter = filter;
+      this.count = count;
+    }
+  }
+}
@@ -0,0 +1,230 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.base.Throwables;
+import com.google.common.util.concurrent.MoreExecutors;
+import java.io.BufferedInputStream;
+import java.io.DataInputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.util.ArrayDeque;
+import java.util.Arrays;
+import java.util.Deque;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Future;
+
+/**
+ * Restores a large number of saved {@link D2DConnectionContext}s at once, e.g. when a server
+ * restarts.
+ *
+ * <p>Saved sessions are stored back to back in a stream. Each record is a 4 byte big-endian length
+ * followed by the output of {@link D2DConnectionContext#saveSession()}, as written by {@link
+ * #writeSession(D2DConnectionContext, OutputStream)}. Records are read in batches of {@link
+ * #RECORDS_PER_TASK}, and every batch is restored in place (without copying each record out first)
+ * by a task on the given executor.
+ *
+ * <p>A record that doesn't hold a valid saved session is reported to the {@link Listener} and
+ * skipped. Only a truncated stream, or a record length that can't be right, ends the restore early,
+ * since the records that follow can't be found.
+ */
+public final class SavedSessionLoader {
+
+  /**
+   * The longest record accepted. Saved sessions are much shorter than this.
+   */
+  public static final int MAX_RECORD_LENGTH = 1024;
+
+  /**
+   * Number of records restored by each task.
+   */
+  static final int RECORDS_PER_TASK = 1024;
+
+  /**
+   * Bounds the number of batches read ahead of the tasks restoring them.
+   */
+  private static final int MAX_PENDING_TASKS = 64;
+
+  /**
+   * Receives the outcome of each record. Records are numbered from 0 in the order they appear in
+   * the stream. When restoring on an executor, the listener may be called from several threads at
+   * once, and not in record order.
+   */
+  public interface Listener {
+
+    /**
+     * Called with the context restored from record {@code index}.
+     */
+    void onSessionRestored(long index, D2DConnectionContext context);
+
+    /**
+     * Called when record {@code index} could not be restored.
+     */
+    void onCorruptRecord(long index, Exception cause);
+  }
+
+  private SavedSessionLoader() {}
+
+  /**
+   * Appends a record holding the saved session of {@code context} to {@code out}.
+   */
+  public static void writeSession(D2DConnectionContext context, OutputStream out)
+      throws IOException {
+    if ((context == null) || (out == null)) {
+      throw new NullPointerException();
+    }
+    byte[] savedSession = context.saveSession();
+    out.write(D2DConnectionContext.signedIntToBytes(savedSession.length));
+    out.write(savedSession);
+  }
+
+  /**
+   * Restores every record in {@code in} on the calling thread.
+   *
+   * @return the number of sessions restored
+   * @throws IOException if reading from {@code in} fails
+   */
+  public static long restore(InputStream in, Listener listener) throws IOException {
+    try {
+      return restore(in, listener, MoreExecutors.newDirectExecutorService());
+    } catch (InterruptedException e) {
+      // Never happens, as the tasks have all completed when they are waited for
+      Thread.currentThread().interrupt();
+      throw new IllegalStateException(e);
+    }
+  }
+
+  /**
+   * Restores every record in {@code in}, reading on the calling thread and restoring the batches
+   * on {@code executor}. Returns once every record has been passed to {@code listener}.
+   *
+   * @return the number of sessions restored
+   * @throws IOException if reading from {@code in} fails
+   */
+  public static long restore(InputStream in, Listener listener, ExecutorService executor)
+      throws IOException, InterruptedException {
+    if ((in == null) || (listener == null) || (executor == null)) {
+      throw new NullPointerException();
+    }
+    DataInputStream data = new DataInputStream(new BufferedInputStream(in));
+    Deque<Future<Integer>> pending = new ArrayDeque<>();
+    long restored = 0;
+    long index = 0;
+    boolean more = true;
+    while (more) {
+      Batch batch = new Batch(index, listener);
+      more = batch.readFrom(data);
+      index += batch.size;
+      if (batch.size > 0) {
+        if (pending.size() == MAX_PENDING_TASKS) {
+          restored += getRestored(pending.removeFirst());
+        }
+        pending.addLast(executor.submit(batch));
+      }
+    }
+    while (!pending.isEmpty()) {
+      restored += getRestored(pending.removeFirst());
+    }
+    return restored;
+  }
+
+  private static int getRestored(Future<Integer> future) throws InterruptedException {
+    try {
+      return future.get();
+    } catch (ExecutionException e) {
+      // Thrown by the listener
+      Throwables.propagateIfPossible(e.getCause());
+      throw new IllegalStateException(e.getCause());
+    }
+  }
+
+  /**
+   * Up to {@link #RECORDS_PER_TASK} consecutive records, read into a single buffer.
+   */
+  private static final class Batch implements Callable<Integer> {
+    private final long firstIndex;
+    private final Listener listener;
+    private final int[] offsets = new int[RECORDS_PER_TASK + 1];
+    // Large enough for a batch of v1 sessions, the longest there are
+    private byte[] buffer = new byte[RECORDS_PER_TASK * 73];
+    private int size = 0;
+
+    Batch(long firstIndex, Listener listener) {
+      this.firstIndex = firstIndex;
+      this.listener = listener;
+    }
+
+    /**
+     * Reads records until the batch is full, or the stream ends.
+     *
+     * @return true if there may be more records to read
+     */
+    boolean readFrom(DataInputStream data) throws IOException {
+      while (size < RECORDS_PER_TASK) {
+        long index = firstIndex + size;
+        int first = data.read();
+        if (first < 0) {
+          return false;
+        }
+        int length;
+        try {
+          length = (first << 24) | (data.readUnsignedByte() << 16) | data.readUnsignedShort();
+        } catch (EOFException e) {
+          listener.onCorruptRecord(index, e);
+          return false;
+        }
+        if ((length < 0) || (length > MAX_RECORD_LENGTH)) {
+          listener.onCorruptRecord(index, new IOException("Invalid record length: " + length));
+          return false;
+        }
+
+        int offset = offsets[size];
+        if (offset + length > buffer.length) {
+          buffer = Arrays.copyOf(buffer, Math.max(2 * buffer.length, offset + length));
+        }
+        try {
+          data.readFully(buffer, offset, length);
+        } catch (EOFException e) {
+          listener.onCorruptRecord(index, e);
+          return false;
+        }
+        offsets[++size] = offset + length;
+      }
+      return true;
+    }
+
+    @Override
+    public Integer call() {
+      int restored = 0;
+      for (int i = 0; i < size; i++) {
+        D2DConnectionContext context;
+        try {
+          context = D2DConnectionContext.fromSavedSession(
+              buffer, offsets[i], offsets[i + 1] - offsets[i]);
+        } catch (IllegalArgumentException e) {
+          listener.onCorruptRecord(firstIndex + i, e);
+          continue;
+        }
+        listener.onSessionRestored(firstIndex + i, context);
+        restored++;
+      }
+      return restored;
+    }
+  }
+}
@@ -14,15 +14,21 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.common.base.Throwables;
+import com.google.protobuf.ByteString;
 import com.google.protobuf.InvalidProtocolBufferException;
 import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmMetadata;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import com.google.security.cryptauth.lib.securemessage.PreparedPublicKey;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageBuilder;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageParser;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageParser.KeyResolver;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.Header;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.HeaderAndBody;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.SecureMessage;
 import java.security.InvalidKeyException;
+import java.security.Key;
 import java.security.KeyPair;
 import java.security.NoSuchAlgorithmException;
 import java.security.PrivateKey;
@@ -30,6 +36,14 @@ import java.security.PublicKey;
 import java.security.SignatureException;
 import java.security.interfaces.ECPublicKey;
 import java.security.interfaces.RSAPublicKey;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Future;
+import javax.annotation.Nullable;
 import javax.crypto.SecretKey;
 
 /**
@@ -107,6 +121,63 @@ public class TransportCryptoOps {
     }
   }
 
+  /**
+   * A client to send a server message to: a {@code masterKey}, and the {@code keyHandle} by which
+   * the client refers to it.
+   *
+   * @see TransportCryptoOps#signcryptServerMessage(Payload, List, ExecutorService)
+   */
+  public static class Recipient {
+    private final SecretKey masterKey;
+    private final byte[] keyHandle;
+
+    public Recipient(SecretKey masterKey, byte[] keyHandle) {
+      if ((masterKey == null) || (keyHandle == null)) {
+        throw new NullPointerException();
+      }
+      this.masterKey = masterKey;
+      this.keyHandle = keyHandle;
+    }
+
+    public SecretKey getMasterKey() {
+      return masterKey;
+    }
+
+    public byte[] getKeyHandle() {
+      return keyHandle;
+    }
+  }
+
+  /**
+   * Number of recipients signcrypted by each task submitted to an executor.
+   */
+  private static final int RECIPIENTS_PER_TASK = 32;
+
+  /**
+   * If set, verified messages are checked for replays here.
+   */
+  @Nullable private static volatile ReplayGuard replayGuard = null;
+
+  /**
+   * Installs a {@link ReplayGuard} that every message verified by this class, and by {@link
+   * EnrollmentCryptoOps#decryptEnrollmentMessage(byte[], SecretKey, boolean)}, is checked against.
+   * A message seen before fails verification. Passing {@code null} disables replay detection.
+   */
+  public static void setReplayGuard(@Nullable ReplayGuard guard) {
+    replayGuard = guard;
+  }
+
+  /**
+   * @throws SignatureException if the installed {@link ReplayGuard} has already seen a message with
+   *   the same {@code keyId} and {@code nonce}
+   */
+  static void checkNotReplayed(ByteString keyId, ByteString nonce) throws SignatureException {
+    ReplayGuard guard = replayGuard;
+    if ((guard != null) && !guard.checkAndRecord(keyId, nonce)) {
+      throw new SignatureException("Replayed message");
+    }
+  }
+
   /**
    * Used by the the server-side to send a secure {@link Payload} to the client.
    *
@@ -119,22 +190,94 @@ public class TransportCryptoOps {
     if ((payload == null) || (masterKey == null) || (keyHandle == null)) {
       throw new NullPointerException();
     }
-    return new SecureMessageBuilder()
-        .setVerificationKeyId(keyHandle)
-        .setPublicMetadata(GcmMetadata.newBuilder()
-            .setType(payload.getPayloadType().getType())
-            .setVersion(SecureGcmConstants.SECURE_GCM_VERSION)
-            .build()
-            .toByteArray())
-        .buildSignCryptedMessage(
-            masterKey,
-            SigType.HMAC_SHA256,
-            masterKey,
-            EncType.AES_256_CBC,
-            payload.getMessage())
+    return signcryptServerMessages(
+        payload,
+        encodeMetadata(payload.getPayloadType()),
+        Collections.singletonList(new Recipient(masterKey, keyHandle)))
+        .get(0);
+  }
+
+  /**
+   * Used by the server-side to send the same secure {@link Payload} to many clients. The result is
+   * the same as calling {@link #signcryptServerMessage(Payload, SecretKey, byte[])} for each
+   * recipient, but the public metadata is only encoded once.
+   *
+   * @return the signcrypted messages, in the same order as {@code recipients}
+   */
+  public static List<byte[]> signcryptServerMessage(Payload payload, List<Recipient> recipients)
+      throws InvalidKeyException, NoSuchAlgorithmException {
+    if ((payload == null) || (recipients == null)) {
+      throw new NullPointerException();
+    }
+    return signcryptServerMessages(payload, encodeMetadata(payload.getPayloadType()), recipients);
+  }
+
+  /**
+   * Like {@link #signcryptServerMessage(Payload, List)}, but divides the recipients into batches
+   * that are signcrypted in parallel on {@code executor}.
+   *
+   * @return the signcrypted messages, in the same order as {@code recipients}
+   * @throws InterruptedException if interrupted while waiting for the batches to finish
+   */
+  public static List<byte[]> signcryptServerMessage(
+      final Payload payload, List<Recipient> recipients, ExecutorService executor)
+      throws InvalidKeyException, NoSuchAlgorithmException, InterruptedException {
+    if ((payload == null) || (recipients == null) || (executor == null)) {
+      throw new NullPointerException();
+    }
+    final byte[] metadata = encodeMetadata(payload.getPayloadType());
+    List<Callable<List<byte[]>>> tasks = new ArrayList<>();
+    for (int i = 0; i < recipients.size(); i += RECIPIENTS_PER_TASK) {
+      final List<Recipient> batch =
+          recipients.subList(i, Math.min(recipients.size(), i + RECIPIENTS_PER_TASK));
+      tasks.add(new Callable<List<byte[]>>() {
+        @Override
+        public List<byte[]> call() throws InvalidKeyException, NoSuchAlgorithmException {
+          return signcryptServerMessages(payload, metadata, batch);
+        }
+      });
+    }
+    List<byte[]> result = new ArrayList<>(recipients.size());
+    for (Future<List<byte[]>> future : executor.invokeAll(tasks)) {
+      try {
+        result.addAll(future.get());
+      } catch (ExecutionException e) {
+        Throwables.propagateIfPossible(
+            e.getCause(), InvalidKeyException.class, NoSuchAlgorithmException.class);
+        throw new IllegalStateException(e.getCause());
+      }
+    }
+    return result;
+  }
+
+  private static byte[] encodeMetadata(PayloadType payloadType) {
+    return GcmMetadata.newBuilder()
+        .setType(payloadType.getType())
+        .setVersion(SecureGcmConstants.SECURE_GCM_VERSION)
+        .build()
         .toByteArray();
   }
 
+  private static List<byte[]> signcryptServerMessages(
+      Payload payload, byte[] metadata, List<Recipient> recipients)
+      throws InvalidKeyException, NoSuchAlgorithmException {
+    // One builder (and its SecureRandom) serves the whole batch
+    SecureMessageBuilder builder = new SecureMessageBuilder().setPublicMetadata(metadata);
+    List<byte[]> result = new ArrayList<>(recipients.size());
+    for (Recipient recipient : recipients) {
+      result.add(builder
+          .setVerificationKeyId(recipient.getKeyHandle())
+          .buildSignCryptedMessage(
+              recipient.getMasterKey(),
+              SigType.HMAC_SHA256,
+              recipient.getMasterKey(),
+              EncType.AES_256_CBC,
+              payload.getMessage())
+          .toByteArray());
+    }
+    return result;
+  }
+
   /**
    * Extracts the {@code keyHandle} from a {@code signcryptedMessage}.
    *
@@ -162,17 +305,68 @@ public class TransportCryptoOps {
       throw new NullPointerException();
     }
     try {
-      SecureMessage secmsg = SecureMessage.parseFrom(signcryptedServerMessage);
-      HeaderAndBody parsed = SecureMessageParser.parseSignCryptedMessage(
-          secmsg,
-          masterKey,
-          SigType.HMAC_SHA256,
-          masterKey,
-          EncType.AES_256_CBC);
+      return verifydecryptServerMessage(
+          SecureMessage.parseFrom(signcryptedServerMessage), masterKey);
+    } catch (InvalidProtocolBufferException e) {
+      throw new SignatureException(e);
+    }
+  }
+
+  /**
+   * Recovers a secure {@link Payload} sent by the server-side, looking up the master key by the
+   * message's {@code keyHandle}. Unlike calling {@link #getKeyHandleFor(byte[])}
+   * followed by {@link #verifydecryptServerMessage(byte[], SecretKey)}, the message is only parsed
+   * once: the {@code HeaderAndBody} read to find the key handle is the one that gets verified.
+   *
+   * @throws SignatureException if {@code keyStore} has no key for the message's {@code keyHandle},
+   *   or if the message fails verification
+   * @see #signcryptServerMessage(Payload, SecretKey, byte[])
+   */
+  public static Payload verifydecryptServerMessage(
+      byte[] signcryptedServerMessage, final MasterKeyStore keyStore)
+      throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
+    if ((signcryptedServerMessage == null) || (keyStore == null)) {
+      throw new NullPointerException();
+    }
+    SecureMessage secmsg;
+    try {
+      secmsg = SecureMessage.parseFrom(signcryptedServerMessage);
+    } catch (InvalidProtocolBufferException e) {
+      throw new SignatureException(e);
+    }
+    return toServerPayload(SecureMessageParser.parseSignCryptedMessage(
+        secmsg,
+        new KeyResolver() {
+          @Override
+          public Key resolveKey(Header unverifiedHeader) {
+            return keyStore.getMasterKey(unverifiedHeader.getVerificationKeyId());
+          }
+        },
+        SigType.HMAC_SHA256,
+        EncType.AES_256_CBC));
+  }
+
+  private static Payload verifydecryptServerMessage(SecureMessage secmsg, SecretKey masterKey)
+      throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
+    return toServerPayload(SecureMessageParser.parseSignCryptedMessage(
+        secmsg,
+        masterKey,
+        SigType.HMAC_SHA256,
+        masterKey,
+        EncType.AES_256_CBC));
+  }
+
+  /**
+   * @param parsed a verified and decrypted server message
+   */
+  private static Payload toServerPayload(HeaderAndBody parsed) throws SignatureException {
+    try {
       GcmMetadata metadata = GcmMetadata.parseFrom(parsed.getHeader().getPublicMetadata());
       if (metadata.getVersion() > SecureGcmConstants.SECURE_GCM_VERSION) {
         throw new SignatureException("Unsupported protocol version");
       }
+      Header header = parsed.getHeader();
+      checkNotReplayed(header.getVerificationKeyId(), header.getIv());
       return new Payload(PayloadType.valueOf(metadata.getType()), parsed.getBody().toByteArray());
     } catch (InvalidProtocolBufferException | IllegalArgumentException e) {
       throw new SignatureException(e);
@@ -224,18 +418,35 @@ public class TransportCryptoOps {
     if ((signcryptedClientMessage == null) || (masterKey == null)) {
       throw new NullPointerException();
     }
+    return verifydecryptClientMessage(
+        signcryptedClientMessage, userPublicKey, getSigTypeFor(userPublicKey), masterKey);
+  }
+
+  /**
+   * @param userPublicKey may be a {@link PreparedPublicKey}, in which case {@code sigType} must be
+   *   the type it was prepared for
+   * @see ClientMessageVerifier
+   */
+  static Payload verifydecryptClientMessage(
+      byte[] signcryptedClientMessage,
+      PublicKey userPublicKey,
+      SigType sigType,
+      SecretKey masterKey)
+      throws SignatureException, InvalidKeyException, NoSuchAlgorithmException {
     try {
       SecureMessage secmsg = SecureMessage.parseFrom(signcryptedClientMessage);
       HeaderAndBody parsed = SecureMessageParser.parseSignCryptedMessage(
           secmsg,
           userPublicKey,
-          getSigTypeFor(userPublicKey),
+          sigType,
           masterKey,
           EncType.AES_256_CBC);
       GcmMetadata metadata = GcmMetadata.parseFrom(parsed.getHeader().getPublicMetadata());
       if (metadata.getVersion() > SecureGcmConstants.SECURE_GCM_VERSION) {
         throw new SignatureException("Unsupported protocol version");
       }
+      Header header = parsed.getHeader();
+      checkNotReplayed(header.getVerificationKeyId(), header.getIv());
       return new Payload(PayloadType.valueOf(metadata.getType()), parsed.getBody().toByteArray());
     } catch (InvalidProtocolBufferException | IllegalArgumentException e) {
       throw new SignatureException(e);
@@ -256,7 +467,7 @@ public class TransportCryptoOps {
     return SecureMessageParser.getUnverifiedHeader(secmsg).getVerificationKeyId().toByteArray();
   }
 
-  private static SigType getSigTypeFor(PublicKey userPublicKey) throws InvalidKeyException {
+  static SigType getSigTypeFor(PublicKey userPublicKey) throws InvalidKeyException {
     if (userPublicKey instanceof ECPublicKey) {
       return SigType.ECDSA_P256_SHA256;
     } else if (userPublicKey instanceof RSAPublicKey) {
@@ -247,6 +247,9 @@ public class Ukey2Handshake {
   // Servers need to store client commitments.
   private byte[] theirCommitment;
 
+  // Servers send their public key compressed if the client said it accepts that.
+  private boolean clientAcceptsCompressedPublicKey;
+
   // We store the raw messages sent for computing the authentication strings and next key.
   private byte[] rawMessage1;
   private byte[] rawMessage2;
@@ -557,6 +560,7 @@ public class Ukey2Handshake {
     clientInit.setVersion(VERSION);
     clientInit.setRandom(ByteString.copyFrom(generateRandomNonce()));
     clientInit.setNextProtocol(NEXT_PROTOCOL);
+    clientInit.setAcceptsCompressedPublicKey(true);
 
     // At the moment, we only support one cipher
     clientInit.addCipherCommitments(generateP256SHA512Commitment());
@@ -572,8 +576,12 @@ public class Ukey2Handshake {
     serverInit.setVersion(VERSION);
     serverInit.setRandom(ByteString.copyFrom(generateRandomNonce()));
     serverInit.setHandshakeCipher(handshakeCipher.getValue());
-    serverInit.setPublicKey(
-        PublicKeyProtoUtil.encodePublicKey(ourKeyPair.getPublic()).toByteString());
+    // The client's key was committed to in ClientInit, before it could learn whether we accept
+    // compressed keys, so only our own key can be sent compressed.
+    GenericPublicKey publicKey = clientAcceptsCompressedPublicKey
+        ? PublicKeyProtoUtil.encodeCompressedPublicKey(ourKeyPair.getPublic())
+        : PublicKeyProtoUtil.encodePublicKey(ourKeyPair.getPublic());
+    serverInit.setPublicKey(publicKey.toByteString());
 
     return serverInit.build().toByteArray();
   }
@@ -683,6 +691,8 @@ public class Ukey2Handshake {
       throwAlertException(Ukey2Alert.AlertType.BAD_NEXT_PROTOCOL, "Incorrect next protocol");
     }
 
+    clientAcceptsCompressedPublicKey = clientInit.getAcceptsCompressedPublicKey();
+
     // Store raw message for AUTH_STRING computation
     rawMessage1 = handshakeMessage;
   }
@@ -998,7 +1008,7 @@ public class Ukey2Handshake {
   private byte[] sha512(byte[] input) throws HandshakeException {
     MessageDigest sha512;
     try {
-      sha512 = MessageDigest.getInstance("SHA-512");
+      sha512 = CryptoOps.getBackend().getMessageDigest("SHA-512");
       return sha512.digest(input);
     } catch (NoSuchAlgorithmException e) {
       throwHandshakeException("No security provider initialized yet?", e);
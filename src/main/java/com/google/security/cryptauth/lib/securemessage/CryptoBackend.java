@@ -0,0 +1,56 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.security.KeyFactory;
+import java.security.KeyPairGenerator;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.security.Signature;
+import javax.crypto.Cipher;
+import javax.crypto.KeyAgreement;
+import javax.crypto.Mac;
+import javax.crypto.NoSuchPaddingException;
+
+/**
+ * Creates the JCA engines used throughout this library (digests, MACs and therefore HKDF, ciphers,
+ * signatures, key agreement, key factories and key generation), so that the {@link
+ * java.security.Provider} they come from can be chosen in one place.
+ *
+ * <p>This selects between JCA providers; it is not a primitive-level interface, and there is no
+ * implementation that calls the host's libcrypto directly. Such a backend would still have to
+ * present the library through JCA engine classes.
+ *
+ * <p>Implementations must be thread safe, and return a new engine from every call.
+ *
+ * @see CryptoOps#setBackend(CryptoBackend)
+ * @see JcaCryptoBackend
+ */
+public interface CryptoBackend {
+
+  MessageDigest getMessageDigest(String algorithm) throws NoSuchAlgorithmException;
+
+  Mac getMac(String algorithm) throws NoSuchAlgorithmException;
+
+  Cipher getCipher(String transformation) throws NoSuchAlgorithmException, NoSuchPaddingException;
+
+  Signature getSignature(String algorithm) throws NoSuchAlgorithmException;
+
+  KeyAgreement getKeyAgreement(String algorithm) throws NoSuchAlgorithmException;
+
+  KeyFactory getKeyFactory(String algorithm) throws NoSuchAlgorithmException;
+
+  KeyPairGenerator getKeyPairGenerator(String algorithm) throws NoSuchAlgorithmException;
+}
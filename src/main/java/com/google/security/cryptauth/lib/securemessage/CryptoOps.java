@@ -22,6 +22,7 @@ import java.security.Key;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
 import java.security.PrivateKey;
+import java.security.Provider;
 import java.security.PublicKey;
 import java.security.SecureRandom;
 import java.security.Signature;
@@ -128,11 +129,61 @@ public class CryptoOps {
    * Truncated hash output length, in bytes.
    */
   static final int DIGEST_LENGTH = 20;
+  /**
+   * Where all of the cryptographic engines used by this library come from. Declared before
+   * {@link #SALT}, which needs it during class initialization.
+   */
+  private static volatile CryptoBackend backend = JcaCryptoBackend.DEFAULT;
+
   /**
    * A salt value specific to this library, generated as SHA-256("SecureMessage")
    */
   private static final byte[] SALT = sha256("SecureMessage");
 
+  /**
+   * Replaces the source of every cryptographic engine used by this library (including by the
+   * {@code securegcm} classes), e.g. with a {@link JcaCryptoBackend} that pins some algorithms to a
+   * faster provider. The default is {@link JcaCryptoBackend#DEFAULT}.
+   */
+  public static void setBackend(CryptoBackend newBackend) {
+    if (newBackend == null) {
+      throw new NullPointerException();
+    }
+    backend = newBackend;
+  }
+
+  /**
+   * @return the backend set by {@link #setBackend(CryptoBackend)}
+   */
+  public static CryptoBackend getBackend() {
+    return backend;
+  }
+
+  /**
+   * If set, all NIST P-256 operations (ECDSA here, key generation in {@link PublicKeyProtoUtil},
+   * and ECDH key agreement in {@code EnrollmentCryptoOps}) use this provider.
+   */
+  @Nullable private static volatile Provider ecProvider = null;
+
+  /**
+   * Routes this library's NIST P-256 key generation, ECDH and ECDSA operations through
+   * {@code provider} (e.g., an {@link EcP256Provider}) instead of the platform default providers.
+   * Passing {@code null} reverts to the {@link #getBackend() backend}. Keys from either choice work
+   * with the other.
+   */
+  public static void setEcProvider(@Nullable Provider provider) {
+    ecProvider = provider;
+  }
+
+  /**
+   * @return the provider set by {@link #setEcProvider(Provider)}, or null if the platform default
+   *   providers are in use
+   */
+  @Nullable
+  public static Provider getEcProvider() {
+    return ecProvider;
+  }
+
   /**
    * Signs {@code data} using the algorithm specified by {@code sigType} with {@code signingKey}.
    *
@@ -154,7 +205,7 @@ public class CryptoOps {
       if (!(signingKey instanceof PrivateKey)) {
         throw new InvalidKeyException("Expected a PrivateKey");
       }
-      Signature sigScheme = Signature.getInstance(sigType.getJcaName());
+      Signature sigScheme = getSignature(sigType);
       sigScheme.initSign((PrivateKey) signingKey, rng);
       try {
         // We include a fixed magic value (salt) in the signature so that if the signing key is
@@ -167,7 +218,7 @@ public class CryptoOps {
         throw new IllegalStateException(e);  // Consistent with failures in Mac.doFinal
       }
     } else {
-      Mac macScheme = Mac.getInstance(sigType.getJcaName());
+      Mac macScheme = backend.getMac(sigType.getJcaName());
       // Note that an AES-256 SecretKey should work with most Mac schemes
       SecretKey derivedKey = deriveAes256KeyFor(getSecretKey(signingKey), getPurpose(sigType));
       macScheme.init(derivedKey);
@@ -177,7 +228,8 @@ public class CryptoOps {
 
   /**
    * Verifies the {@code signature} on {@code data} using the algorithm specified by
-   * {@code sigType} with {@code verificationKey}.
+   * {@code sigType} with {@code verificationKey}. The verification engine of a {@link
+   * PreparedPublicKey} is reused rather than created.
    *
    * @return true iff the signature is verified
    * @throws NoSuchAlgorithmException if the security provider is inadequate for {@code sigType}
@@ -193,13 +245,29 @@ public class CryptoOps {
       if (!(verificationKey instanceof PublicKey)) {
         throw new InvalidKeyException("Expected a PublicKey");
       }
-      Signature sigScheme = Signature.getInstance(sigType.getJcaName());
-      sigScheme.initVerify((PublicKey) verificationKey);
-      sigScheme.update(SALT);  // See the comments in sign() for more on this
-      sigScheme.update(data);
-      return sigScheme.verify(signature);
+      PreparedPublicKey prepared = null;
+      Signature sigScheme = null;
+      if (verificationKey instanceof PreparedPublicKey) {
+        prepared = (PreparedPublicKey) verificationKey;
+        verificationKey = prepared.getPublicKey();
+        sigScheme = prepared.getVerifier(sigType);
+      }
+      if (sigScheme == null) {
+        sigScheme = getSignature(sigType);
+        sigScheme.initVerify((PublicKey) verificationKey);
+      }
+      try {
+        sigScheme.update(SALT);  // See the comments in sign() for more on this
+        sigScheme.update(data);
+        return sigScheme.verify(signature);
+      } catch (SignatureException | RuntimeException e) {
+        if (prepared != null) {
+          prepared.discardVerifier();
+        }
+        throw e;
+      }
     } else {
-      Mac macScheme = Mac.getInstance(sigType.getJcaName());
+      Mac macScheme = backend.getMac(sigType.getJcaName());
       SecretKey derivedKey =
           deriveAes256KeyFor(getSecretKey(verificationKey), getPurpose(sigType));
       macScheme.init(derivedKey);
@@ -207,6 +275,14 @@ public class CryptoOps {
     }
   }
 
+  static Signature getSignature(SigType sigType) throws NoSuchAlgorithmException {
+    Provider provider = ecProvider;
+    if ((provider != null) && (sigType == SigType.ECDSA_P256_SHA256)) {
+      return Signature.getInstance(sigType.getJcaName(), provider);
+    }
+    return backend.getSignature(sigType.getJcaName());
+  }
+
   /**
    * Generate a random IV appropriate for use with the algorithm specified in {@code encType}.
    *
@@ -220,7 +296,7 @@ public class CryptoOps {
       throw new NullPointerException();
     }
     try {
-      Cipher encrypter = Cipher.getInstance(encType.getJcaName());
+      Cipher encrypter = backend.getCipher(encType.getJcaName());
       byte[] iv = new byte[encrypter.getBlockSize()];
       rng.nextBytes(iv);
       return iv;
@@ -250,7 +326,7 @@ public class CryptoOps {
       throw new NoSuchAlgorithmException("Cannot use NONE type here");
     }
     try {
-      Cipher encrypter = Cipher.getInstance(encType.getJcaName());
+      Cipher encrypter = backend.getCipher(encType.getJcaName());
       SecretKey derivedKey =
           deriveAes256KeyFor(getSecretKey(encryptionKey), getPurpose(encType));
       encrypter.init(Cipher.ENCRYPT_MODE, derivedKey, new IvParameterSpec(iv), rng);
@@ -290,7 +366,7 @@ public class CryptoOps {
       throw new NoSuchAlgorithmException("Cannot use NONE type here");
     }
     try {
-      Cipher decrypter = Cipher.getInstance(encType.getJcaName());
+      Cipher decrypter = backend.getCipher(encType.getJcaName());
       SecretKey derivedKey =
           deriveAes256KeyFor(getSecretKey(decryptionKey), getPurpose(encType));
       decrypter.init(Cipher.DECRYPT_MODE, derivedKey, new IvParameterSpec(iv));
@@ -305,7 +381,7 @@ public class CryptoOps {
    * (using a truncated SHA-256 output).
    */
   static byte[] digest(byte[] data) throws NoSuchAlgorithmException {
-    MessageDigest sha256 = MessageDigest.getInstance("SHA-256");
+    MessageDigest sha256 = backend.getMessageDigest("SHA-256");
     byte[] truncatedHash = new byte[DIGEST_LENGTH];
     System.arraycopy(sha256.digest(data), 0, truncatedHash, 0, DIGEST_LENGTH);
     return truncatedHash;
@@ -374,7 +450,7 @@ public class CryptoOps {
   public static byte[] sha256(String input) {
     MessageDigest sha256;
     try {
-      sha256 = MessageDigest.getInstance("SHA-256");
+      sha256 = backend.getMessageDigest("SHA-256");
       return sha256.digest(utf8StringToBytes(input));
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException("No security provider initialized yet?", e);
@@ -387,13 +463,17 @@ public class CryptoOps {
    * and produces a derived AES-256 key safe to use as if it were independent of any other
    * derived key which used a different {@code purpose}.
    *
-   * @param masterKey any key suitable for use with HmacSHA256
+   * @param masterKey any key suitable for use with HmacSHA256. Derivations from a {@link
+   *   PreparedSecretKey} are only computed once.
    * @param purpose a UTF-8 encoded string describing the intended purpose of derived key
    * @return a derived SecretKey suitable for use with AES-256
    * @throws InvalidKeyException if the encoded form of {@code masterKey} cannot be accessed
    */
   static SecretKey deriveAes256KeyFor(SecretKey masterKey, String purpose)
       throws NoSuchAlgorithmException, InvalidKeyException {
+    if (masterKey instanceof PreparedSecretKey) {
+      return ((PreparedSecretKey) masterKey).getDerivedKey(purpose);
+    }
     return new SecretKeySpec(hkdf(masterKey, SALT, utf8StringToBytes(purpose)), "AES");
   }
 
@@ -495,7 +575,7 @@ public class CryptoOps {
    */
   private static byte[] hkdfSha256Extract(SecretKey inputKeyMaterial, byte[] salt)
       throws NoSuchAlgorithmException, InvalidKeyException {
-    Mac macScheme = Mac.getInstance("HmacSHA256");
+    Mac macScheme = backend.getMac("HmacSHA256");
     try {
       macScheme.init(new SecretKeySpec(salt, "AES"));
     } catch (InvalidKeyException e) {
@@ -521,7 +601,7 @@ public class CryptoOps {
    */
   private static byte[] hkdfSha256Expand(byte[] pseudoRandomKey, byte[] info, int length)
       throws NoSuchAlgorithmException {
-    Mac macScheme = Mac.getInstance("HmacSHA256");
+    Mac macScheme = backend.getMac("HmacSHA256");
     try {
       macScheme.init(new SecretKeySpec(pseudoRandomKey, "AES"));
     } catch (InvalidKeyException e) {
@@ -0,0 +1,98 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.math.BigInteger;
+
+/**
+ * Computes {@code DH_G^x mod DH_P} for the fixed 2048-bit Diffie-Hellman group used by {@link
+ * PublicKeyProtoUtil}, using a precomputed table of powers of the generator.
+ *
+ * <p>The exponent is split into {@link #WINDOW_BITS}-bit digits, and the table holds
+ * {@code g^(d * 2^(WINDOW_BITS * i))} for every digit value {@code d} and position {@code i}.
+ * A {@link PublicKeyProtoUtil#DH_LEN}-bit exponent then costs one modular multiplication per
+ * nonzero digit, with no squarings at all, which is several times cheaper than {@link
+ * BigInteger#modPow}. With {@code DH_LEN} = 512 exponent bits the table holds 128 windows of 16
+ * 2048-bit values: 2048 * 256 bytes, about 600 KB once BigInteger overhead is counted. It is built
+ * on first use.
+ *
+ * <p>This is not constant time: zero digits are skipped, and the table is indexed by the digits
+ * of the secret exponent, so timing and cache behavior depend on the exponent.
+ */
+final class Dh2048FixedBase {
+
+  private Dh2048FixedBase() {}  // Do not instantiate
+
+  /**
+   * Number of exponent bits consumed per table lookup.
+   */
+  static final int WINDOW_BITS = 4;
+
+  private static final int DIGITS = 1 << WINDOW_BITS;
+
+  private static final int WINDOWS =
+      (PublicKeyProtoUtil.DH_LEN + WINDOW_BITS - 1) / WINDOW_BITS;
+
+  /**
+   * Holds the table, so that it is only built by callers that actually need it.
+   */
+  private static final class TableHolder {
+    static final BigInteger[][] TABLE = buildTable();
+  }
+
+  /**
+   * @return {@code DH_G^x mod DH_P}
+   * @throws IllegalArgumentException if {@code x} is negative or longer than {@code DH_LEN} bits
+   */
+  static BigInteger pow(BigInteger x) {
+    if ((x.signum() < 0) || (x.bitLength() > PublicKeyProtoUtil.DH_LEN)) {
+      throw new IllegalArgumentException("Exponent out of range");
+    }
+    BigInteger[][] table = TableHolder.TABLE;
+    BigInteger result = null;
+    for (int i = 0; i < WINDOWS; i++) {
+      int digit = 0;
+      for (int bit = 0; bit < WINDOW_BITS; bit++) {
+        if (x.testBit(i * WINDOW_BITS + bit)) {
+          digit |= 1 << bit;
+        }
+      }
+      // Not constant time: skips zero digits, and indexes the table by the secret digit
+      if (digit == 0) {
+        continue;
+      }
+      result = (result == null)
+          ? table[i][digit]
+          : result.multiply(table[i][digit]).mod(PublicKeyProtoUtil.DH_P);
+    }
+    return (result == null) ? BigInteger.ONE : result;
+  }
+
+  private static BigInteger[][] buildTable() {
+    BigInteger p = PublicKeyProtoUtil.DH_P;
+    BigInteger[][] table = new BigInteger[WINDOWS][DIGITS];
+    // base = g^(2^(WINDOW_BITS * i)) for the current window i
+    BigInteger base = PublicKeyProtoUtil.DH_G;
+    for (int i = 0; i < WINDOWS; i++) {
+      table[i][0] = BigInteger.ONE;
+      table[i][1] = base;
+      for (int digit = 2; digit < DIGITS; digit++) {
+        table[i][digit] = table[i][digit - 1].multiply(base).mod(p);
+      }
+      base = table[i][DIGITS - 1].multiply(base).mod(p);
+    }
+    return table;
+  }
+}
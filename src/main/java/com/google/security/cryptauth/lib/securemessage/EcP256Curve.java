@@ -0,0 +1,291 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import static com.google.security.cryptauth.lib.securemessage.EcP256Field.LIMBS;
+
+import java.math.BigInteger;
+import java.util.Arrays;
+
+/**
+ * Point arithmetic on the NIST P-256 curve, built on {@link EcP256Field}.
+ *
+ * <p>Points are kept in homogeneous projective coordinates {@code (X : Y : Z)}, with the point at
+ * infinity represented as {@code (0 : 1 : 0)}. They are added with the complete formulas of
+ * Renes, Costello and Batina ("Complete addition formulas for prime order elliptic curves",
+ * Algorithm 4), which also handle doubling and the point at infinity, so there are no special
+ * cases to branch on.
+ *
+ * <p>Scalars are 32 byte big-endian arrays, consumed in {@link #WINDOW_BITS}-bit digits. Every
+ * table lookup reads all of the table entries, so neither the running time nor the memory access
+ * pattern of a scalar multiplication depends on the scalar.
+ *
+ * <p>Instances hold scratch space, and are not thread safe.
+ */
+final class EcP256Curve {
+
+  /**
+   * Number of scalar bits consumed per table lookup.
+   */
+  static final int WINDOW_BITS = 4;
+
+  /**
+   * Number of bytes in an encoded scalar.
+   */
+  static final int SCALAR_BYTES = 32;
+
+  private static final int DIGITS = 1 << WINDOW_BITS;
+
+  private static final int WINDOWS = 8 * SCALAR_BYTES / WINDOW_BITS;
+
+  /**
+   * The order {@code n} of the base point.
+   */
+  static final BigInteger N = new BigInteger(
+      "ffffffff00000000ffffffffffffffffbce6faada7179e84f3b9cac2fc632551", 16);
+
+  /**
+   * The affine coordinates of the base point {@code G}.
+   */
+  static final int[] GX = {
+    0xd898c296, 0xf4a13945, 0x2deb33a0, 0x77037d81,
+    0x63a440f2, 0xf8bce6e5, 0xe12c4247, 0x6b17d1f2
+  };
+
+  static final int[] GY = {
+    0x37bf51f5, 0xcbb64068, 0x6b315ece, 0x2bce3357,
+    0x7c0f9e16, 0x8ee7eb4a, 0xfe1a7f9b, 0x4fe342e2
+  };
+
+  /**
+   * A curve point in projective coordinates.
+   */
+  static final class Point {
+    final int[] x = new int[LIMBS];
+    final int[] y = new int[LIMBS];
+    final int[] z = new int[LIMBS];
+
+    Point() {
+      setInfinity();
+    }
+
+    void setInfinity() {
+      Arrays.fill(x, 0);
+      Arrays.fill(y, 0);
+      Arrays.fill(z, 0);
+      y[0] = 1;
+    }
+
+    void set(Point other) {
+      System.arraycopy(other.x, 0, x, 0, LIMBS);
+      System.arraycopy(other.y, 0, y, 0, LIMBS);
+      System.arraycopy(other.z, 0, z, 0, LIMBS);
+    }
+
+    /**
+     * Sets this point to {@code other} if {@code choice} is 1, and leaves it alone if it is 0,
+     * without branching on {@code choice}.
+     */
+    void conditionalSet(Point other, int choice) {
+      EcP256Field.select(x, other.x, choice, x);
+      EcP256Field.select(y, other.y, choice, y);
+      EcP256Field.select(z, other.z, choice, z);
+    }
+  }
+
+  /**
+   * Holds the base point table, so that it is only built by callers that actually need it.
+   */
+  private static final class BaseTableHolder {
+    static final Point[][] TABLE = buildBaseTable();
+  }
+
+  private final long[] wide = new long[2 * LIMBS];
+  private final int[] t0 = new int[LIMBS];
+  private final int[] t1 = new int[LIMBS];
+  private final int[] t2 = new int[LIMBS];
+  private final int[] t3 = new int[LIMBS];
+  private final int[] t4 = new int[LIMBS];
+  private final int[] x3 = new int[LIMBS];
+  private final int[] y3 = new int[LIMBS];
+  private final int[] z3 = new int[LIMBS];
+  private final Point selected = new Point();
+  private final Point[] table = new Point[DIGITS];
+
+  EcP256Curve() {
+    for (int i = 0; i < DIGITS; i++) {
+      table[i] = new Point();
+    }
+  }
+
+  /**
+   * Sets {@code out} to the affine point ({@code x}, {@code y}).
+   *
+   * @return false (leaving {@code out} unspecified) if {@code x} or {@code y} is not a valid
+   *   field element, or the point isn't on the curve
+   */
+  boolean setAffine(BigInteger x, BigInteger y, Point out) {
+    if (!EcP256Field.decode(x.toByteArray(), out.x)
+        || !EcP256Field.decode(y.toByteArray(), out.y)
+        || !EcP256Field.isOnCurve(out.x, out.y, t0, t1, wide)) {
+      return false;
+    }
+    Arrays.fill(out.z, 0);
+    out.z[0] = 1;
+    return true;
+  }
+
+  /**
+   * Converts {@code p} to affine coordinates.
+   *
+   * @return false if {@code p} is the point at infinity, which has no affine coordinates
+   */
+  boolean toAffine(Point p, int[] x, int[] y) {
+    EcP256Field.invert(p.z, t0, wide);
+    EcP256Field.mul(p.x, t0, x, wide);
+    EcP256Field.mul(p.y, t0, y, wide);
+    return !EcP256Field.isZero(p.z);
+  }
+
+  /**
+   * Sets {@code out = a + b}. Any of the points may alias each other.
+   */
+  void add(Point a, Point b, Point out) {
+    long[] w = wide;
+    // Algorithm 4 of Renes-Costello-Batina, for curves with a = -3. The inputs are all read
+    // before the first write to out, so out can be either of them.
+    EcP256Field.mul(a.x, b.x, t0, w);
+    EcP256Field.mul(a.y, b.y, t1, w);
+    EcP256Field.mul(a.z, b.z, t2, w);
+    EcP256Field.add(a.x, a.y, t3, w);
+    EcP256Field.add(b.x, b.y, t4, w);
+    EcP256Field.mul(t3, t4, t3, w);
+    EcP256Field.add(t0, t1, t4, w);
+    EcP256Field.sub(t3, t4, t3, w);
+    EcP256Field.add(a.y, a.z, t4, w);
+    EcP256Field.add(b.y, b.z, x3, w);
+    EcP256Field.mul(t4, x3, t4, w);
+    EcP256Field.add(t1, t2, x3, w);
+    EcP256Field.sub(t4, x3, t4, w);
+    EcP256Field.add(a.x, a.z, x3, w);
+    EcP256Field.add(b.x, b.z, y3, w);
+    EcP256Field.mul(x3, y3, x3, w);
+    EcP256Field.add(t0, t2, y3, w);
+    EcP256Field.sub(x3, y3, y3, w);
+
+    EcP256Field.mul(EcP256Field.B, t2, z3, w);
+    EcP256Field.sub(y3, z3, x3, w);
+    EcP256Field.add(x3, x3, z3, w);
+    EcP256Field.add(x3, z3, x3, w);
+    EcP256Field.sub(t1, x3, z3, w);
+    EcP256Field.add(t1, x3, x3, w);
+    EcP256Field.mul(EcP256Field.B, y3, y3, w);
+    EcP256Field.add(t2, t2, t1, w);
+    EcP256Field.add(t1, t2, t2, w);
+    EcP256Field.sub(y3, t2, y3, w);
+    EcP256Field.sub(y3, t0, y3, w);
+    EcP256Field.add(y3, y3, t1, w);
+    EcP256Field.add(t1, y3, y3, w);
+    EcP256Field.add(t0, t0, t1, w);
+    EcP256Field.add(t1, t0, t0, w);
+    EcP256Field.sub(t0, t2, t0, w);
+
+    EcP256Field.mul(t4, y3, t1, w);
+    EcP256Field.mul(t0, y3, t2, w);
+    EcP256Field.mul(x3, z3, y3, w);
+    EcP256Field.add(y3, t2, out.y, w);
+    EcP256Field.mul(t3, x3, x3, w);
+    EcP256Field.sub(x3, t1, out.x, w);
+    EcP256Field.mul(t4, z3, z3, w);
+    EcP256Field.mul(t3, t0, t1, w);
+    EcP256Field.add(z3, t1, out.z, w);
+  }
+
+  /**
+   * Sets {@code out = scalar * p}. {@code out} may alias {@code p}.
+   *
+   * @param scalar a {@link #SCALAR_BYTES} byte big-endian integer
+   */
+  void multiply(byte[] scalar, Point p, Point out) {
+    table[0].setInfinity();
+    table[1].set(p);
+    for (int i = 2; i < DIGITS; i++) {
+      add(table[i - 1], p, table[i]);
+    }
+    out.setInfinity();
+    for (int i = WINDOWS - 1; i >= 0; i--) {
+      for (int j = 0; j < WINDOW_BITS; j++) {
+        add(out, out, out);
+      }
+      lookup(table, digit(scalar, i), selected);
+      add(out, selected, out);
+    }
+  }
+
+  /**
+   * Sets {@code out = scalar * G}, where {@code G} is the base point.
+   *
+   * @param scalar a {@link #SCALAR_BYTES} byte big-endian integer
+   */
+  void multiplyBase(byte[] scalar, Point out) {
+    Point[][] baseTable = BaseTableHolder.TABLE;
+    out.setInfinity();
+    for (int i = 0; i < WINDOWS; i++) {
+      lookup(baseTable[i], digit(scalar, i), selected);
+      add(out, selected, out);
+    }
+  }
+
+  /**
+   * @return the {@code i}-th least significant digit of {@code scalar}
+   */
+  private static int digit(byte[] scalar, int i) {
+    return (scalar[SCALAR_BYTES - 1 - (i >>> 1)] >>> ((i & 1) * WINDOW_BITS)) & (DIGITS - 1);
+  }
+
+  /**
+   * Sets {@code out = table[index]}, reading every entry of the table.
+   */
+  private static void lookup(Point[] table, int index, Point out) {
+    out.set(table[0]);
+    for (int i = 1; i < DIGITS; i++) {
+      // 1 if i == index, and 0 otherwise
+      int choice = ((i ^ index) - 1) >>> 31;
+      out.conditionalSet(table[i], choice);
+    }
+  }
+
+  /**
+   * @return a table whose {@code i}-th row holds {@code d * 2^(WINDOW_BITS * i) * G} for every
+   *   digit value {@code d}
+   */
+  private static Point[][] buildBaseTable() {
+    EcP256Curve curve = new EcP256Curve();
+    Point[][] baseTable = new Point[WINDOWS][DIGITS];
+    Point base = new Point();
+    System.arraycopy(GX, 0, base.x, 0, LIMBS);
+    System.arraycopy(GY, 0, base.y, 0, LIMBS);
+    base.z[0] = 1;
+    for (int i = 0; i < WINDOWS; i++) {
+      baseTable[i][0] = new Point();
+      for (int d = 1; d < DIGITS; d++) {
+        baseTable[i][d] = new Point();
+        curve.add(baseTable[i][d - 1], base, baseTable[i][d]);
+      }
+      curve.add(baseTable[i][DIGITS - 1], base, base);
+    }
+    return baseTable;
+  }
+}
@@ -0,0 +1,346 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.util.Arrays;
+
+/**
+ * Fixed-width arithmetic modulo the prime {@code p = 2^256 - 2^224 + 2^192 + 2^96 - 1} of the
+ * NIST P-256 curve, used to validate curve points and by {@link EcP256Curve}, without going
+ * through {@link java.math.BigInteger}.
+ *
+ * <p>Field elements are {@code int[8]} arrays holding little-endian 32-bit limbs (limb 0 is the
+ * least significant), always fully reduced into {@code [0, p)}. Products are reduced with the
+ * NIST/Solinas fast reduction for P-256 (FIPS 186-4, D.2.3). The arithmetic routines have no
+ * data-dependent branches or memory accesses.
+ */
+final class EcP256Field {
+
+  private EcP256Field() {}  // Do not instantiate
+
+  /**
+   * Number of 32-bit limbs in a field element.
+   */
+  static final int LIMBS = 8;
+
+  /**
+   * Maximum number of bytes in a 2's complement encoding of a field element.
+   */
+  private static final int MAX_ENCODING_BYTES = 33;
+
+  private static final long MASK = 0xffffffffL;
+
+  /**
+   * The field prime {@code p}.
+   */
+  static final int[] P = {
+    0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+    0x00000000, 0x00000000, 0x00000001, 0xffffffff
+  };
+
+  /**
+   * The curve coefficient {@code b} (the coefficient {@code a} is {@code -3}).
+   */
+  static final int[] B = {
+    0x27d2604b, 0x3bce3c3e, 0xcc53b0f6, 0x651d06b0,
+    0x769886bc, 0xb3ebbd55, 0xaa3a93e7, 0x5ac635d8
+  };
+
+  /**
+   * Decodes a big-endian two's complement coordinate, as found in an {@code EcP256PublicKey}
+   * proto, into {@code out}.
+   *
+   * @return false if {@code encoded} is not a non-negative integer of at most 256 bits that is
+   *   strictly less than {@code p}
+   */
+  static boolean decode(byte[] encoded, int[] out) {
+    return decode(encoded, encoded.length, out);
+  }
+
+  /**
+   * Same as {@link #decode(byte[], int[])}, but decodes only the first {@code length} bytes of
+   * {@code encoded}, so that callers can decode from a reused buffer.
+   */
+  static boolean decode(byte[] encoded, int length, int[] out) {
+    if ((length == 0)
+        || (length > MAX_ENCODING_BYTES)
+        || (length == MAX_ENCODING_BYTES && encoded[0] != 0)
+        || (encoded[0] < 0)) {
+      return false;
+    }
+    Arrays.fill(out, 0);
+    for (int k = 0; k < Math.min(length, 4 * LIMBS); k++) {
+      out[k >>> 2] |= (encoded[length - 1 - k] & 0xff) << ((k & 3) << 3);
+    }
+    return lessThanP(out);
+  }
+
+  /**
+   * @return true if ({@code x}, {@code y}) satisfies {@code y^2 = x^3 - 3x + b (mod p)}
+   */
+  static boolean isOnCurve(int[] x, int[] y) {
+    return isOnCurve(x, y, new int[LIMBS], new int[LIMBS], new long[2 * LIMBS]);
+  }
+
+  /**
+   * Same as {@link #isOnCurve(int[], int[])}, but uses the caller's scratch space so that many
+   * points can be checked without allocating.
+   *
+   * @param lhs scratch space of {@code LIMBS} entries
+   * @param rhs scratch space of {@code LIMBS} entries
+   * @param wide scratch space of at least {@code 2 * LIMBS} entries
+   */
+  static boolean isOnCurve(int[] x, int[] y, int[] lhs, int[] rhs, long[] wide) {
+    mul(y, y, lhs, wide);
+    curveEquation(x, rhs, wide);
+    return equal(lhs, rhs);
+  }
+
+  /**
+   * Sets {@code out = x^3 - 3x + b (mod p)}, the square of the y coordinate of any curve point
+   * with x coordinate {@code x}. {@code out} must not alias {@code x}.
+   *
+   * @param wide scratch space of at least {@code 2 * LIMBS} entries
+   */
+  static void curveEquation(int[] x, int[] out, long[] wide) {
+    mul(x, x, out, wide);
+    mul(out, x, out, wide);
+    for (int i = 0; i < LIMBS; i++) {
+      wide[i] = (out[i] & MASK) - 3 * (x[i] & MASK) + (B[i] & MASK);
+    }
+    reduce(wide, out);
+  }
+
+  /**
+   * Sets {@code out = a^((p + 1) / 4) (mod p)}, which is a square root of {@code a} whenever
+   * {@code a} has one (p is 3 mod 4). Callers must square the result to find out whether it does.
+   * {@code out} may alias {@code a}.
+   *
+   * @param wide scratch space of at least {@code 2 * LIMBS} entries
+   */
+  static void sqrt(int[] a, int[] out, long[] wide) {
+    // (p + 1) / 4 = 2^254 - 2^222 + 2^190 + 2^94, i.e. bits 253..222, 190 and 94 are set. The
+    // exponent is public, so square-and-multiply on its bits doesn't leak anything about a.
+    int[] result = a.clone();
+    for (int bit = 252; bit >= 0; bit--) {
+      mul(result, result, result, wide);
+      if (bit >= 222 || bit == 190 || bit == 94) {
+        mul(result, a, result, wide);
+      }
+    }
+    System.arraycopy(result, 0, out, 0, LIMBS);
+  }
+
+  /**
+   * Sets {@code out = a^(p - 2) (mod p)}, which is the inverse of {@code a} when {@code a} is
+   * nonzero, and zero otherwise. {@code out} may alias {@code a}.
+   *
+   * @param wide scratch space of at least {@code 2 * LIMBS} entries
+   */
+  static void invert(int[] a, int[] out, long[] wide) {
+    // p - 2 has the bits of p, except for bit 1. As in sqrt(), the exponent is public.
+    int[] result = a.clone();
+    for (int bit = 254; bit >= 0; bit--) {
+      mul(result, result, result, wide);
+      if (bit != 1 && ((P[bit >>> 5] >>> (bit & 31)) & 1) != 0) {
+        mul(result, a, result, wide);
+      }
+    }
+    System.arraycopy(result, 0, out, 0, LIMBS);
+  }
+
+  /**
+   * Sets {@code out = a + b (mod p)}. {@code out} may alias either input.
+   *
+   * @param wide scratch space of at least {@code LIMBS} entries
+   */
+  static void add(int[] a, int[] b, int[] out, long[] wide) {
+    for (int i = 0; i < LIMBS; i++) {
+      wide[i] = (a[i] & MASK) + (b[i] & MASK);
+    }
+    reduce(wide, out);
+  }
+
+  /**
+   * Sets {@code out = a - b (mod p)}. {@code out} may alias either input.
+   *
+   * @param wide scratch space of at least {@code LIMBS} entries
+   */
+  static void sub(int[] a, int[] b, int[] out, long[] wide) {
+    for (int i = 0; i < LIMBS; i++) {
+      wide[i] = (a[i] & MASK) - (b[i] & MASK);
+    }
+    reduce(wide, out);
+  }
+
+  /**
+   * Sets {@code out = -a (mod p)}. {@code out} may alias {@code a}.
+   *
+   * @param wide scratch space of at least {@code LIMBS} entries
+   */
+  static void neg(int[] a, int[] out, long[] wide) {
+    for (int i = 0; i < LIMBS; i++) {
+      wide[i] = (P[i] & MASK) - (a[i] & MASK);
+    }
+    reduce(wide, out);
+  }
+
+  /**
+   * Sets {@code out} to {@code b} if {@code choice} is 1 and to {@code a} if it is 0, without
+   * branching on {@code choice}. {@code out} may alias either input.
+   */
+  static void select(int[] a, int[] b, int choice, int[] out) {
+    int mask = -choice;
+    for (int i = 0; i < LIMBS; i++) {
+      out[i] = a[i] ^ (mask & (a[i] ^ b[i]));
+    }
+  }
+
+  /**
+   * @return the 32 byte big-endian unsigned encoding of {@code a}
+   */
+  static byte[] toByteArray(int[] a) {
+    byte[] out = new byte[4 * LIMBS];
+    for (int k = 0; k < out.length; k++) {
+      out[out.length - 1 - k] = (byte) (a[k >>> 2] >>> ((k & 3) << 3));
+    }
+    return out;
+  }
+
+  /**
+   * Sets {@code out = a * b (mod p)}. {@code out} may alias either input.
+   *
+   * @param wide scratch space of at least {@code 2 * LIMBS} entries
+   */
+  static void mul(int[] a, int[] b, int[] out, long[] wide) {
+    // Schoolbook multiplication into 16 limbs. Each step fits in an unsigned 64-bit value, so the
+    // carries are extracted with an unsigned shift.
+    Arrays.fill(wide, 0, 2 * LIMBS, 0L);
+    for (int i = 0; i < LIMBS; i++) {
+      long ai = a[i] & MASK;
+      long carry = 0;
+      for (int j = 0; j < LIMBS; j++) {
+        long t = ai * (b[j] & MASK) + wide[i + j] + carry;
+        wide[i + j] = t & MASK;
+        carry = t >>> 32;
+      }
+      wide[i + LIMBS] = carry;
+    }
+
+    // Solinas reduction: s1 + 2*s2 + 2*s3 + s4 + s5 - d1 - d2 - d3 - d4, gathered per limb.
+    long c0 = wide[0];
+    long c1 = wide[1];
+    long c2 = wide[2];
+    long c3 = wide[3];
+    long c4 = wide[4];
+    long c5 = wide[5];
+    long c6 = wide[6];
+    long c7 = wide[7];
+    long c8 = wide[8];
+    long c9 = wide[9];
+    long c10 = wide[10];
+    long c11 = wide[11];
+    long c12 = wide[12];
+    long c13 = wide[13];
+    long c14 = wide[14];
+    long c15 = wide[15];
+    wide[0] = c0 + c8 + c9 - c11 - c12 - c13 - c14;
+    wide[1] = c1 + c9 + c10 - c12 - c13 - c14 - c15;
+    wide[2] = c2 + c10 + c11 - c13 - c14 - c15;
+    wide[3] = c3 + 2 * (c11 + c12) + c13 - c15 - c8 - c9;
+    wide[4] = c4 + 2 * (c12 + c13) + c14 - c9 - c10;
+    wide[5] = c5 + 2 * (c13 + c14) + c15 - c10 - c11;
+    wide[6] = c6 + 3 * c14 + 2 * c15 + c13 - c8 - c9;
+    wide[7] = c7 + 3 * c15 + c8 - c10 - c11 - c12 - c13;
+    reduce(wide, out);
+  }
+
+  /**
+   * Fully reduces the signed limbs {@code t[0..7]} (each of magnitude below {@code 2^35}) into
+   * {@code out}. Clobbers {@code t}.
+   */
+  static void reduce(long[] t, int[] out) {
+    // Two rounds of carry propagation, each folding the carry out of the top limb back in using
+    // 2^256 = 2^224 - 2^192 - 2^96 + 1 (mod p). The first fold leaves a carry of at most one, and
+    // the second fold cannot carry again.
+    for (int round = 0; round < 2; round++) {
+      long carry = propagate(t);
+      t[0] += carry;
+      t[3] -= carry;
+      t[6] -= carry;
+      t[7] += carry;
+    }
+    propagate(t);
+
+    // t is now in [0, 2^256), which is less than 2p: subtract p once if that doesn't borrow.
+    long borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      borrow = (t[i] - (P[i] & MASK) + borrow) >> 32;
+    }
+    // borrow is -1 (all ones) if t < p, and 0 otherwise
+    long subtrahendMask = MASK & ~borrow;
+    borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      long d = t[i] - (P[i] & subtrahendMask) + borrow;
+      borrow = d >> 32;
+      out[i] = (int) d;
+    }
+  }
+
+  /**
+   * @return true if {@code a} and {@code b} hold the same value, in constant time
+   */
+  static boolean equal(int[] a, int[] b) {
+    int result = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      result |= a[i] ^ b[i];
+    }
+    return result == 0;
+  }
+
+  /**
+   * @return true if {@code a} is zero, in constant time
+   */
+  static boolean isZero(int[] a) {
+    int result = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      result |= a[i];
+    }
+    return result == 0;
+  }
+
+  /**
+   * Normalizes every limb of {@code t} into {@code [0, 2^32)}.
+   *
+   * @return the signed carry out of the top limb
+   */
+  private static long propagate(long[] t) {
+    long carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      t[i] += carry;
+      carry = t[i] >> 32;
+      t[i] &= MASK;
+    }
+    return carry;
+  }
+
+  private static boolean lessThanP(int[] a) {
+    long borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      borrow = ((a[i] & MASK) - (P[i] & MASK) + borrow) >> 32;
+    }
+    return borrow != 0;
+  }
+}
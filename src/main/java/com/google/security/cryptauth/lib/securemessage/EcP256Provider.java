@@ -0,0 +1,85 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.security.NoSuchAlgorithmException;
+import java.security.Provider;
+import java.util.Collections;
+
+/**
+ * A pure Java security {@link Provider} for the NIST P-256 operations used by this library, with
+ * predictable performance on any JVM:
+ *
+ * <ul>
+ *   <li>{@code KeyPairGenerator.EC} (P-256 only)
+ *   <li>{@code KeyAgreement.ECDH}
+ *   <li>{@code Signature.SHA256withECDSA}
+ * </ul>
+ *
+ * <p>Scalar multiplications run in constant time (see {@link EcP256Curve}). Keys are created
+ * through the platform's {@code EC} {@link java.security.KeyFactory}, so they can be encoded and
+ * used interchangeably with keys from other providers.
+ *
+ * <p>The provider doesn't need to be registered with {@link java.security.Security}; use {@link
+ * CryptoOps#setEcProvider(Provider)} to route this library's P-256 operations through it. Note
+ * that some JDKs only accept {@code KeyAgreement} implementations from signed JCE providers.
+ */
+public final class EcP256Provider extends Provider {
+
+  private static final long serialVersionUID = 1L;
+
+  /**
+   * The name of this provider.
+   */
+  public static final String NAME = "UKEY2-EcP256";
+
+  @SuppressWarnings("deprecation")  // Provider(String, String, String) needs Java 9
+  public EcP256Provider() {
+    super(NAME, 1.0, "Pure Java NIST P-256 key generation, ECDH and ECDSA");
+    putService(new EcP256Service(
+        this, "KeyPairGenerator", "EC", EcP256Spi.EcKeyPairGenerator.class));
+    putService(new EcP256Service(this, "KeyAgreement", "ECDH", EcP256Spi.EcdhKeyAgreement.class));
+    putService(new EcP256Service(
+        this, "Signature", "SHA256withECDSA", EcP256Spi.EcdsaSignature.class));
+  }
+
+  /**
+   * Creates the engines directly rather than by reflection, so that they can stay package-private.
+   */
+  private static final class EcP256Service extends Provider.Service {
+
+    EcP256Service(Provider provider, String type, String algorithm, Class<?> engineClass) {
+      super(
+          provider, type, algorithm, engineClass.getName(), Collections.<String>emptyList(), null);
+    }
+
+    @Override
+    public Object newInstance(Object constructorParameter) throws NoSuchAlgorithmException {
+      if (constructorParameter != null) {
+        throw new NoSuchAlgorithmException(
+            "Constructor parameters are not supported for " + getAlgorithm());
+      }
+      String type = getType();
+      if (type.equals("KeyPairGenerator")) {
+        return new EcP256Spi.EcKeyPairGenerator();
+      } else if (type.equals("KeyAgreement")) {
+        return new EcP256Spi.EcdhKeyAgreement();
+      } else if (type.equals("Signature")) {
+        return new EcP256Spi.EcdsaSignature();
+      }
+      throw new NoSuchAlgorithmException("Unsupported service type: " + type);
+    }
+  }
+}
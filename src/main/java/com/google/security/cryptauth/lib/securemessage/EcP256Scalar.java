@@ -0,0 +1,220 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import static com.google.security.cryptauth.lib.securemessage.EcP256Field.LIMBS;
+
+import java.util.Arrays;
+
+/**
+ * Fixed-width arithmetic modulo the order {@code n} of the NIST P-256 base point, used by {@link
+ * EcP256Spi} for the ECDSA computations on secret scalars.
+ *
+ * <p>Scalars use the same {@code int[8]} little-endian limb layout as {@link EcP256Field}, fully
+ * reduced into {@code [0, n)}. Since {@code n} has no special form, products are reduced with
+ * Montgomery multiplication. As in {@link EcP256Field}, the arithmetic routines have no
+ * data-dependent branches or memory accesses; only the (public) exponent of {@link #invert} is
+ * branched on.
+ */
+final class EcP256Scalar {
+
+  private EcP256Scalar() {}  // Do not instantiate
+
+  private static final long MASK = 0xffffffffL;
+
+  /**
+   * The group order {@code n}.
+   */
+  static final int[] N = {
+    0xfc632551, 0xf3b9cac2, 0xa7179e84, 0xbce6faad,
+    0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+  };
+
+  /**
+   * {@code -n^-1 mod 2^32}.
+   */
+  private static final long N0_INVERSE = 0xee00bc4fL;
+
+  /**
+   * {@code 2^512 mod n}, which takes values into the Montgomery domain.
+   */
+  private static final int[] R_SQUARED = {
+    0xbe79eea2, 0x83244c95, 0x49bd6fa6, 0x4699799c,
+    0x2b6bec59, 0x2845b239, 0xf3d95620, 0x66e12d94
+  };
+
+  private static final int[] ONE = {1, 0, 0, 0, 0, 0, 0, 0};
+
+  /**
+   * Decodes a {@link EcP256Curve#SCALAR_BYTES} byte big-endian integer into {@code out}, reducing
+   * it modulo {@code n}.
+   */
+  static void decode(byte[] encoded, int[] out) {
+    if (encoded.length != EcP256Curve.SCALAR_BYTES) {
+      throw new IllegalArgumentException("Scalars are " + EcP256Curve.SCALAR_BYTES + " bytes");
+    }
+    Arrays.fill(out, 0);
+    for (int k = 0; k < encoded.length; k++) {
+      out[k >>> 2] |= (encoded[encoded.length - 1 - k] & 0xff) << ((k & 3) << 3);
+    }
+    // Any 256-bit value is below 2n, so one conditional subtraction reduces it
+    subtractNIfNotLess(out, 0, out);
+  }
+
+  /**
+   * Sets {@code out} to {@code a} (any 256-bit value) reduced modulo {@code n}. {@code out} may
+   * alias {@code a}.
+   */
+  static void reduce(int[] a, int[] out) {
+    subtractNIfNotLess(a, 0, out);
+  }
+
+  /**
+   * @return true if {@code encoded}, a {@link EcP256Curve#SCALAR_BYTES} byte big-endian integer,
+   *   is in {@code [1, n)}, in constant time
+   */
+  static boolean isValid(byte[] encoded) {
+    int[] a = new int[LIMBS];
+    for (int k = 0; k < encoded.length; k++) {
+      a[k >>> 2] |= (encoded[encoded.length - 1 - k] & 0xff) << ((k & 3) << 3);
+    }
+    long borrow = 0;
+    int bits = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      borrow = ((a[i] & MASK) - (N[i] & MASK) + borrow) >> 32;
+      bits |= a[i];
+    }
+    boolean valid = (borrow != 0) & (bits != 0);
+    Arrays.fill(a, 0);
+    return valid;
+  }
+
+  /**
+   * Sets {@code out = a * b (mod n)}. {@code out} may alias either input.
+   *
+   * @param wide scratch space of at least {@code LIMBS + 2} entries
+   */
+  static void mul(int[] a, int[] b, int[] out, long[] wide) {
+    // (a * b / R) * R^2 / R = a * b
+    montgomeryMul(a, b, out, wide);
+    montgomeryMul(out, R_SQUARED, out, wide);
+  }
+
+  /**
+   * Sets {@code out = a + b (mod n)}. {@code out} may alias either input.
+   */
+  static void add(int[] a, int[] b, int[] out) {
+    long carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      long t = (a[i] & MASK) + (b[i] & MASK) + carry;
+      out[i] = (int) t;
+      carry = t >>> 32;
+    }
+    subtractNIfNotLess(out, (int) carry, out);
+  }
+
+  /**
+   * Sets {@code out = a^(n - 2) (mod n)}, which is the inverse of {@code a} when {@code a} is
+   * nonzero, and zero otherwise. {@code out} may alias {@code a}.
+   *
+   * @param wide scratch space of at least {@code LIMBS + 2} entries
+   */
+  static void invert(int[] a, int[] out, long[] wide) {
+    // Square-and-multiply in the Montgomery domain. The exponent n - 2 is public, so branching on
+    // its bits doesn't leak anything about a.
+    int[] base = new int[LIMBS];
+    montgomeryMul(a, R_SQUARED, base, wide);
+    int[] result = base.clone();
+    for (int bit = 254; bit >= 0; bit--) {
+      montgomeryMul(result, result, result, wide);
+      if (((nMinusTwoLimb(bit >>> 5) >>> (bit & 31)) & 1) != 0) {
+        montgomeryMul(result, base, result, wide);
+      }
+    }
+    montgomeryMul(result, ONE, out, wide);
+    Arrays.fill(base, 0);
+    Arrays.fill(result, 0);
+  }
+
+  /**
+   * @return true if {@code a} is zero, in constant time
+   */
+  static boolean isZero(int[] a) {
+    return EcP256Field.isZero(a);
+  }
+
+  /**
+   * @return limb {@code i} of {@code n - 2} (n is odd, so only the lowest limb differs from n)
+   */
+  private static int nMinusTwoLimb(int i) {
+    return (i == 0) ? N[0] - 2 : N[i];
+  }
+
+  /**
+   * Sets {@code out = a * b / 2^256 (mod n)}, with the CIOS method. {@code out} may alias either
+   * input.
+   */
+  private static void montgomeryMul(int[] a, int[] b, int[] out, long[] t) {
+    Arrays.fill(t, 0, LIMBS + 2, 0L);
+    for (int i = 0; i < LIMBS; i++) {
+      // t += a[i] * b. Each step fits in an unsigned 64-bit value.
+      long ai = a[i] & MASK;
+      long carry = 0;
+      for (int j = 0; j < LIMBS; j++) {
+        long s = t[j] + ai * (b[j] & MASK) + carry;
+        t[j] = s & MASK;
+        carry = s >>> 32;
+      }
+      long s = t[LIMBS] + carry;
+      t[LIMBS] = s & MASK;
+      t[LIMBS + 1] = s >>> 32;
+
+      // t = (t + m * n) / 2^32, where m makes the low limb vanish
+      long m = (t[0] * N0_INVERSE) & MASK;
+      carry = (t[0] + m * (N[0] & MASK)) >>> 32;
+      for (int j = 1; j < LIMBS; j++) {
+        s = t[j] + m * (N[j] & MASK) + carry;
+        t[j - 1] = s & MASK;
+        carry = s >>> 32;
+      }
+      s = t[LIMBS] + carry;
+      t[LIMBS - 1] = s & MASK;
+      t[LIMBS] = t[LIMBS + 1] + (s >>> 32);
+    }
+    // t < 2n, held in t[0..LIMBS]. The inputs have all been read, so out can be written.
+    for (int i = 0; i < LIMBS; i++) {
+      out[i] = (int) t[i];
+    }
+    subtractNIfNotLess(out, (int) t[LIMBS], out);
+  }
+
+  /**
+   * Sets {@code out} to {@code a + 2^256 * high - n} if that isn't negative, and to {@code a}
+   * otherwise, without branching. {@code high} must be 0 or 1, and the result less than {@code n}.
+   */
+  private static void subtractNIfNotLess(int[] a, int high, int[] out) {
+    int[] difference = new int[LIMBS];
+    long borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+      long d = (a[i] & MASK) - (N[i] & MASK) + borrow;
+      difference[i] = (int) d;
+      borrow = d >> 32;
+    }
+    // high + borrow is -1 if a + 2^256 * high < n, and 0 or 1 otherwise
+    int keep = (int) ((high + borrow) >>> 63);
+    EcP256Field.select(difference, a, keep, out);
+    Arrays.fill(difference, 0);
+  }
+}
@@ -0,0 +1,522 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import static com.google.security.cryptauth.lib.securemessage.EcP256Field.LIMBS;
+
+import com.google.security.cryptauth.lib.securemessage.EcP256Curve.Point;
+import java.math.BigInteger;
+import java.security.GeneralSecurityException;
+import java.security.InvalidAlgorithmParameterException;
+import java.security.InvalidKeyException;
+import java.security.InvalidParameterException;
+import java.security.Key;
+import java.security.KeyFactory;
+import java.security.KeyPair;
+import java.security.KeyPairGeneratorSpi;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.security.PrivateKey;
+import java.security.ProviderException;
+import java.security.PublicKey;
+import java.security.SecureRandom;
+import java.security.SignatureException;
+import java.security.SignatureSpi;
+import java.security.interfaces.ECPrivateKey;
+import java.security.interfaces.ECPublicKey;
+import java.security.spec.AlgorithmParameterSpec;
+import java.security.spec.ECFieldFp;
+import java.security.spec.ECGenParameterSpec;
+import java.security.spec.ECParameterSpec;
+import java.security.spec.ECPoint;
+import java.security.spec.ECPrivateKeySpec;
+import java.security.spec.ECPublicKeySpec;
+import java.security.spec.EllipticCurve;
+import java.util.Arrays;
+import java.util.HashSet;
+import java.util.Set;
+import javax.annotation.Nullable;
+import javax.crypto.KeyAgreementSpi;
+import javax.crypto.SecretKey;
+import javax.crypto.ShortBufferException;
+import javax.crypto.spec.SecretKeySpec;
+
+/**
+ * The engines behind {@link EcP256Provider}, and the conversions between JCA keys and {@link
+ * EcP256Curve} scalars and points that they share.
+ */
+final class EcP256Spi {
+
+  private EcP256Spi() {}  // Do not instantiate
+
+  /**
+   * The domain parameters of NIST P-256.
+   */
+  static final ECParameterSpec PARAMS = new ECParameterSpec(
+      new EllipticCurve(
+          new ECFieldFp(toBigInteger(EcP256Field.P)),
+          toBigInteger(EcP256Field.P).subtract(BigInteger.valueOf(3)),
+          toBigInteger(EcP256Field.B)),
+      new ECPoint(toBigInteger(EcP256Curve.GX), toBigInteger(EcP256Curve.GY)),
+      EcP256Curve.N,
+      1);
+
+  private static final Set<String> CURVE_NAMES = new HashSet<>(Arrays.asList(
+      "secp256r1", "prime256v1", "NIST P-256", "P-256", "1.2.840.10045.3.1.7"));
+
+  private static final byte DER_SEQUENCE = 0x30;
+
+  private static final byte DER_INTEGER = 0x02;
+
+  /**
+   * Generates P-256 key pairs. Other curves are rejected.
+   */
+  static final class EcKeyPairGenerator extends KeyPairGeneratorSpi {
+    @Nullable private SecureRandom random;
+
+    @Override
+    public void initialize(int keysize, SecureRandom random) {
+      if (keysize != 8 * EcP256Curve.SCALAR_BYTES) {
+        throw new InvalidParameterException("Only 256-bit keys are supported");
+      }
+      this.random = random;
+    }
+
+    @Override
+    public void initialize(AlgorithmParameterSpec params, SecureRandom random)
+        throws InvalidAlgorithmParameterException {
+      if (params instanceof ECGenParameterSpec) {
+        String name = ((ECGenParameterSpec) params).getName();
+        if (!CURVE_NAMES.contains(name)) {
+          throw new InvalidAlgorithmParameterException("Unsupported curve: " + name);
+        }
+      } else if (!(params instanceof ECParameterSpec) || !isP256((ECParameterSpec) params)) {
+        throw new InvalidAlgorithmParameterException("Only NIST P-256 is supported");
+      }
+      this.random = random;
+    }
+
+    @Override
+    public KeyPair generateKeyPair() {
+      if (random == null) {
+        random = new SecureRandom();
+      }
+      byte[] privateScalar = randomScalar(random);
+      EcP256Curve curve = new EcP256Curve();
+      Point point = new Point();
+      int[] x = new int[LIMBS];
+      int[] y = new int[LIMBS];
+      curve.multiplyBase(privateScalar, point);
+      curve.toAffine(point, x, y);
+      try {
+        // Let the platform create the key objects, so that they encode and compare like any other
+        // EC keys
+        KeyFactory keyFactory = KeyFactory.getInstance("EC");
+        PublicKey publicKey = keyFactory.generatePublic(
+            new ECPublicKeySpec(new ECPoint(toBigInteger(x), toBigInteger(y)), PARAMS));
+        PrivateKey privateKey = keyFactory.generatePrivate(
+            new ECPrivateKeySpec(new BigInteger(1, privateScalar), PARAMS));
+        return new KeyPair(publicKey, privateKey);
+      } catch (GeneralSecurityException e) {
+        throw new ProviderException(e);
+      } finally {
+        Arrays.fill(privateScalar, (byte) 0);
+      }
+    }
+  }
+
+  /**
+   * ECDH on P-256. The shared secret is the x coordinate of the shared point, as in SunEC.
+   */
+  static final class EcdhKeyAgreement extends KeyAgreementSpi {
+    private final EcP256Curve curve = new EcP256Curve();
+    private final Point point = new Point();
+    @Nullable private byte[] privateScalar;
+    @Nullable private byte[] secret;
+
+    @Override
+    protected void engineInit(Key key, SecureRandom random) throws InvalidKeyException {
+      byte[] newScalar = toPrivateScalar(key);
+      clear();
+      privateScalar = newScalar;
+    }
+
+    @Override
+    protected void engineInit(Key key, AlgorithmParameterSpec params, SecureRandom random)
+        throws InvalidKeyException, InvalidAlgorithmParameterException {
+      if (params != null) {
+        throw new InvalidAlgorithmParameterException("ECDH takes no parameters");
+      }
+      engineInit(key, random);
+    }
+
+    @Override
+    protected Key engineDoPhase(Key key, boolean lastPhase) throws InvalidKeyException {
+      if (privateScalar == null) {
+        throw new IllegalStateException("Not initialized");
+      }
+      if (secret != null) {
+        throw new IllegalStateException("Phase already executed");
+      }
+      if (!lastPhase) {
+        throw new IllegalStateException("Only two party agreement is supported");
+      }
+      toPublicPoint(key, curve, point);
+      curve.multiply(privateScalar, point, point);
+      int[] x = new int[LIMBS];
+      if (!curve.toAffine(point, x, new int[LIMBS])) {
+        // Can't happen for a valid point, since the curve has prime order
+        throw new InvalidKeyException("Invalid peer key");
+      }
+      secret = EcP256Field.toByteArray(x);
+      return null;
+    }
+
+    @Override
+    protected byte[] engineGenerateSecret() {
+      if (secret == null) {
+        throw new IllegalStateException("Key agreement has not been completed");
+      }
+      byte[] result = secret;
+      secret = null;
+      return result;
+    }
+
+    @Override
+    protected int engineGenerateSecret(byte[] sharedSecret, int offset)
+        throws ShortBufferException {
+      if (offset < 0 || sharedSecret.length - offset < EcP256Curve.SCALAR_BYTES) {
+        throw new ShortBufferException("Need " + EcP256Curve.SCALAR_BYTES + " bytes");
+      }
+      byte[] result = engineGenerateSecret();
+      System.arraycopy(result, 0, sharedSecret, offset, result.length);
+      Arrays.fill(result, (byte) 0);
+      return result.length;
+    }
+
+    @Override
+    protected SecretKey engineGenerateSecret(String algorithm) throws NoSuchAlgorithmException {
+      if (algorithm == null) {
+        throw new NoSuchAlgorithmException("Algorithm must not be null");
+      }
+      byte[] result = engineGenerateSecret();
+      try {
+        return new SecretKeySpec(result, algorithm);
+      } finally {
+        Arrays.fill(result, (byte) 0);
+      }
+    }
+
+    private void clear() {
+      if (privateScalar != null) {
+        Arrays.fill(privateScalar, (byte) 0);
+        privateScalar = null;
+      }
+      if (secret != null) {
+        Arrays.fill(secret, (byte) 0);
+        secret = null;
+      }
+    }
+  }
+
+  /**
+   * ECDSA on P-256 with SHA-256, producing DER encoded signatures.
+   */
+  static final class EcdsaSignature extends SignatureSpi {
+    private final EcP256Curve curve = new EcP256Curve();
+    private final MessageDigest digest;
+    private final Point publicPoint = new Point();
+    private final Point sum = new Point();
+    private final Point product = new Point();
+    private final int[] x = new int[LIMBS];
+    private final int[] y = new int[LIMBS];
+    // ECDSA scalars, modulo n
+    private final int[] eScalar = new int[LIMBS];
+    private final int[] rScalar = new int[LIMBS];
+    private final int[] sScalar = new int[LIMBS];
+    private final int[] k = new int[LIMBS];
+    private final int[] blind = new int[LIMBS];
+    private final int[] t = new int[LIMBS];
+    private final long[] wide = new long[LIMBS + 2];
+    @Nullable private int[] privateScalar;
+    @Nullable private SecureRandom random;
+    private boolean verifying;
+
+    EcdsaSignature() {
+      try {
+        digest = MessageDigest.getInstance("SHA-256");
+      } catch (NoSuchAlgorithmException e) {
+        throw new ProviderException(e);  // Shouldn't happen
+      }
+    }
+
+    @Override
+    protected void engineInitSign(PrivateKey key) throws InvalidKeyException {
+      engineInitSign(key, null);
+    }
+
+    @Override
+    protected void engineInitSign(PrivateKey key, @Nullable SecureRandom random)
+        throws InvalidKeyException {
+      byte[] scalar = toPrivateScalar(key);
+      if (privateScalar == null) {
+        privateScalar = new int[LIMBS];
+      }
+      EcP256Scalar.decode(scalar, privateScalar);
+      Arrays.fill(scalar, (byte) 0);
+      this.random = random;
+      verifying = false;
+      digest.reset();
+    }
+
+    @Override
+    protected void engineInitVerify(PublicKey key) throws InvalidKeyException {
+      toPublicPoint(key, curve, publicPoint);
+      if (privateScalar != null) {
+        Arrays.fill(privateScalar, 0);
+        privateScalar = null;
+      }
+      verifying = true;
+      digest.reset();
+    }
+
+    @Override
+    protected void engineUpdate(byte b) {
+      digest.update(b);
+    }
+
+    @Override
+    protected void engineUpdate(byte[] b, int off, int len) {
+      digest.update(b, off, len);
+    }
+
+    @Override
+    protected byte[] engineSign() throws SignatureException {
+      if (privateScalar == null) {
+        throw new SignatureException("Not initialized for signing");
+      }
+      if (random == null) {
+        random = new SecureRandom();
+      }
+      // Everything that touches the nonce or the private scalar uses the fixed-width arithmetic
+      // of EcP256Scalar. The result is additionally blinded: s = k^-1 (e + r * d) is computed as
+      // (k * b)^-1 (b * e + r * (b * d)) for a random b.
+      EcP256Scalar.decode(digest.digest(), eScalar);
+      while (true) {
+        byte[] nonce = randomScalar(random);
+        curve.multiplyBase(nonce, sum);
+        curve.toAffine(sum, x, y);
+        EcP256Scalar.reduce(x, rScalar);
+        EcP256Scalar.decode(nonce, k);
+        Arrays.fill(nonce, (byte) 0);
+        if (EcP256Scalar.isZero(rScalar)) {
+          continue;
+        }
+        byte[] blindBytes = randomScalar(random);
+        EcP256Scalar.decode(blindBytes, blind);
+        Arrays.fill(blindBytes, (byte) 0);
+
+        EcP256Scalar.mul(k, blind, k, wide);
+        EcP256Scalar.invert(k, k, wide);
+        EcP256Scalar.mul(blind, privateScalar, t, wide);
+        EcP256Scalar.mul(t, rScalar, t, wide);
+        EcP256Scalar.mul(blind, eScalar, blind, wide);
+        EcP256Scalar.add(blind, t, t);
+        EcP256Scalar.mul(t, k, sScalar, wide);
+        Arrays.fill(k, 0);
+        Arrays.fill(blind, 0);
+        Arrays.fill(t, 0);
+        if (!EcP256Scalar.isZero(sScalar)) {
+          // r and s are the public signature, so BigInteger is fine from here on
+          return encodeSignature(toBigInteger(rScalar), toBigInteger(sScalar));
+        }
+      }
+    }
+
+    @Override
+    protected boolean engineVerify(byte[] sigBytes) throws SignatureException {
+      if (!verifying) {
+        throw new SignatureException("Not initialized for verification");
+      }
+      BigInteger n = EcP256Curve.N;
+      BigInteger e = new BigInteger(1, digest.digest());
+      BigInteger[] rs = decodeSignature(sigBytes);
+      BigInteger r = rs[0];
+      BigInteger s = rs[1];
+      if (r.signum() == 0 || r.compareTo(n) >= 0 || s.signum() == 0 || s.compareTo(n) >= 0) {
+        return false;
+      }
+      BigInteger w = s.modInverse(n);
+      curve.multiplyBase(toScalarBytes(e.multiply(w).mod(n)), sum);
+      curve.multiply(toScalarBytes(r.multiply(w).mod(n)), publicPoint, product);
+      curve.add(sum, product, sum);
+      return curve.toAffine(sum, x, y) && toBigInteger(x).mod(n).equals(r);
+    }
+
+    @Override
+    @Deprecated
+    protected void engineSetParameter(String param, Object value) {
+      throw new InvalidParameterException("No parameters are supported");
+    }
+
+    @Override
+    @Deprecated
+    protected Object engineGetParameter(String param) {
+      throw new InvalidParameterException("No parameters are supported");
+    }
+  }
+
+  /**
+   * @return true if {@code params} describes NIST P-256
+   */
+  static boolean isP256(@Nullable ECParameterSpec params) {
+    return (params != null)
+        && (params.getCofactor() == 1)
+        && params.getOrder().equals(EcP256Curve.N)
+        && params.getCurve().equals(PARAMS.getCurve())
+        && params.getGenerator().equals(PARAMS.getGenerator());
+  }
+
+  /**
+   * @return the private scalar of {@code key}, as {@link EcP256Curve#SCALAR_BYTES} big-endian
+   *   bytes
+   * @throws InvalidKeyException if {@code key} is not a valid P-256 private key
+   */
+  static byte[] toPrivateScalar(Key key) throws InvalidKeyException {
+    if (!(key instanceof ECPrivateKey)) {
+      throw new InvalidKeyException("Expected an ECPrivateKey");
+    }
+    ECPrivateKey privateKey = (ECPrivateKey) key;
+    if (!isP256(privateKey.getParams())) {
+      throw new InvalidKeyException("Only NIST P-256 keys are supported");
+    }
+    BigInteger s = privateKey.getS();
+    if ((s == null) || (s.signum() <= 0) || (s.compareTo(EcP256Curve.N) >= 0)) {
+      throw new InvalidKeyException("Private key out of range");
+    }
+    return toScalarBytes(s);
+  }
+
+  /**
+   * Sets {@code out} to the point of {@code key}.
+   *
+   * @throws InvalidKeyException if {@code key} is not a P-256 public key, or its point is not on
+   *   the curve
+   */
+  static void toPublicPoint(Key key, EcP256Curve curve, Point out) throws InvalidKeyException {
+    if (!(key instanceof ECPublicKey)) {
+      throw new InvalidKeyException("Expected an ECPublicKey");
+    }
+    ECPublicKey publicKey = (ECPublicKey) key;
+    if (!isP256(publicKey.getParams())) {
+      throw new InvalidKeyException("Only NIST P-256 keys are supported");
+    }
+    ECPoint w = publicKey.getW();
+    if (ECPoint.POINT_INFINITY.equals(w)
+        || !curve.setAffine(w.getAffineX(), w.getAffineY(), out)) {
+      throw new InvalidKeyException("Point is not on the P-256 curve");
+    }
+  }
+
+  /**
+   * @return a uniformly random scalar in {@code [1, n)}
+   */
+  static byte[] randomScalar(SecureRandom random) {
+    byte[] scalar = new byte[EcP256Curve.SCALAR_BYTES];
+    while (true) {
+      random.nextBytes(scalar);
+      if (EcP256Scalar.isValid(scalar)) {
+        return scalar;
+      }
+    }
+  }
+
+  /**
+   * @return {@code value}, which must be in {@code [0, 2^256)}, as {@link
+   *   EcP256Curve#SCALAR_BYTES} big-endian bytes
+   */
+  static byte[] toScalarBytes(BigInteger value) {
+    byte[] magnitude = value.toByteArray();
+    byte[] out = new byte[EcP256Curve.SCALAR_BYTES];
+    int length = Math.min(magnitude.length, out.length);
+    System.arraycopy(magnitude, magnitude.length - length, out, out.length - length, length);
+    return out;
+  }
+
+  static BigInteger toBigInteger(int[] a) {
+    return new BigInteger(1, EcP256Field.toByteArray(a));
+  }
+
+  /**
+   * @return the DER encoding of the ECDSA signature ({@code r}, {@code s})
+   */
+  static byte[] encodeSignature(BigInteger r, BigInteger s) {
+    byte[] rBytes = r.toByteArray();
+    byte[] sBytes = s.toByteArray();
+    // At most 70 bytes, so the short form of the lengths is enough
+    int length = 4 + rBytes.length + sBytes.length;
+    byte[] out = new byte[2 + length];
+    out[0] = DER_SEQUENCE;
+    out[1] = (byte) length;
+    out[2] = DER_INTEGER;
+    out[3] = (byte) rBytes.length;
+    System.arraycopy(rBytes, 0, out, 4, rBytes.length);
+    out[4 + rBytes.length] = DER_INTEGER;
+    out[5 + rBytes.length] = (byte) sBytes.length;
+    System.arraycopy(sBytes, 0, out, 6 + rBytes.length, sBytes.length);
+    return out;
+  }
+
+  /**
+   * @return {r, s} decoded from a DER encoded ECDSA signature
+   * @throws SignatureException if {@code signature} is not a strict DER encoding
+   */
+  static BigInteger[] decodeSignature(byte[] signature) throws SignatureException {
+    if ((signature.length < 2)
+        || (signature[0] != DER_SEQUENCE)
+        || ((signature[1] & 0xff) != signature.length - 2)) {
+      throw new SignatureException("Invalid signature encoding");
+    }
+    int rEnd = integerEnd(signature, 2);
+    int sEnd = integerEnd(signature, rEnd);
+    if (sEnd != signature.length) {
+      throw new SignatureException("Invalid signature encoding");
+    }
+    return new BigInteger[] {
+      new BigInteger(Arrays.copyOfRange(signature, 4, rEnd)),
+      new BigInteger(Arrays.copyOfRange(signature, rEnd + 2, sEnd))
+    };
+  }
+
+  /**
+   * @return the offset just past the minimally encoded, non-negative DER INTEGER at
+   *   {@code offset}
+   */
+  private static int integerEnd(byte[] der, int offset) throws SignatureException {
+    if ((offset + 2 > der.length) || (der[offset] != DER_INTEGER)) {
+      throw new SignatureException("Invalid signature encoding");
+    }
+    int length = der[offset + 1];
+    int start = offset + 2;
+    if ((length < 1)
+        || (length > EcP256Curve.SCALAR_BYTES + 1)
+        || (start + length > der.length)
+        || (der[start] < 0)
+        || ((length > 1) && (der[start] == 0) && (der[start + 1] >= 0))) {
+      throw new SignatureException("Invalid signature encoding");
+    }
+    return start + length;
+  }
+}
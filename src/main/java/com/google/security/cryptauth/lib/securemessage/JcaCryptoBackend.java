@@ -0,0 +1,210 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.security.KeyFactory;
+import java.security.KeyPairGenerator;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.security.Provider;
+import java.security.Signature;
+import java.util.Collections;
+import java.util.HashMap;
+import java.util.Locale;
+import java.util.Map;
+import javax.annotation.Nullable;
+import javax.crypto.Cipher;
+import javax.crypto.KeyAgreement;
+import javax.crypto.Mac;
+import javax.crypto.NoSuchPaddingException;
+
+/**
+ * A {@link CryptoBackend} that looks engines up through the standard JCA {@code getInstance}
+ * methods.
+ *
+ * <p>By default every engine comes from the platform's preferred provider, exactly as if {@code
+ * getInstance(algorithm)} had been called directly. Individual algorithms can be pinned to a
+ * specific {@link Provider}, and a backend can prefer one provider for everything it offers. For
+ * example, {@code JcaCryptoBackend.preferring(JcaCryptoBackend.loadConscryptProvider())} runs
+ * AES, HMAC, SHA and P-256 on the copy of BoringSSL bundled with Conscrypt when Conscrypt is on the
+ * classpath. That is not the host's system libcrypto.
+ *
+ * <p>Instances are immutable.
+ */
+public final class JcaCryptoBackend implements CryptoBackend {
+
+  /**
+   * Engine types, as used by {@link Provider#getService(String, String)}.
+   */
+  public static final String MESSAGE_DIGEST = "MessageDigest";
+  public static final String MAC = "Mac";
+  public static final String CIPHER = "Cipher";
+  public static final String SIGNATURE = "Signature";
+  public static final String KEY_AGREEMENT = "KeyAgreement";
+  public static final String KEY_FACTORY = "KeyFactory";
+  public static final String KEY_PAIR_GENERATOR = "KeyPairGenerator";
+
+  /**
+   * Uses the platform's preferred provider for everything.
+   */
+  public static final JcaCryptoBackend DEFAULT =
+      new JcaCryptoBackend(Collections.<String, Provider>emptyMap(), null);
+
+  /**
+   * Maps {@link #key(String, String)} to the provider pinned for that algorithm.
+   */
+  private final Map<String, Provider> pinnedProviders;
+
+  @Nullable private final Provider preferredProvider;
+
+  private JcaCryptoBackend(
+      Map<String, Provider> pinnedProviders, @Nullable Provider preferredProvider) {
+    this.pinnedProviders = pinnedProviders;
+    this.preferredProvider = preferredProvider;
+  }
+
+  /**
+   * @return a backend that takes every engine {@code provider} offers from it, and the rest from
+   *   the platform's preferred providers
+   */
+  public static JcaCryptoBackend preferring(Provider provider) {
+    if (provider == null) {
+      throw new NullPointerException();
+    }
+    return new JcaCryptoBackend(Collections.<String, Provider>emptyMap(), provider);
+  }
+
+  /**
+   * @return a copy of this backend that takes the {@code type} engine for {@code algorithm} (e.g.,
+   *   {@link #CIPHER} and {@code "AES/CBC/PKCS5Padding"}) from {@code provider}
+   */
+  public JcaCryptoBackend withPinnedProvider(String type, String algorithm, Provider provider) {
+    if ((type == null) || (algorithm == null) || (provider == null)) {
+      throw new NullPointerException();
+    }
+    Map<String, Provider> pinned = new HashMap<>(pinnedProviders);
+    pinned.put(key(type, algorithm), provider);
+    return new JcaCryptoBackend(Collections.unmodifiableMap(pinned), preferredProvider);
+  }
+
+  /**
+   * @return the provider this backend uses for the {@code type} engine for {@code algorithm}, or
+   *   null if it defers to the platform's preferred provider
+   */
+  @Nullable
+  public Provider getProvider(String type, String algorithm) {
+    Provider provider = pinnedProviders.get(key(type, algorithm));
+    if (provider != null) {
+      return provider;
+    }
+    if ((preferredProvider != null) && offers(preferredProvider, type, algorithm)) {
+      return preferredProvider;
+    }
+    return null;
+  }
+
+  /**
+   * Instantiates Conscrypt's provider (which wraps the BoringSSL it ships with) if Conscrypt and
+   * its native library are available. Conscrypt is looked up reflectively, so this library doesn't
+   * depend on it.
+   *
+   * @return the provider, or null if Conscrypt is unavailable
+   */
+  @Nullable
+  public static Provider loadConscryptProvider() {
+    try {
+      Class<?> conscrypt = Class.forName("org.conscrypt.Conscrypt");
+      return (Provider) conscrypt.getMethod("newProvider").invoke(null);
+    } catch (ReflectiveOperationException | LinkageError | RuntimeException e) {
+      return null;  // Not on the classpath, or the native library can't be loaded
+    }
+  }
+
+  @Override
+  public MessageDigest getMessageDigest(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(MESSAGE_DIGEST, algorithm);
+    return (provider == null)
+        ? MessageDigest.getInstance(algorithm)
+        : MessageDigest.getInstance(algorithm, provider);
+  }
+
+  @Override
+  public Mac getMac(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(MAC, algorithm);
+    return (provider == null) ? Mac.getInstance(algorithm) : Mac.getInstance(algorithm, provider);
+  }
+
+  @Override
+  public Cipher getCipher(String transformation)
+      throws NoSuchAlgorithmException, NoSuchPaddingException {
+    Provider provider = getProvider(CIPHER, transformation);
+    return (provider == null)
+        ? Cipher.getInstance(transformation)
+        : Cipher.getInstance(transformation, provider);
+  }
+
+  @Override
+  public Signature getSignature(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(SIGNATURE, algorithm);
+    return (provider == null)
+        ? Signature.getInstance(algorithm)
+        : Signature.getInstance(algorithm, provider);
+  }
+
+  @Override
+  public KeyAgreement getKeyAgreement(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(KEY_AGREEMENT, algorithm);
+    return (provider == null)
+        ? KeyAgreement.getInstance(algorithm)
+        : KeyAgreement.getInstance(algorithm, provider);
+  }
+
+  @Override
+  public KeyFactory getKeyFactory(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(KEY_FACTORY, algorithm);
+    return (provider == null)
+        ? KeyFactory.getInstance(algorithm)
+        : KeyFactory.getInstance(algorithm, provider);
+  }
+
+  @Override
+  public KeyPairGenerator getKeyPairGenerator(String algorithm) throws NoSuchAlgorithmException {
+    Provider provider = getProvider(KEY_PAIR_GENERATOR, algorithm);
+    return (provider == null)
+        ? KeyPairGenerator.getInstance(algorithm)
+        : KeyPairGenerator.getInstance(algorithm, provider);
+  }
+
+  /**
+   * @return true if {@code provider} has an engine for {@code algorithm}. Cipher transformations
+   *   are usually registered under just their algorithm name, e.g. "AES" for "AES/CBC/NoPadding".
+   */
+  static boolean offers(Provider provider, String type, String algorithm) {
+    if (provider.getService(type, algorithm) != null) {
+      return true;
+    }
+    int slash = algorithm.indexOf('/');
+    return type.equals(CIPHER)
+        && (slash > 0)
+        && (provider.getService(type, algorithm.substring(0, slash)) != null);
+  }
+
+  /**
+   * JCA algorithm names are case insensitive.
+   */
+  private static String key(String type, String algorithm) {
+    return type + "." + algorithm.toUpperCase(Locale.ROOT);
+  }
+}
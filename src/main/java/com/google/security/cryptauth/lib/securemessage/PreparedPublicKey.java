@@ -0,0 +1,114 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import java.security.InvalidKeyException;
+import java.security.NoSuchAlgorithmException;
+import java.security.PublicKey;
+import java.security.Signature;
+import javax.annotation.Nullable;
+
+/**
+ * A {@link PublicKey} that keeps a {@link Signature} engine ready for verifying its signatures, so
+ * that a key used for many messages only looks up and initializes the engine once per thread.
+ *
+ * <p>A {@code PreparedPublicKey} can be passed anywhere its underlying key can for verification.
+ * The engine is created with whichever provider {@link CryptoOps} is configured with when a thread
+ * first uses the key. It is thread safe, and is serialized as its underlying key.
+ */
+public final class PreparedPublicKey implements PublicKey {
+
+  private static final long serialVersionUID = 1L;
+
+  private final PublicKey publicKey;
+  private final SigType sigType;
+  private final transient ThreadLocal<Signature> verifiers = new ThreadLocal<>();
+
+  /**
+   * @param publicKey the key to verify signatures with
+   * @param sigType the public key signature scheme the key is used with
+   * @throws IllegalArgumentException if {@code sigType} isn't a public key scheme
+   */
+  public PreparedPublicKey(PublicKey publicKey, SigType sigType) {
+    if ((publicKey == null) || (sigType == null)) {
+      throw new NullPointerException();
+    }
+    if (!sigType.isPublicKeyScheme()) {
+      throw new IllegalArgumentException(sigType + " is not a public key signature scheme");
+    }
+    if (publicKey instanceof PreparedPublicKey) {
+      publicKey = ((PreparedPublicKey) publicKey).publicKey;
+    }
+    this.publicKey = publicKey;
+    this.sigType = sigType;
+  }
+
+  /**
+   * @return the key this key was prepared from
+   */
+  public PublicKey getPublicKey() {
+    return publicKey;
+  }
+
+  public SigType getSigType() {
+    return sigType;
+  }
+
+  @Override
+  public String getAlgorithm() {
+    return publicKey.getAlgorithm();
+  }
+
+  @Override
+  public String getFormat() {
+    return publicKey.getFormat();
+  }
+
+  @Override
+  public byte[] getEncoded() {
+    return publicKey.getEncoded();
+  }
+
+  /**
+   * @return the calling thread's engine for verifying {@code sigType} signatures with this key, or
+   *   null if the key was prepared for a different {@link SigType}. The engine is ready for
+   *   {@code update} calls, and is reset by each call to {@link Signature#verify(byte[])}.
+   */
+  @Nullable
+  Signature getVerifier(SigType sigType) throws NoSuchAlgorithmException, InvalidKeyException {
+    if (sigType != this.sigType) {
+      return null;
+    }
+    Signature verifier = verifiers.get();
+    if (verifier == null) {
+      verifier = CryptoOps.getSignature(sigType);
+      verifier.initVerify(publicKey);
+      verifiers.set(verifier);
+    }
+    return verifier;
+  }
+
+  /**
+   * Drops the calling thread's engine, whose state is unknown after a failure.
+   */
+  void discardVerifier() {
+    verifiers.remove();
+  }
+
+  private Object writeReplace() {
+    return publicKey;
+  }
+}
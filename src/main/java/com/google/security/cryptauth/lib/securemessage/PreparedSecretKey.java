@@ -0,0 +1,85 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.security.InvalidKeyException;
+import java.security.NoSuchAlgorithmException;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+import javax.crypto.SecretKey;
+
+/**
+ * A master {@link SecretKey} that remembers the sub-keys {@link CryptoOps} derives from it, so
+ * that a key used for many messages only pays for each HKDF derivation once.
+ *
+ * <p>A {@code PreparedSecretKey} can be used anywhere its master key can, and has the same
+ * algorithm and encoding. It is thread safe.
+ */
+public final class PreparedSecretKey implements SecretKey {
+
+  private static final long serialVersionUID = 1L;
+
+  private final SecretKey masterKey;
+  private final ConcurrentMap<String, SecretKey> derivedKeys = new ConcurrentHashMap<>();
+
+  /**
+   * @param masterKey the key to derive sub-keys from. If it is already a {@code
+   *   PreparedSecretKey}, its underlying master key is used.
+   */
+  public PreparedSecretKey(SecretKey masterKey) {
+    if (masterKey == null) {
+      throw new NullPointerException();
+    }
+    if (masterKey instanceof PreparedSecretKey) {
+      masterKey = ((PreparedSecretKey) masterKey).masterKey;
+    }
+    this.masterKey = masterKey;
+  }
+
+  /**
+   * @return the master key this key was prepared from
+   */
+  public SecretKey getMasterKey() {
+    return masterKey;
+  }
+
+  @Override
+  public String getAlgorithm() {
+    return masterKey.getAlgorithm();
+  }
+
+  @Override
+  public String getFormat() {
+    return masterKey.getFormat();
+  }
+
+  @Override
+  public byte[] getEncoded() {
+    return masterKey.getEncoded();
+  }
+
+  /**
+   * @see CryptoOps#deriveAes256KeyFor(SecretKey, String)
+   */
+  SecretKey getDerivedKey(String purpose) throws NoSuchAlgorithmException, InvalidKeyException {
+    SecretKey derivedKey = derivedKeys.get(purpose);
+    if (derivedKey == null) {
+      // Racing threads derive the same key, so it doesn't matter which one is kept
+      derivedKey = CryptoOps.deriveAes256KeyFor(masterKey, purpose);
+      derivedKeys.putIfAbsent(purpose, derivedKey);
+    }
+    return derivedKey;
+  }
+}
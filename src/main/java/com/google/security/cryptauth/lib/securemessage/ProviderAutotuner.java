@@ -0,0 +1,482 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.common.io.BaseEncoding;
+import java.math.BigInteger;
+import java.security.GeneralSecurityException;
+import java.security.KeyFactory;
+import java.security.MessageDigest;
+import java.security.PrivateKey;
+import java.security.Provider;
+import java.security.PublicKey;
+import java.security.SecureRandom;
+import java.security.Security;
+import java.security.Signature;
+import java.security.spec.ECPoint;
+import java.security.spec.ECPrivateKeySpec;
+import java.security.spec.ECPublicKeySpec;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.List;
+import java.util.Locale;
+import java.util.concurrent.TimeUnit;
+import java.util.logging.Level;
+import java.util.logging.Logger;
+import javax.crypto.Cipher;
+import javax.crypto.KeyAgreement;
+import javax.crypto.Mac;
+import javax.crypto.spec.IvParameterSpec;
+import javax.crypto.spec.SecretKeySpec;
+
+/**
+ * Picks the fastest correct provider for each primitive this library uses, and pins it in a
+ * {@link JcaCryptoBackend}.
+ *
+ * <p>Every candidate provider that offers a primitive must first pass a known-answer test (from
+ * FIPS 180, RFC 4231, SP 800-38A, RFC 6979 and RFC 5903). The candidates that pass are then timed
+ * on a representative operation for a fixed amount of time each. Decisions and measured rates
+ * are logged at {@code INFO}, and are available from the returned {@link Report}, so that the
+ * choice can be audited.
+ *
+ * <p>Tuning takes roughly {@code 2 * measurementNanos} per primitive and candidate, so it is best
+ * done once at startup, e.g. with {@link #autotune()}.
+ */
+public final class ProviderAutotuner {
+
+  private static final Logger logger = Logger.getLogger(ProviderAutotuner.class.getName());
+
+  /**
+   * Default time spent timing each candidate for each primitive, after an equal warm-up.
+   */
+  public static final long DEFAULT_MEASUREMENT_NANOS = TimeUnit.MILLISECONDS.toNanos(50);
+
+  /**
+   * Size of the messages digested, MACed and encrypted while timing.
+   */
+  private static final int MESSAGE_BYTES = 1024;
+
+  private final List<Provider> candidates;
+  private final long measurementNanos;
+
+  /**
+   * Considers every provider installed in {@link Security}, with the default measurement time.
+   */
+  public ProviderAutotuner() {
+    this(Arrays.asList(Security.getProviders()), DEFAULT_MEASUREMENT_NANOS);
+  }
+
+  /**
+   * @param candidates the providers to consider, which don't need to be installed (e.g., an
+   *   {@link EcP256Provider}, or {@link JcaCryptoBackend#loadConscryptProvider()})
+   * @param measurementNanos how long to time each candidate for each primitive
+   */
+  public ProviderAutotuner(List<Provider> candidates, long measurementNanos) {
+    if (candidates == null) {
+      throw new NullPointerException();
+    }
+    if (measurementNanos <= 0) {
+      throw new IllegalArgumentException("Measurement time must be positive");
+    }
+    this.candidates = new ArrayList<>(candidates);
+    this.measurementNanos = measurementNanos;
+  }
+
+  /**
+   * Tunes using every installed provider, and installs the result with {@link
+   * CryptoOps#setBackend(CryptoBackend)}.
+   */
+  public static Report autotune() {
+    Report report = new ProviderAutotuner().run();
+    CryptoOps.setBackend(report.getBackend());
+    return report;
+  }
+
+  /**
+   * Runs the known-answer tests and measurements. Doesn't change the current backend.
+   */
+  public Report run() {
+    JcaCryptoBackend backend = JcaCryptoBackend.DEFAULT;
+    List<Measurement> measurements = new ArrayList<>();
+    for (Primitive primitive : primitives()) {
+      Measurement best = null;
+      for (Provider provider : candidates) {
+        if (!JcaCryptoBackend.offers(provider, primitive.type, primitive.algorithm)) {
+          continue;
+        }
+        Measurement measurement = measure(primitive, provider);
+        measurements.add(measurement);
+        if (measurement.isCorrect()
+            && ((best == null) || (measurement.getOpsPerSecond() > best.getOpsPerSecond()))) {
+          best = measurement;
+        }
+      }
+      if (best == null) {
+        logger.info(String.format(
+            "%s %s: no candidate passed, using the platform default",
+            primitive.type, primitive.algorithm));
+        continue;
+      }
+      best.chosen = true;
+      backend = backend.withPinnedProvider(primitive.type, primitive.algorithm, best.provider);
+      logger.info(String.format(
+          "%s %s: chose %s at %.0f ops/s", primitive.type, primitive.algorithm,
+          best.getProviderName(), best.getOpsPerSecond()));
+    }
+    Report report = new Report(backend, measurements);
+    logger.info(report.toString());
+    return report;
+  }
+
+  private Measurement measure(Primitive primitive, Provider provider) {
+    try {
+      if (!primitive.passesKnownAnswerTest(provider)) {
+        logger.warning(String.format(
+            "%s %s from %s failed its known-answer test",
+            primitive.type, primitive.algorithm, provider.getName()));
+        return new Measurement(primitive, provider, false, 0);
+      }
+      Operation operation = primitive.prepare(provider);
+      time(operation, measurementNanos);  // Warm up
+      return new Measurement(primitive, provider, true, time(operation, measurementNanos));
+    } catch (GeneralSecurityException | RuntimeException e) {
+      logger.log(Level.FINE, String.format(
+          "%s %s from %s is unusable", primitive.type, primitive.algorithm, provider.getName()), e);
+      return new Measurement(primitive, provider, false, 0);
+    }
+  }
+
+  /**
+   * @return operations per second
+   */
+  private static double time(Operation operation, long nanos) throws GeneralSecurityException {
+    long start = System.nanoTime();
+    long elapsed;
+    long count = 0;
+    do {
+      operation.run();
+      count++;
+      elapsed = System.nanoTime() - start;
+    } while (elapsed < nanos);
+    return count * 1e9 / elapsed;
+  }
+
+  /**
+   * The measurements for every primitive and candidate, and the resulting backend.
+   */
+  public static final class Report {
+    private final JcaCryptoBackend backend;
+    private final List<Measurement> measurements;
+
+    Report(JcaCryptoBackend backend, List<Measurement> measurements) {
+      this.backend = backend;
+      this.measurements = Collections.unmodifiableList(measurements);
+    }
+
+    /**
+     * @return a backend with the fastest correct provider pinned for every tuned primitive
+     */
+    public JcaCryptoBackend getBackend() {
+      return backend;
+    }
+
+    public List<Measurement> getMeasurements() {
+      return measurements;
+    }
+
+    @Override
+    public String toString() {
+      StringBuilder result = new StringBuilder("Provider autotuning results:");
+      for (Measurement measurement : measurements) {
+        result.append("\n  ").append(measurement);
+      }
+      return result.toString();
+    }
+  }
+
+  /**
+   * The outcome of testing and timing one provider for one primitive.
+   */
+  public static final class Measurement {
+    private final String type;
+    private final String algorithm;
+    private final Provider provider;
+    private final boolean correct;
+    private final double opsPerSecond;
+    private boolean chosen;
+
+    Measurement(Primitive primitive, Provider provider, boolean correct, double opsPerSecond) {
+      this.type = primitive.type;
+      this.algorithm = primitive.algorithm;
+      this.provider = provider;
+      this.correct = correct;
+      this.opsPerSecond = opsPerSecond;
+    }
+
+    public String getType() {
+      return type;
+    }
+
+    public String getAlgorithm() {
+      return algorithm;
+    }
+
+    public String getProviderName() {
+      return provider.getName();
+    }
+
+    /**
+     * @return false if the provider failed the known-answer test, or couldn't be used at all
+     */
+    public boolean isCorrect() {
+      return correct;
+    }
+
+    /**
+     * @return the measured rate, or 0 if the provider wasn't timed
+     */
+    public double getOpsPerSecond() {
+      return opsPerSecond;
+    }
+
+    /**
+     * @return true if this provider was pinned for the primitive
+     */
+    public boolean isChosen() {
+      return chosen;
+    }
+
+    @Override
+    public String toString() {
+      return String.format(Locale.ROOT, "%s %s %s: %s%s", type, algorithm, getProviderName(),
+          correct ? String.format(Locale.ROOT, "%.0f ops/s", opsPerSecond) : "FAILED",
+          chosen ? " (chosen)" : "");
+    }
+  }
+
+  private interface Operation {
+    void run() throws GeneralSecurityException;
+  }
+
+  private abstract static class Primitive {
+    final String type;
+    final String algorithm;
+
+    Primitive(String type, String algorithm) {
+      this.type = type;
+      this.algorithm = algorithm;
+    }
+
+    abstract boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException;
+
+    /**
+     * @return a representative operation using {@code provider}, to be timed
+     */
+    abstract Operation prepare(Provider provider) throws GeneralSecurityException;
+  }
+
+  private static List<Primitive> primitives() {
+    List<Primitive> primitives = new ArrayList<>();
+    primitives.add(digest("SHA-256",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    primitives.add(digest("SHA-512",
+        "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+        + "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"));
+    primitives.add(new Primitive(JcaCryptoBackend.MAC, "HmacSHA256") {
+      @Override
+      boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException {
+        // RFC 4231, test case 2
+        Mac mac = Mac.getInstance(algorithm, provider);
+        mac.init(new SecretKeySpec(CryptoOps.utf8StringToBytes("Jefe"), algorithm));
+        return Arrays.equals(
+            hex("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"),
+            mac.doFinal(CryptoOps.utf8StringToBytes("what do ya want for nothing?")));
+      }
+
+      @Override
+      Operation prepare(Provider provider) throws GeneralSecurityException {
+        final Mac mac = Mac.getInstance(algorithm, provider);
+        mac.init(new SecretKeySpec(new byte[32], algorithm));
+        final byte[] message = new byte[MESSAGE_BYTES];
+        return new Operation() {
+          @Override
+          public void run() {
+            mac.doFinal(message);
+          }
+        };
+      }
+    });
+    primitives.add(new Primitive(JcaCryptoBackend.CIPHER, "AES/CBC/PKCS5Padding") {
+      // SP 800-38A, F.2.5, followed by a block of padding
+      private final SecretKeySpec key = new SecretKeySpec(
+          hex("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4"), "AES");
+      private final IvParameterSpec iv =
+          new IvParameterSpec(hex("000102030405060708090a0b0c0d0e0f"));
+      private final byte[] plaintext = hex("6bc1bee22e409f96e93d7e117393172a");
+      private final byte[] ciphertext =
+          hex("f58c4c04d6e5f1ba779eabfb5f7bfbd6485a5c81519cf378fa36d42b8547edc0");
+
+      @Override
+      boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException {
+        Cipher cipher = Cipher.getInstance(algorithm, provider);
+        cipher.init(Cipher.ENCRYPT_MODE, key, iv);
+        if (!Arrays.equals(ciphertext, cipher.doFinal(plaintext))) {
+          return false;
+        }
+        cipher.init(Cipher.DECRYPT_MODE, key, iv);
+        return Arrays.equals(plaintext, cipher.doFinal(ciphertext));
+      }
+
+      @Override
+      Operation prepare(Provider provider) throws GeneralSecurityException {
+        final Cipher cipher = Cipher.getInstance(algorithm, provider);
+        final byte[] message = new byte[MESSAGE_BYTES];
+        return new Operation() {
+          @Override
+          public void run() throws GeneralSecurityException {
+            // Re-initialized every time, since CryptoOps does that for every message
+            cipher.init(Cipher.ENCRYPT_MODE, key, iv);
+            cipher.doFinal(message);
+          }
+        };
+      }
+    });
+    primitives.add(new Primitive(JcaCryptoBackend.SIGNATURE, "SHA256withECDSA") {
+      // RFC 6979, A.2.5, with SHA-256 and the message "sample"
+      private final BigInteger privateScalar = new BigInteger(
+          "c9afa9d845ba75166b5c215767b1d6934e50c3db36e89b127b8a622b120f6721", 16);
+      private final BigInteger publicX = new BigInteger(
+          "60fed4ba255a9d31c961eb74c6356d68c049b8923b61fa6ce669622e60f29fb6", 16);
+      private final BigInteger publicY = new BigInteger(
+          "7903fe1008b8bc99a41ae9e95628bc64f2f1b20c2d7e9f5177a3c294d4462299", 16);
+      private final byte[] message = CryptoOps.utf8StringToBytes("sample");
+      private final byte[] signature = EcP256Spi.encodeSignature(
+          new BigInteger("efd48b2aacb6a8fd1140dd9cd45e81d69d2c877b56aaf991c34d0ea84eaf3716", 16),
+          new BigInteger("f7cb1c942d657c41d436c7a1b6e29f65f3e900dbb9aff4064dc4ab2f843acda8", 16));
+
+      @Override
+      boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException {
+        // ECDSA signatures are randomized, so check that a known signature verifies, and that
+        // a fresh one verifies against the platform's implementation
+        PublicKey publicKey = ecPublicKey(publicX, publicY);
+        Signature verifier = Signature.getInstance(algorithm, provider);
+        verifier.initVerify(publicKey);
+        verifier.update(message);
+        if (!verifier.verify(signature)) {
+          return false;
+        }
+        Signature signer = Signature.getInstance(algorithm, provider);
+        signer.initSign(ecPrivateKey(privateScalar), new SecureRandom());
+        signer.update(message);
+        Signature platformVerifier = Signature.getInstance(algorithm);
+        platformVerifier.initVerify(publicKey);
+        platformVerifier.update(message);
+        return platformVerifier.verify(signer.sign());
+      }
+
+      @Override
+      Operation prepare(Provider provider) throws GeneralSecurityException {
+        final Signature signer = Signature.getInstance(algorithm, provider);
+        signer.initSign(ecPrivateKey(privateScalar), new SecureRandom());
+        final Signature verifier = Signature.getInstance(algorithm, provider);
+        verifier.initVerify(ecPublicKey(publicX, publicY));
+        return new Operation() {
+          @Override
+          public void run() throws GeneralSecurityException {
+            // Both halves are on the request path of a handshake
+            signer.update(message);
+            verifier.update(message);
+            verifier.verify(signer.sign());
+          }
+        };
+      }
+    });
+    primitives.add(new Primitive(JcaCryptoBackend.KEY_AGREEMENT, "ECDH") {
+      // RFC 5903, section 8.1
+      private final BigInteger privateScalar = new BigInteger(
+          "c6ef9c5d78ae012a011164acb397ce2088685d8f06bf9be0b283ab46476bee53", 16);
+      private final BigInteger peerX = new BigInteger(
+          "dad0b65394221cf9b051e1feca5787d098dfe637fc90b9ef945d0c3772581180", 16);
+      private final BigInteger peerY = new BigInteger(
+          "5271a0461cdb8252d61f1c456fa3e59ab1f45b33accf5f58389e0577b8990bb3", 16);
+      private final byte[] sharedSecret =
+          hex("d6840f6b42f6edafd13116e0e12565202fef8e9ece7dce03812464d04b9442de");
+
+      @Override
+      boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException {
+        KeyAgreement agreement = KeyAgreement.getInstance(algorithm, provider);
+        agreement.init(ecPrivateKey(privateScalar));
+        agreement.doPhase(ecPublicKey(peerX, peerY), true);
+        return Arrays.equals(sharedSecret, agreement.generateSecret());
+      }
+
+      @Override
+      Operation prepare(Provider provider) throws GeneralSecurityException {
+        final KeyAgreement agreement = KeyAgreement.getInstance(algorithm, provider);
+        final PrivateKey privateKey = ecPrivateKey(privateScalar);
+        final PublicKey peerKey = ecPublicKey(peerX, peerY);
+        return new Operation() {
+          @Override
+          public void run() throws GeneralSecurityException {
+            agreement.init(privateKey);
+            agreement.doPhase(peerKey, true);
+            agreement.generateSecret();
+          }
+        };
+      }
+    });
+    return primitives;
+  }
+
+  private static Primitive digest(String algorithm, final String expectedAbcHash) {
+    return new Primitive(JcaCryptoBackend.MESSAGE_DIGEST, algorithm) {
+      @Override
+      boolean passesKnownAnswerTest(Provider provider) throws GeneralSecurityException {
+        // FIPS 180-2, the one block message "abc"
+        return Arrays.equals(
+            hex(expectedAbcHash),
+            MessageDigest.getInstance(algorithm, provider)
+                .digest(CryptoOps.utf8StringToBytes("abc")));
+      }
+
+      @Override
+      Operation prepare(Provider provider) throws GeneralSecurityException {
+        final MessageDigest digest = MessageDigest.getInstance(algorithm, provider);
+        final byte[] message = new byte[MESSAGE_BYTES];
+        return new Operation() {
+          @Override
+          public void run() {
+            digest.digest(message);
+          }
+        };
+      }
+    };
+  }
+
+  private static PublicKey ecPublicKey(BigInteger x, BigInteger y)
+      throws GeneralSecurityException {
+    return KeyFactory.getInstance("EC")
+        .generatePublic(new ECPublicKeySpec(new ECPoint(x, y), EcP256Spi.PARAMS));
+  }
+
+  private static PrivateKey ecPrivateKey(BigInteger s) throws GeneralSecurityException {
+    return KeyFactory.getInstance("EC").generatePrivate(new ECPrivateKeySpec(s, EcP256Spi.PARAMS));
+  }
+
+  private static byte[] hex(String hex) {
+    return BaseEncoding.base16().lowerCase().decode(hex);
+  }
+}
@@ -0,0 +1,182 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.common.annotations.VisibleForTesting;
+import com.google.protobuf.ByteString;
+import com.google.protobuf.InvalidProtocolBufferException;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
+import java.security.PublicKey;
+import java.security.spec.InvalidKeySpecException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.Executor;
+import java.util.concurrent.atomic.AtomicReference;
+import javax.annotation.Nullable;
+
+/**
+ * Parses and validates large numbers of serialized {@link GenericPublicKey} protos at once, e.g.
+ * when importing enrollments in bulk.
+ *
+ * <p>Identical inputs are only parsed once. The distinct inputs are split into chunks which are
+ * spread over a caller supplied {@link Executor}, and each chunk reuses a single {@code
+ * KeyFactory} and set of curve check buffers for all of its EC keys. A malformed key never fails
+ * the whole batch: every input gets its own {@link Result}.
+ *
+ * @see PublicKeyProtoUtil#parsePublicKey(GenericPublicKey)
+ */
+public class PublicKeyBatchParser {
+
+  private PublicKeyBatchParser() {}  // Do not instantiate
+
+  /**
+   * Number of distinct keys handled by a single task.
+   */
+  private static final int DEFAULT_CHUNK_SIZE = 64;
+
+  /**
+   * The outcome of parsing one input: either a {@link PublicKey} or the reason it was rejected.
+   */
+  public static final class Result {
+    @Nullable private final PublicKey publicKey;
+    @Nullable private final InvalidKeySpecException error;
+
+    private Result(@Nullable PublicKey publicKey, @Nullable InvalidKeySpecException error) {
+      this.publicKey = publicKey;
+      this.error = error;
+    }
+
+    /**
+     * @return true if the input was a valid and supported public key
+     */
+    public boolean isValid() {
+      return publicKey != null;
+    }
+
+    /**
+     * @return the parsed key, or null if the input was rejected
+     */
+    @Nullable
+    public PublicKey getPublicKey() {
+      return publicKey;
+    }
+
+    /**
+     * @return the reason the input was rejected, or null if it was valid
+     */
+    @Nullable
+    public InvalidKeySpecException getError() {
+      return error;
+    }
+  }
+
+  /**
+   * Parses every serialized {@link GenericPublicKey} in {@code encodedPublicKeys}.
+   *
+   * @param executor runs the parsing work. The calling thread also takes part, and blocks until
+   *   every input has been handled.
+   * @return one {@link Result} per input, in the same order as the inputs. Identical inputs share
+   *   the same {@link Result}.
+   * @throws InterruptedException if interrupted while waiting for {@code executor}
+   */
+  public static List<Result> parsePublicKeys(List<byte[]> encodedPublicKeys, Executor executor)
+      throws InterruptedException {
+    return parsePublicKeys(encodedPublicKeys, executor, DEFAULT_CHUNK_SIZE);
+  }
+
+  @VisibleForTesting
+  static List<Result> parsePublicKeys(
+      List<byte[]> encodedPublicKeys, Executor executor, int chunkSize)
+      throws InterruptedException {
+    if ((encodedPublicKeys == null) || (executor == null)) {
+      throw new NullPointerException();
+    }
+    if (chunkSize < 1) {
+      throw new IllegalArgumentException("Chunk size must be positive");
+    }
+
+    // Map each input onto the first occurrence of its value
+    Map<ByteString, Integer> indexOf = new HashMap<>();
+    final List<ByteString> distinct = new ArrayList<>();
+    int[] distinctIndex = new int[encodedPublicKeys.size()];
+    for (int i = 0; i < distinctIndex.length; i++) {
+      ByteString encoded = ByteString.copyFrom(encodedPublicKeys.get(i));
+      Integer index = indexOf.get(encoded);
+      if (index == null) {
+        index = distinct.size();
+        indexOf.put(encoded, index);
+        distinct.add(encoded);
+      }
+      distinctIndex[i] = index;
+    }
+    if (distinct.isEmpty()) {
+      return Collections.emptyList();
+    }
+
+    final Result[] distinctResults = new Result[distinct.size()];
+    int chunks = (distinct.size() + chunkSize - 1) / chunkSize;
+    final CountDownLatch done = new CountDownLatch(chunks - 1);
+    final AtomicReference<RuntimeException> failure = new AtomicReference<>();
+    for (int chunk = 1; chunk < chunks; chunk++) {
+      final int start = chunk * chunkSize;
+      final int end = Math.min(start + chunkSize, distinct.size());
+      executor.execute(new Runnable() {
+        @Override
+        public void run() {
+          try {
+            parseRange(distinct, start, end, distinctResults);
+          } catch (RuntimeException e) {
+            failure.compareAndSet(null, e);
+          } finally {
+            done.countDown();
+          }
+        }
+      });
+    }
+    // Handle the first chunk on this thread rather than leaving it idle
+    parseRange(distinct, 0, Math.min(chunkSize, distinct.size()), distinctResults);
+    done.await();
+    if (failure.get() != null) {
+      throw failure.get();
+    }
+
+    Result[] results = new Result[distinctIndex.length];
+    for (int i = 0; i < results.length; i++) {
+      results[i] = distinctResults[distinctIndex[i]];
+    }
+    return Collections.unmodifiableList(Arrays.asList(results));
+  }
+
+  private static void parseRange(List<ByteString> encodedPublicKeys, int start, int end,
+      Result[] results) {
+    PublicKeyProtoUtil.EcKeyParser ecKeyParser = new PublicKeyProtoUtil.EcKeyParser();
+    for (int i = start; i < end; i++) {
+      try {
+        GenericPublicKey gpk = GenericPublicKey.parseFrom(encodedPublicKeys.get(i));
+        results[i] = new Result(PublicKeyProtoUtil.parsePublicKey(gpk, ecKeyParser), null);
+      } catch (InvalidKeySpecException e) {
+        results[i] = new Result(null, e);
+      } catch (InvalidProtocolBufferException | IllegalArgumentException e) {
+        results[i] =
+            new Result(null, new InvalidKeySpecException("Unable to parse GenericPublicKey", e));
+      }
+    }
+  }
+}
@@ -0,0 +1,119 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.common.annotations.VisibleForTesting;
+import com.google.common.base.Ticker;
+import com.google.common.cache.Cache;
+import com.google.common.cache.CacheBuilder;
+import com.google.protobuf.ByteString;
+import com.google.protobuf.InvalidProtocolBufferException;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
+import java.security.PublicKey;
+import java.security.spec.InvalidKeySpecException;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * A bounded, thread safe cache from encoded {@link GenericPublicKey} protos to the validated
+ * {@link PublicKey} objects they describe.
+ *
+ * <p>Parsing a public key requires validating the encoding (and, for EC keys, that the point lies
+ * on the curve) and building a new key through the security provider. Servers that see the same
+ * peer keys over and over can use this class to skip that work for keys they have already
+ * validated. Only successfully parsed keys are cached; malformed inputs are rejected every time.
+ *
+ * @see PublicKeyProtoUtil#parsePublicKey(GenericPublicKey)
+ */
+public class PublicKeyCache {
+
+  private final Cache<ByteString, PublicKey> cache;
+
+  /**
+   * @param maximumSize the maximum number of keys to retain, least recently used keys are evicted
+   *   first once this is exceeded
+   * @param expireAfterWrite how long a parsed key may be served from the cache
+   * @param unit the unit of {@code expireAfterWrite}
+   */
+  public PublicKeyCache(long maximumSize, long expireAfterWrite, TimeUnit unit) {
+    this(maximumSize, expireAfterWrite, unit, Ticker.systemTicker());
+  }
+
+  @VisibleForTesting
+  PublicKeyCache(long maximumSize, long expireAfterWrite, TimeUnit unit, Ticker ticker) {
+    if (maximumSize < 0 || expireAfterWrite < 0) {
+      throw new IllegalArgumentException("Cache limits must not be negative");
+    }
+    this.cache = CacheBuilder.newBuilder()
+        .maximumSize(maximumSize)
+        .expireAfterWrite(expireAfterWrite, unit)
+        .ticker(ticker)
+        .recordStats()
+        .build();
+  }
+
+  /**
+   * Extracts a {@link PublicKey} from the serialized {@link GenericPublicKey} in
+   * {@code encodedPublicKey}, reusing a previously validated key when one is available.
+   *
+   * @throws InvalidKeySpecException if the input is not a valid and/or supported public key
+   */
+  public PublicKey parsePublicKey(byte[] encodedPublicKey) throws InvalidKeySpecException {
+    if (encodedPublicKey == null) {
+      throw new NullPointerException();
+    }
+    ByteString cacheKey = ByteString.copyFrom(encodedPublicKey);
+    PublicKey result = cache.getIfPresent(cacheKey);
+    if (result != null) {
+      return result;
+    }
+    try {
+      result = PublicKeyProtoUtil.parsePublicKey(GenericPublicKey.parseFrom(cacheKey));
+    } catch (InvalidProtocolBufferException e) {
+      throw new InvalidKeySpecException("Unable to parse GenericPublicKey", e);
+    } catch (IllegalArgumentException e) {
+      throw new InvalidKeySpecException("Unable to parse GenericPublicKey", e);
+    }
+    cache.put(cacheKey, result);
+    return result;
+  }
+
+  /**
+   * @return the number of lookups that were served from the cache
+   */
+  public long getHitCount() {
+    return cache.stats().hitCount();
+  }
+
+  /**
+   * @return the number of lookups that had to parse their input
+   */
+  public long getMissCount() {
+    return cache.stats().missCount();
+  }
+
+  /**
+   * @return the approximate number of keys currently held
+   */
+  public long size() {
+    return cache.size();
+  }
+
+  /**
+   * Discards all cached keys. The hit and miss counters are not reset.
+   */
+  public void invalidateAll() {
+    cache.invalidateAll();
+  }
+}
@@ -22,22 +22,25 @@ import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.EcP256
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.SimpleRsaPublicKey;
 import java.math.BigInteger;
+import java.security.AlgorithmParameters;
+import java.security.GeneralSecurityException;
 import java.security.InvalidAlgorithmParameterException;
 import java.security.KeyFactory;
 import java.security.KeyPair;
 import java.security.KeyPairGenerator;
 import java.security.NoSuchAlgorithmException;
+import java.security.Provider;
 import java.security.PublicKey;
 import java.security.SecureRandom;
 import java.security.interfaces.ECPublicKey;
 import java.security.interfaces.RSAPublicKey;
-import java.security.spec.ECFieldFp;
 import java.security.spec.ECGenParameterSpec;
 import java.security.spec.ECParameterSpec;
 import java.security.spec.ECPoint;
 import java.security.spec.ECPublicKeySpec;
 import java.security.spec.InvalidKeySpecException;
 import java.security.spec.RSAPublicKeySpec;
+import javax.annotation.Nullable;
 import javax.crypto.interfaces.DHPrivateKey;
 import javax.crypto.interfaces.DHPublicKey;
 import javax.crypto.spec.DHParameterSpec;
@@ -54,11 +57,6 @@ public class PublicKeyProtoUtil {
 
   private PublicKeyProtoUtil() {}  // Do not instantiate
 
-  /**
-   * Caches state about whether the current platform supports Elliptic Curve algorithms.
-   */
-  private static final Boolean IS_LEGACY_CRYPTO_REQUIRED = determineIfLegacyCryptoRequired();
-
   private static final BigInteger ONE = new BigInteger("1");
   private static final BigInteger TWO = new BigInteger("2");
 
@@ -78,30 +76,6 @@ public class PublicKeyProtoUtil {
    */
   private static final String EC_P256_OPENSSL_NAME = "prime256v1";
 
-  /**
-   * The {@link ECParameterSpec} for the NIST P-256 Elliptic Curve.
-   */
-  private static final ECParameterSpec EC_P256_PARAMS = isLegacyCryptoRequired() ? null :
-      ((ECPublicKey) generateEcP256KeyPair().getPublic()).getParams();
-
-  /**
-   * The prime {@code p} describing the field for the NIST P-256 curve.
-   */
-  private static final BigInteger EC_P256_P = isLegacyCryptoRequired() ? null :
-      ((ECFieldFp) EC_P256_PARAMS.getCurve().getField()).getP();
-
-  /**
-   * The coefficient {@code a} for the NIST P-256 curve.
-   */
-  private static final BigInteger EC_P256_A = isLegacyCryptoRequired() ? null :
-      EC_P256_PARAMS.getCurve().getA();
-
-  /**
-   * The coefficient {@code b} for the NIST P-256 curve.
-   */
-  private static final BigInteger EC_P256_B = isLegacyCryptoRequired() ? null :
-      EC_P256_PARAMS.getCurve().getB();
-
   /**
    * Maximum number of bytes in a 2's complement encoding of a NIST P-256 elliptic curve point.
    */
@@ -236,6 +210,35 @@ public class PublicKeyProtoUtil {
         .build();
   }
 
+  /**
+   * Encodes an {@link ECPublicKey} to an {@link EcP256PublicKey} proto message in compressed form,
+   * i.e., with only the x coordinate and the parity of the y coordinate. Only send compressed keys
+   * to peers known to support them, as older implementations require the y coordinate.
+   */
+  public static EcP256PublicKey encodeCompressedEcPublicKey(PublicKey pk) {
+    ECPublicKey epk = pkToECPublicKey(pk);
+    return EcP256PublicKey.newBuilder()
+        .setX(extractX(epk))
+        .setYIsOdd(epk.getW().getAffineY().testBit(0))
+        .build();
+  }
+
+  /**
+   * Same as {@link #encodePublicKey(PublicKey)}, except that {@link ECPublicKey}s are encoded in
+   * compressed form.
+   *
+   * @see #encodeCompressedEcPublicKey(PublicKey)
+   */
+  public static GenericPublicKey encodeCompressedPublicKey(PublicKey pk) {
+    if (pk instanceof ECPublicKey) {
+      return GenericPublicKey.newBuilder()
+          .setType(SecureMessageProto.PublicKeyType.EC_P256)
+          .setEcP256PublicKey(encodeCompressedEcPublicKey(pk))
+          .build();
+    }
+    return encodePublicKey(pk);
+  }
+
   /**
    * Encodes a 2048-bit {@link RSAPublicKey} to an {@link SimpleRsaPublicKey} proto message.
    */
@@ -264,6 +267,15 @@ public class PublicKeyProtoUtil {
    * @throws InvalidKeySpecException if the input is not a valid and/or supported public key type
    */
   public static PublicKey parsePublicKey(GenericPublicKey gpk) throws InvalidKeySpecException {
+    return parsePublicKey(gpk, null);
+  }
+
+  /**
+   * Same as {@link #parsePublicKey(GenericPublicKey)}, but parses EC keys with the given
+   * {@link EcKeyParser} (if not null), so that its state can be reused across many keys.
+   */
+  static PublicKey parsePublicKey(GenericPublicKey gpk, @Nullable EcKeyParser ecKeyParser)
+      throws InvalidKeySpecException {
     if (!gpk.hasType()) {
       // "required" means nothing in micro proto land. We have to check this ourselves.
       throw new InvalidKeySpecException("GenericPublicKey.type is a required field");
@@ -273,7 +285,10 @@ public class PublicKeyProtoUtil {
         if (!gpk.hasEcP256PublicKey()) {
           break;
         }
-        return parseEcPublicKey(gpk.getEcP256PublicKey());
+        if (ecKeyParser == null) {
+          ecKeyParser = new EcKeyParser();
+        }
+        return ecKeyParser.parse(gpk.getEcP256PublicKey());
       case RSA2048:
         if (!gpk.hasRsa2048PublicKey()) {
           break;
@@ -298,25 +313,7 @@ public class PublicKeyProtoUtil {
    */
   public static ECPublicKey parseEcPublicKey(EcP256PublicKey p256pk)
       throws InvalidKeySpecException {
-    if (!p256pk.hasX() || !p256pk.hasY()) {
-      throw new InvalidKeySpecException("Key is missing a required coordinate");
-    }
-    if (isLegacyCryptoRequired()) {
-      throw new InvalidKeySpecException("Elliptic Curve keys not supported on this platform");
-    }
-    byte[] encodedX = p256pk.getX().toByteArray();
-    byte[] encodedY = p256pk.getY().toByteArray();
-    try {
-      validateEcP256CoordinateEncoding(encodedX);
-      validateEcP256CoordinateEncoding(encodedY);
-      BigInteger wX = new BigInteger(encodedX);
-      BigInteger wY = new BigInteger(encodedY);
-      validateEcP256CurvePoint(wX, wY);
-      return (ECPublicKey) KeyFactory.getInstance(EC_ALG).generatePublic(
-          new ECPublicKeySpec(new ECPoint(wX, wY), EC_P256_PARAMS));
-    } catch (NoSuchAlgorithmException e) {
-      throw new RuntimeException(e);
-    }
+    return new EcKeyParser().parse(p256pk);
   }
 
   /**
@@ -337,7 +334,7 @@ public class PublicKeyProtoUtil {
     }
     BigInteger e = BigInteger.valueOf(pk.getE());
     try {
-      return (RSAPublicKey) KeyFactory.getInstance(RSA_ALG).generatePublic(
+      return (RSAPublicKey) CryptoOps.getBackend().getKeyFactory(RSA_ALG).generatePublic(
           new RSAPublicKeySpec(n, e));
     } catch (NoSuchAlgorithmException e1) {
       throw new AssertionError(e1);  // Should never happen
@@ -364,7 +361,7 @@ public class PublicKeyProtoUtil {
     }
     validateDhGroupElement(y);
     try {
-      return (DHPublicKey) KeyFactory.getInstance(DH_ALG).generatePublic(
+      return (DHPublicKey) CryptoOps.getBackend().getKeyFactory(DH_ALG).generatePublic(
           new DHPublicKeySpec(y, DH_P, DH_G));
     } catch (NoSuchAlgorithmException e) {
       throw new AssertionError(e);  // Should never happen
@@ -390,16 +387,14 @@ public class PublicKeyProtoUtil {
    *   described by {@link #DH_G}
    */
   public static KeyPair generateDh2048KeyPair() {
-    try {
-      return getDhKeyGen().generateKeyPair();
-    } catch (InvalidAlgorithmParameterException e) {
-      // Construct an appropriate KeyPair manually, since this platform refuses to do it for us
-      DHParameterSpec spec = new DHParameterSpec(DH_P, DH_G);
-      BigInteger x = new BigInteger(DH_LEN, new SecureRandom());
-      DHPrivateKey privateKey = new DHPrivateKeyShim(x, spec);
-      DHPublicKey publicKey = new DHPublicKeyShim(DH_G.modPow(x, DH_P), spec);
-      return new KeyPair(publicKey, privateKey);
-    }
+    // Construct the KeyPair manually rather than through the platform's generator: some platforms
+    // refuse to use this group, and since the generator is fixed, a precomputed table makes the
+    // exponentiation much cheaper than a generic modPow.
+    DHParameterSpec spec = new DHParameterSpec(DH_P, DH_G);
+    BigInteger x = new BigInteger(DH_LEN, new SecureRandom());
+    DHPrivateKey privateKey = new DHPrivateKeyShim(x, spec);
+    DHPublicKey publicKey = new DHPublicKeyShim(Dh2048FixedBase.pow(x), spec);
+    return new KeyPair(publicKey, privateKey);
   }
 
   /**
@@ -429,44 +424,128 @@ public class PublicKeyProtoUtil {
   }
 
   /**
-   * @throws InvalidKeySpecException if point ({@code x},{@code y}) isn't on the NIST P-256 curve
-   */
-  private static void validateEcP256CurvePoint(BigInteger x, BigInteger y)
-      throws InvalidKeySpecException {
-    if ((x.signum() == -1) || (y.signum() == -1)) {
-      throw new InvalidKeySpecException("Point encoding must use only non-negative integers");
-    }
-
-    BigInteger p = EC_P256_P;
-    if ((x.compareTo(p) >= 0) || (y.compareTo(p) >= 0)) {
-      throw new InvalidKeySpecException("Point lies outside of the expected field");
-    }
-
-    // Points on the curve satisfy y^2 = x^3 + ax + b  (mod p)
-    BigInteger lhs = squareMod(y, p);
-    BigInteger rhs = squareMod(x, p).add(EC_P256_A) // = (x^2 + a)
-        .multiply(x).mod(p) // = x(x^2 + a) = x^3 + ax
-        .add(EC_P256_B) // = x^3 + ax + b
-        .mod(p);
-    if (!lhs.equals(rhs)) {
-      throw new InvalidKeySpecException("Point does not lie on the expected curve");
+   * Parses and validates {@link EcP256PublicKey} protos, reusing one {@link KeyFactory} and one set
+   * of field arithmetic buffers for every key it sees. Coordinates are decoded straight from the
+   * proto's {@link ByteString}s into those buffers, without copying them into new arrays first.
+   * Not thread safe.
+   */
+  static final class EcKeyParser {
+    private final byte[] encoding = new byte[MAX_P256_ENCODING_BYTES];
+    private final int[] x = new int[EcP256Field.LIMBS];
+    private final int[] y = new int[EcP256Field.LIMBS];
+    private final int[] lhs = new int[EcP256Field.LIMBS];
+    private final int[] rhs = new int[EcP256Field.LIMBS];
+    private final long[] wide = new long[2 * EcP256Field.LIMBS];
+    @Nullable private KeyFactory keyFactory;
+
+    /**
+     * @see PublicKeyProtoUtil#parseEcPublicKey(EcP256PublicKey)
+     */
+    ECPublicKey parse(EcP256PublicKey p256pk) throws InvalidKeySpecException {
+      if (!p256pk.hasX() || (!p256pk.hasY() && !p256pk.hasYIsOdd())) {
+        throw new InvalidKeySpecException("Key is missing a required coordinate");
+      }
+      if (p256pk.hasY() && p256pk.hasYIsOdd()) {
+        throw new InvalidKeySpecException("Key must not be both compressed and uncompressed");
+      }
+      if (isLegacyCryptoRequired()) {
+        throw new InvalidKeySpecException("Elliptic Curve keys not supported on this platform");
+      }
+      ByteString encodedX = p256pk.getX();
+      validateEcP256CoordinateEncoding(encodedX);
+      if (p256pk.hasY()) {
+        ByteString encodedY = p256pk.getY();
+        validateEcP256CoordinateEncoding(encodedY);
+        validateEcP256CurvePoint(encodedX, encodedY);
+      } else {
+        decompressEcP256CurvePoint(encodedX, p256pk.getYIsOdd());
+      }
+      try {
+        if (keyFactory == null) {
+          keyFactory = CryptoOps.getBackend().getKeyFactory(EC_ALG);
+        }
+      } catch (NoSuchAlgorithmException e) {
+        throw new RuntimeException(e);
+      }
+      ECPoint w = new ECPoint(
+          new BigInteger(1, EcP256Field.toByteArray(x)),
+          new BigInteger(1, EcP256Field.toByteArray(y)));
+      return (ECPublicKey) keyFactory.generatePublic(
+          new ECPublicKeySpec(w, EcP256ParamsHolder.EC_P256_PARAMS));
+    }
+
+    /**
+     * Decodes the point with 2's complement encoded coordinates ({@code encodedX},{@code
+     * encodedY}) into {@code x} and {@code y}.
+     *
+     * @throws InvalidKeySpecException if the point isn't on the NIST P-256 curve
+     */
+    private void validateEcP256CurvePoint(ByteString encodedX, ByteString encodedY)
+        throws InvalidKeySpecException {
+      if ((encodedX.byteAt(0) < 0) || (encodedY.byteAt(0) < 0)) {
+        throw new InvalidKeySpecException("Point encoding must use only non-negative integers");
+      }
+
+      if (!decode(encodedX, x) || !decode(encodedY, y)) {
+        throw new InvalidKeySpecException("Point lies outside of the expected field");
+      }
+
+      // Points on the curve satisfy y^2 = x^3 + ax + b  (mod p)
+      if (!EcP256Field.isOnCurve(x, y, lhs, rhs, wide)) {
+        throw new InvalidKeySpecException("Point does not lie on the expected curve");
+      }
+    }
+
+    /**
+     * Decodes {@code encodedX} into {@code x}, and recovers the matching y coordinate with the
+     * given parity into {@code y}, taking time independent of the values involved.
+     *
+     * @throws InvalidKeySpecException if there is no point with x coordinate {@code encodedX} on
+     *   the NIST P-256 curve
+     */
+    private void decompressEcP256CurvePoint(ByteString encodedX, boolean yIsOdd)
+        throws InvalidKeySpecException {
+      if (encodedX.byteAt(0) < 0) {
+        throw new InvalidKeySpecException("Point encoding must use only non-negative integers");
+      }
+
+      if (!decode(encodedX, x)) {
+        throw new InvalidKeySpecException("Point lies outside of the expected field");
+      }
+
+      // Points on the curve satisfy y^2 = x^3 + ax + b  (mod p), so y is a square root of the
+      // right hand side, if it has one
+      EcP256Field.curveEquation(x, rhs, wide);
+      EcP256Field.sqrt(rhs, y, wide);
+      EcP256Field.mul(y, y, lhs, wide);
+      if (!EcP256Field.equal(lhs, rhs)) {
+        throw new InvalidKeySpecException("Point does not lie on the expected curve");
+      }
+
+      // Pick whichever of y and -y has the requested parity
+      EcP256Field.neg(y, lhs, wide);
+      EcP256Field.select(y, lhs, (y[0] ^ (yIsOdd ? 1 : 0)) & 1, y);
+    }
+
+    /**
+     * Decodes {@code encoded}, which must already have passed {@link
+     * #validateEcP256CoordinateEncoding(ByteString)}, into {@code out} by way of the reused
+     * {@code encoding} buffer.
+     */
+    private boolean decode(ByteString encoded, int[] out) {
+      encoded.copyTo(encoding, 0);
+      return EcP256Field.decode(encoding, encoded.size(), out);
     }
   }
 
-  /**
-   * @return value of {@code x}^2 (mod {@code p})
-   */
-  private static BigInteger squareMod(BigInteger x, BigInteger p) {
-    return x.multiply(x).mod(p);
-  }
-
   /**
    * @throws InvalidKeySpecException if the coordinate is too large for a 256-bit curve
    */
-  private static void validateEcP256CoordinateEncoding(byte[] p) throws InvalidKeySpecException {
-    if ((p.length == 0)
-        || (p.length > MAX_P256_ENCODING_BYTES)
-        || (p.length == MAX_P256_ENCODING_BYTES && p[0] != 0)) {
+  private static void validateEcP256CoordinateEncoding(ByteString p)
+      throws InvalidKeySpecException {
+    if ((p.size() == 0)
+        || (p.size() > MAX_P256_ENCODING_BYTES)
+        || (p.size() == MAX_P256_ENCODING_BYTES && p.byteAt(0) != 0)) {
       throw new InvalidKeySpecException();  // Intentionally vague for security reasons
     }
   }
@@ -542,8 +621,11 @@ public class PublicKeyProtoUtil {
    */
   private static KeyPairGenerator getEcKeyGen() {
     KeyPairGenerator keygen;
+    Provider provider = CryptoOps.getEcProvider();
     try {
-      keygen = KeyPairGenerator.getInstance(EC_ALG);
+      keygen = (provider == null)
+          ? CryptoOps.getBackend().getKeyPairGenerator(EC_ALG)
+          : KeyPairGenerator.getInstance(EC_ALG, provider);
     } catch (NoSuchAlgorithmException e) {
       throw new RuntimeException(e);
     }
@@ -567,7 +649,7 @@ public class PublicKeyProtoUtil {
    */
   private static KeyPairGenerator getRsaKeyGen() {
     try {
-      KeyPairGenerator keygen = KeyPairGenerator.getInstance(RSA_ALG);
+      KeyPairGenerator keygen = CryptoOps.getBackend().getKeyPairGenerator(RSA_ALG);
       keygen.initialize(RSA2048_MODULUS_BITS);
       return keygen;
     } catch (NoSuchAlgorithmException e) {
@@ -575,22 +657,6 @@ public class PublicKeyProtoUtil {
     }
   }
 
-  /**
-   * @return a DH {@link KeyPairGenerator} object initialized for the group described by {@link
-   *     #DH_G}.
-   * @throws InvalidAlgorithmParameterException on some platforms that don't support large DH groups
-   */
-  @SuppressInsecureCipherModeCheckerPendingReview // b/32143855
-  private static KeyPairGenerator getDhKeyGen() throws InvalidAlgorithmParameterException {
-    try {
-      KeyPairGenerator keygen = KeyPairGenerator.getInstance(DH_ALG);
-      keygen.initialize(new DHParameterSpec(DH_P, DH_G, DH_LEN));
-      return keygen;
-    } catch (NoSuchAlgorithmException e) {
-      throw new AssertionError(e);  // This should never happen
-    }
-  }
-
   /**
    * A lightweight shim class to enable the creation of {@link DHPublicKey} and {@link DHPrivateKey}
    * objects that accept arbitrary {@link DHParameterSpec}s -- unfortunately, many platforms do
@@ -654,11 +720,62 @@ public class PublicKeyProtoUtil {
     }
   }
 
+  /**
+   * Caches state about whether the current platform supports Elliptic Curve algorithms. Held in
+   * its own class so that it is only computed on first use.
+   */
+  private static final class LegacyCryptoHolder {
+    static final boolean IS_LEGACY_CRYPTO_REQUIRED = determineIfLegacyCryptoRequired();
+  }
+
+  /**
+   * Holds the {@link ECParameterSpec} for the NIST P-256 Elliptic Curve, which is looked up on
+   * first use.
+   */
+  private static final class EcP256ParamsHolder {
+    static final ECParameterSpec EC_P256_PARAMS =
+        isLegacyCryptoRequired() ? null : loadEcP256Params();
+  }
+
+  /**
+   * Performs the one-time platform probing and parameter lookups needed by this class, so that
+   * callers can pay for them ahead of the first key being parsed or generated (e.g., at server
+   * startup, off of the request path). Calling this is optional, and cheap after the first time.
+   */
+  public static void warmUp() {
+    if (isLegacyCryptoRequired()) {
+      return;
+    }
+    ECParameterSpec unused = EcP256ParamsHolder.EC_P256_PARAMS;
+    try {
+      CryptoOps.getBackend().getKeyFactory(EC_ALG);
+    } catch (NoSuchAlgorithmException e) {
+      throw new RuntimeException(e);
+    }
+  }
+
   /**
    * @return true if this platform does not support Elliptic Curve algorithms
    */
   public static boolean isLegacyCryptoRequired() {
-    return IS_LEGACY_CRYPTO_REQUIRED;
+    return LegacyCryptoHolder.IS_LEGACY_CRYPTO_REQUIRED;
+  }
+
+  /**
+   * @return the {@link ECParameterSpec} for NIST P-256, obtained by a named curve lookup when the
+   *   platform supports it, and otherwise taken from a freshly generated key
+   */
+  private static ECParameterSpec loadEcP256Params() {
+    for (String name : new String[] {EC_P256_OPENSSL_NAME, EC_P256_COMMON_NAME}) {
+      try {
+        AlgorithmParameters params = AlgorithmParameters.getInstance(EC_ALG);
+        params.init(new ECGenParameterSpec(name));
+        return params.getParameterSpec(ECParameterSpec.class);
+      } catch (GeneralSecurityException e) {
+        // Try the next name, or fall back to key generation below
+      }
+    }
+    return ((ECPublicKey) generateEcP256KeyPair().getPublic()).getParams();
   }
 
   /**
@@ -15,6 +15,7 @@
 package com.google.security.cryptauth.lib.securemessage;
 
 import com.google.protobuf.ByteString;
+import com.google.protobuf.UnsafeByteOperations;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.Header;
@@ -246,7 +247,7 @@ public class SecureMessageBuilder {
       result.setAssociatedDataLength(associatedData.length);
     }
     if (iv != null) {
-      result.setIv(ByteString.copyFrom(iv));
+      result.setIv(UnsafeByteOperations.unsafeWrap(iv));
     }
     return result.build();
   }
@@ -257,9 +258,10 @@ public class SecureMessageBuilder {
    * @return a serialized representation of a {@link SecureMessageProto.HeaderAndBody}
    */
   private byte[] serializeHeaderAndBody(byte[] header, byte[] body) {
+    // The wrapped arrays are only read while serializing, so they needn't be copied first
     return HeaderAndBodyInternal.newBuilder()
-        .setHeader(ByteString.copyFrom(header))
-        .setBody(ByteString.copyFrom(body))
+        .setHeader(UnsafeByteOperations.unsafeWrap(header))
+        .setBody(UnsafeByteOperations.unsafeWrap(body))
         .build()
         .toByteArray();
   }
@@ -269,9 +271,10 @@ public class SecureMessageBuilder {
       throws NoSuchAlgorithmException, InvalidKeyException {
     byte[] sig =
         CryptoOps.sign(sigType, signingKey, rng, CryptoOps.concat(headerAndBody, associatedData));
+    // Both arrays were created for this message alone, so they can be wrapped rather than copied
     return SecureMessage.newBuilder()
-        .setHeaderAndBody(ByteString.copyFrom(headerAndBody))
-        .setSignature(ByteString.copyFrom(sig))
+        .setHeaderAndBody(UnsafeByteOperations.unsafeWrap(headerAndBody))
+        .setSignature(UnsafeByteOperations.unsafeWrap(sig))
         .build();
   }
 }
@@ -15,7 +15,9 @@
 package com.google.security.cryptauth.lib.securemessage;
 
 import com.google.protobuf.ByteString;
+import com.google.protobuf.CodedInputStream;
 import com.google.protobuf.InvalidProtocolBufferException;
+import com.google.protobuf.UnsafeByteOperations;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
 import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.Header;
@@ -51,13 +53,23 @@ public class SecureMessageParser {
    */
   public static Header getUnverifiedHeader(SecureMessage secmsg)
       throws InvalidProtocolBufferException {
+    return getUnverifiedHeaderAndBody(secmsg).getHeader();
+  }
+
+  /**
+   * Like {@link #getUnverifiedHeader(SecureMessage)}, but returns the whole {@link HeaderAndBody},
+   * so that it can be reused when the message is verified.
+   */
+  private static HeaderAndBody getUnverifiedHeaderAndBody(SecureMessage secmsg)
+      throws InvalidProtocolBufferException {
     if (!secmsg.hasHeaderAndBody()) {
       throw new InvalidProtocolBufferException("Missing header and body");
     }
-    if (!HeaderAndBody.parseFrom(secmsg.getHeaderAndBody()).hasHeader()) {
+    HeaderAndBody headerAndBody = HeaderAndBody.parseFrom(aliasingInput(secmsg.getHeaderAndBody()));
+    if (!headerAndBody.hasHeader()) {
       throw new InvalidProtocolBufferException("Missing header");
     }
-    Header result = HeaderAndBody.parseFrom(secmsg.getHeaderAndBody()).getHeader();
+    Header result = headerAndBody.getHeader();
     // Check that at least a signature scheme was set
     if (!result.hasSignatureScheme()) {
       throw new InvalidProtocolBufferException("Missing header field(s)");
@@ -76,7 +88,38 @@ public class SecureMessageParser {
         throw new InvalidProtocolBufferException("Corrupt/unsupported EncryptionScheme");
       }
     }
-    return result;
+    return headerAndBody;
+  }
+
+  /**
+   * Chooses the key for a signcrypted message from its unverified {@link Header}.
+   *
+   * @see SecureMessageParser#parseSignCryptedMessage(SecureMessage, KeyResolver, SigType, EncType)
+   */
+  public interface KeyResolver {
+
+    /**
+     * @param unverifiedHeader the message's header, which must only be used to choose the key,
+     *   since it is not verified yet
+     * @return the key that both signed and encrypted the message, or null if there is none
+     */
+    @Nullable
+    Key resolveKey(Header unverifiedHeader);
+  }
+
+  /**
+   * Parses a {@link SecureMessage} nested inside the payload body of another one, such as the body
+   * of a {@link HeaderAndBody} returned by {@link #parseSignCryptedMessage}. The fields of the
+   * result share memory with {@code body} rather than being copied out of it.
+   *
+   * <p>Like {@link SecureMessage#parseFrom(ByteString)}, this does not verify anything.
+   */
+  public static SecureMessage parseNestedMessage(ByteString body)
+      throws InvalidProtocolBufferException {
+    if (body == null) {
+      throw new NullPointerException();
+    }
+    return SecureMessage.parseFrom(aliasingInput(body));
   }
 
   /**
@@ -108,6 +151,7 @@ public class SecureMessageParser {
     }
     return verifyHeaderAndBody(
         secmsg,
+        null,
         verificationKey,
         sigType,
         EncType.NONE,
@@ -157,6 +201,53 @@ public class SecureMessageParser {
         || (encType == null)) {
       throw new NullPointerException();
     }
+    return parseSignCryptedMessage(
+        secmsg, null, verificationKey, sigType, decryptionKey, encType, associatedData);
+  }
+
+  /**
+   * Parses a {@link SecureMessage} containing an encrypted payload body that was signed and
+   * encrypted with the same key, choosing that key with {@code keyResolver}. The {@link
+   * HeaderAndBody} parsed to choose the key is the one that gets verified, so it is only parsed
+   * once.
+   *
+   * @return the parsed {@link HeaderAndBody} pair (which is fully verified and decrypted)
+   * @throws SignatureException if {@code keyResolver} has no key for the message, or if signature
+   *   verification fails
+   * @see SecureMessageBuilder#buildSignCryptedMessage(Key, SigType, Key, EncType, byte[])
+   */
+  public static HeaderAndBody parseSignCryptedMessage(
+      SecureMessage secmsg, KeyResolver keyResolver, SigType sigType, EncType encType)
+          throws InvalidKeyException, NoSuchAlgorithmException, SignatureException {
+    if ((secmsg == null) || (keyResolver == null) || (sigType == null) || (encType == null)) {
+      throw new NullPointerException();
+    }
+    HeaderAndBody unverified;
+    try {
+      unverified = getUnverifiedHeaderAndBody(secmsg);
+    } catch (InvalidProtocolBufferException e) {
+      throw new SignatureException(e);
+    }
+    Key key = keyResolver.resolveKey(unverified.getHeader());
+    if (key == null) {
+      throw new SignatureException("No key for the message");
+    }
+    return parseSignCryptedMessage(secmsg, unverified, key, sigType, key, encType, null);
+  }
+
+  /**
+   * @param unverified the result of {@link #getUnverifiedHeaderAndBody(SecureMessage)} for {@code
+   *   secmsg}, or null to parse it here
+   */
+  private static HeaderAndBody parseSignCryptedMessage(
+      SecureMessage secmsg,
+      @Nullable HeaderAndBody unverified,
+      Key verificationKey,
+      SigType sigType,
+      Key decryptionKey,
+      EncType encType,
+      @Nullable byte[] associatedData)
+          throws InvalidKeyException, NoSuchAlgorithmException, SignatureException {
     if (encType == EncType.NONE) {
       throw new SignatureException("Not a signcrypted message");
     }
@@ -166,6 +257,7 @@ public class SecureMessageParser {
     HeaderAndBody headerAndEncryptedBody;
     headerAndEncryptedBody = verifyHeaderAndBody(
         secmsg,
+        unverified,
         verificationKey,
         sigType,
         encType,
@@ -192,7 +284,8 @@ public class SecureMessageParser {
     if (!tagRequired) {
       // No tag expected, so we're all done
       return HeaderAndBody.newBuilder(headerAndEncryptedBody)
-          .setBody(ByteString.copyFrom(rawDecryptedBody))
+          // rawDecryptedBody isn't used anywhere else, so it can be wrapped rather than copied
+          .setBody(UnsafeByteOperations.unsafeWrap(rawDecryptedBody))
           .build();
     }
 
@@ -200,7 +293,9 @@ public class SecureMessageParser {
     byte[] headerBytes;
     try {
       headerBytes =
-          HeaderAndBodyInternal.parseFrom(secmsg.getHeaderAndBody()).getHeader().toByteArray();
+          HeaderAndBodyInternal.parseFrom(aliasingInput(secmsg.getHeaderAndBody()))
+              .getHeader()
+              .toByteArray();
     } catch (InvalidProtocolBufferException e) {
       // This shouldn't happen, but throw it up just in case
       throw new SignatureException(e);
@@ -219,13 +314,20 @@ public class SecureMessageParser {
 
     int bodyLen = rawDecryptedBody.length - CryptoOps.DIGEST_LENGTH;
     return HeaderAndBody.newBuilder(headerAndEncryptedBody)
-        // Remove the tag and set the plaintext body
-        .setBody(ByteString.copyFrom(rawDecryptedBody, CryptoOps.DIGEST_LENGTH, bodyLen))
+        // Remove the tag and set the plaintext body (again wrapping, rather than copying, it)
+        .setBody(
+            UnsafeByteOperations.unsafeWrap(rawDecryptedBody, CryptoOps.DIGEST_LENGTH, bodyLen))
         .build();
   }
 
+  /**
+   * @param unverified the result of {@link #getUnverifiedHeaderAndBody(SecureMessage)} for {@code
+   *   secmsg}, or null to parse it here. Either way, the signature is checked against the raw
+   *   bytes of {@code secmsg}.
+   */
   private static HeaderAndBody verifyHeaderAndBody(
       SecureMessage secmsg,
+      @Nullable HeaderAndBody unverified,
       Key verificationKey,
       SigType sigType,
       EncType encType,
@@ -243,7 +345,9 @@ public class SecureMessageParser {
     boolean verified = CryptoOps.verify(verificationKey, sigType, signature, signedData);
     HeaderAndBody result = null;
     try {
-      result = HeaderAndBody.parseFrom(secmsg.getHeaderAndBody());
+      result = (unverified != null)
+          ? unverified
+          : HeaderAndBody.parseFrom(aliasingInput(secmsg.getHeaderAndBody()));
       // Even if declared required, micro proto doesn't throw an exception if fields are not present
       if (!result.hasHeader() || !result.hasBody()) {
         throw new SignatureException("Signature failed verification");
@@ -267,4 +371,14 @@ public class SecureMessageParser {
     }
     throw new SignatureException("Signature failed verification");
   }
+
+  /**
+   * @return a {@link CodedInputStream} over {@code bytes} whose {@code bytes} fields are views of
+   *   {@code bytes}, rather than copies (which is safe, since a {@link ByteString} is immutable)
+   */
+  private static CodedInputStream aliasingInput(ByteString bytes) {
+    CodedInputStream input = bytes.newCodedInput();
+    input.enableAliasing(true);
+    return input;
+  }
 }
@@ -0,0 +1,217 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.security.cryptauth.lib.securegcm.Ukey2Handshake.HandshakeCipher;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Random;
+import java.util.concurrent.TimeUnit;
+import org.HdrHistogram.Histogram;
+
+/**
+ * Measures how D2D messaging through {@link D2DConnectionContextV1} scales across threads.
+ *
+ * <p>Sets up {@code --sessions} session pairs with {@link Ukey2Handshake}, and splits them between
+ * {@code --threads} threads. Each thread repeatedly picks one of its sessions, encodes a message
+ * with one side and decodes it with the other, and records how long that took. Message sizes are
+ * drawn from {@code --sizes}, a list of {@code size:weight} pairs. After {@code --warmup} seconds,
+ * measurements are taken for {@code --duration} seconds, and reported as JSON (also written to
+ * {@code --output}, if given).
+ *
+ * <pre>
+ * gradle harness -Pharness=D2DSessionBenchmark -Pharness.args='--threads=8 --sizes=100:9,10000:1'
+ * </pre>
+ */
+public final class D2DSessionBenchmark {
+
+  private static final String DEFAULT_SIZES = "64:50,1024:40,16384:9,262144:1";
+
+  private static final int WARMUP = 0;
+  private static final int MEASURE = 1;
+  private static final int STOP = 2;
+
+  private static volatile int phase = WARMUP;
+
+  private D2DSessionBenchmark() {}
+
+  public static void main(String[] args) throws Exception {
+    HarnessOptions options = new HarnessOptions(args);
+    int threads = options.getInt("threads", Runtime.getRuntime().availableProcessors());
+    int sessions = options.getInt("sessions", 16 * threads);
+    String sizes = options.getString("sizes", DEFAULT_SIZES);
+    double warmupSeconds = options.getDouble("warmup", 5);
+    double durationSeconds = options.getDouble("duration", 10);
+    if ((threads < 1) || (sessions < threads)) {
+      throw new IllegalArgumentException("Need at least one session per thread");
+    }
+    SizeDistribution sizeDistribution = new SizeDistribution(sizes);
+
+    List<List<D2DConnectionContext[]>> sessionsByThread = new ArrayList<>();
+    for (int i = 0; i < threads; i++) {
+      sessionsByThread.add(new ArrayList<D2DConnectionContext[]>());
+    }
+    for (int i = 0; i < sessions; i++) {
+      sessionsByThread.get(i % threads).add(handshake());
+    }
+
+    Worker[] workers = new Worker[threads];
+    Thread[] workerThreads = new Thread[threads];
+    for (int i = 0; i < threads; i++) {
+      workers[i] = new Worker(sessionsByThread.get(i), sizeDistribution, new Random(i));
+      workerThreads[i] = new Thread(workers[i], "d2d-benchmark-" + i);
+      workerThreads[i].start();
+    }
+    sleep(warmupSeconds);
+    long start = System.nanoTime();
+    phase = MEASURE;
+    sleep(durationSeconds);
+    phase = STOP;
+    long elapsedNanos = System.nanoTime() - start;
+
+    Histogram latency = JsonReport.newLatencyHistogram();
+    long messages = 0;
+    long bytes = 0;
+    for (int i = 0; i < threads; i++) {
+      workerThreads[i].join();
+      if (workers[i].failure != null) {
+        throw new IllegalStateException("Worker failed", workers[i].failure);
+      }
+      latency.add(workers[i].latency);
+      messages += workers[i].messages;
+      bytes += workers[i].bytes;
+    }
+
+    double seconds = elapsedNanos / 1e9;
+    new JsonReport("D2DSessionBenchmark")
+        .put("sessions", sessions)
+        .put("threads", threads)
+        .put("sizes", sizes)
+        .put("warmupSeconds", warmupSeconds)
+        .put("durationSeconds", seconds)
+        .put("messages", messages)
+        .put("messagesPerSecond", messages / seconds)
+        .put("megabytesPerSecond", bytes / seconds / (1 << 20))
+        .putLatency("latency", latency)
+        .write(options.getString("output", null));
+  }
+
+  /**
+   * @return a connected pair of contexts, the initiator's first
+   */
+  static D2DConnectionContext[] handshake() throws Exception {
+    Ukey2Handshake initiator = Ukey2Handshake.forInitiator(HandshakeCipher.P256_SHA512);
+    Ukey2Handshake responder = Ukey2Handshake.forResponder(HandshakeCipher.P256_SHA512);
+    responder.parseHandshakeMessage(initiator.getNextHandshakeMessage());
+    initiator.parseHandshakeMessage(responder.getNextHandshakeMessage());
+    responder.parseHandshakeMessage(initiator.getNextHandshakeMessage());
+    initiator.getVerificationString(32);
+    responder.getVerificationString(32);
+    initiator.verifyHandshake();
+    responder.verifyHandshake();
+    return new D2DConnectionContext[] {
+      initiator.toConnectionContext(), responder.toConnectionContext()
+    };
+  }
+
+  private static void sleep(double seconds) throws InterruptedException {
+    TimeUnit.MILLISECONDS.sleep((long) (seconds * 1000));
+  }
+
+  /**
+   * Message sizes, drawn with the given relative weights.
+   */
+  static final class SizeDistribution {
+    private final int[] sizes;
+    private final int[] cumulativeWeights;
+    private final byte[][] payloads;
+
+    /**
+     * @param spec comma separated {@code size:weight} pairs
+     */
+    SizeDistribution(String spec) {
+      String[] entries = spec.split(",");
+      sizes = new int[entries.length];
+      cumulativeWeights = new int[entries.length];
+      payloads = new byte[entries.length][];
+      Random random = new Random(0);
+      int total = 0;
+      for (int i = 0; i < entries.length; i++) {
+        String[] sizeAndWeight = entries[i].trim().split(":");
+        if (sizeAndWeight.length != 2) {
+          throw new IllegalArgumentException("Expected size:weight, but got: " + entries[i]);
+        }
+        sizes[i] = Integer.parseInt(sizeAndWeight[0]);
+        int weight = Integer.parseInt(sizeAndWeight[1]);
+        if ((sizes[i] < 0) || (weight <= 0)) {
+          throw new IllegalArgumentException("Invalid size or weight: " + entries[i]);
+        }
+        total += weight;
+        cumulativeWeights[i] = total;
+        payloads[i] = new byte[sizes[i]];
+        random.nextBytes(payloads[i]);
+      }
+    }
+
+    /**
+     * @return a payload of a randomly chosen size. Payloads are shared, and must not be modified.
+     */
+    byte[] next(Random random) {
+      int choice = random.nextInt(cumulativeWeights[cumulativeWeights.length - 1]);
+      int i = 0;
+      while (cumulativeWeights[i] <= choice) {
+        i++;
+      }
+      return payloads[i];
+    }
+  }
+
+  private static final class Worker implements Runnable {
+    private final List<D2DConnectionContext[]> sessions;
+    private final SizeDistribution sizes;
+    private final Random random;
+    final Histogram latency = JsonReport.newLatencyHistogram();
+    long messages = 0;
+    long bytes = 0;
+    Exception failure = null;
+
+    Worker(List<D2DConnectionContext[]> sessions, SizeDistribution sizes, Random random) {
+      this.sessions = sessions;
+      this.sizes = sizes;
+      this.random = random;
+    }
+
+    @Override
+    public void run() {
+      try {
+        int current;
+        while ((current = phase) != STOP) {
+          D2DConnectionContext[] session = sessions.get(random.nextInt(sessions.size()));
+          byte[] payload = sizes.next(random);
+          long start = System.nanoTime();
+          session[0].decodeMessageFromPeer(session[1].encodeMessageToPeer(payload));
+          long nanos = System.nanoTime() - start;
+          if (current == MEASURE) {
+            latency.recordValue(Math.min(nanos, JsonReport.MAX_RECORDED_NANOS));
+            messages++;
+            bytes += payload.length;
+          }
+        }
+      } catch (Exception e) {
+        failure = e;
+      }
+    }
+  }
+}
@@ -0,0 +1,366 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmDeviceInfo;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
+import java.security.KeyPair;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Random;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ThreadPoolExecutor;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.locks.LockSupport;
+import javax.crypto.SecretKey;
+import org.HdrHistogram.ConcurrentHistogram;
+import org.HdrHistogram.Histogram;
+
+/**
+ * Simulates a fleet of devices talking to one server, in a single process, to find bottlenecks
+ * under a realistic mix of operations.
+ *
+ * <p>{@code --devices} virtual devices are first enrolled and given a D2D session with the server.
+ * Operations then arrive at random (a Poisson process) at {@code --rate} per second, each for a
+ * random device, and are run on a pool of {@code --threads} threads. The kind of each operation is
+ * drawn from {@code --mix}, a list of {@code name:weight} pairs over:
+ *
+ * <ul>
+ *   <li>{@code enroll}: re-enrollment with {@link EnrollmentCryptoOps}
+ *   <li>{@code handshake}: a new {@link Ukey2Handshake} with the server
+ *   <li>{@code message}: a D2D message to the server, and its reply
+ *   <li>{@code session}: the server saves the device's session, and restores it
+ *   <li>{@code serverMessage}: a {@link TransportCryptoOps} message from the server
+ *   <li>{@code clientMessage}: a {@link TransportCryptoOps} message to the server
+ * </ul>
+ *
+ * <p>Arrivals don't wait for earlier operations to finish, so an overloaded server shows up as a
+ * growing latency rather than a lower arrival rate. For every kind of operation, the JSON report
+ * (also written to {@code --output}, if given) has the throughput, the latency from arrival to
+ * completion, and the service time spent actually running it.
+ *
+ * <pre>
+ * gradle harness -Pharness=FleetLoadGenerator -Pharness.args='--devices=5000 --rate=4000'
+ * </pre>
+ */
+public final class FleetLoadGenerator {
+
+  private static final String DEFAULT_MIX =
+      "enroll:1,handshake:4,message:70,session:5,serverMessage:12,clientMessage:8";
+
+  private static final String[] OPERATIONS = {
+    "enroll", "handshake", "message", "session", "serverMessage", "clientMessage"
+  };
+
+  private static final String DEVICE_MODEL = "FleetLoadGenerator";
+
+  private final InMemoryMasterKeyStore masterKeyStore = new InMemoryMasterKeyStore();
+  private final byte[] payload;
+
+  private FleetLoadGenerator(int payloadSize) {
+    payload = new byte[payloadSize];
+    new Random(0).nextBytes(payload);
+  }
+
+  public static void main(String[] args) throws Exception {
+    HarnessOptions options = new HarnessOptions(args);
+    int devices = options.getInt("devices", 1000);
+    int threads = options.getInt("threads", Runtime.getRuntime().availableProcessors());
+    double rate = options.getDouble("rate", 1000);
+    String mix = options.getString("mix", DEFAULT_MIX);
+    int payloadSize = options.getInt("payloadSize", 256);
+    double warmupSeconds = options.getDouble("warmup", 5);
+    double durationSeconds = options.getDouble("duration", 30);
+    if ((devices < 1) || (threads < 1) || (rate <= 0)) {
+      throw new IllegalArgumentException("Need at least one device and thread, and a rate");
+    }
+    int[] cumulativeWeights = parseMix(mix);
+
+    FleetLoadGenerator generator = new FleetLoadGenerator(payloadSize);
+    ThreadPoolExecutor executor = (ThreadPoolExecutor) Executors.newFixedThreadPool(threads);
+    Device[] fleet = generator.setUpFleet(devices, executor);
+
+    OperationStats[] stats = new OperationStats[OPERATIONS.length];
+    OperationStats[] warmupStats = new OperationStats[OPERATIONS.length];
+    for (int i = 0; i < stats.length; i++) {
+      stats[i] = new OperationStats();
+      warmupStats[i] = new OperationStats();
+    }
+    Random random = new Random(1);
+    long start = System.nanoTime();
+    long measureStart = start + (long) (warmupSeconds * 1e9);
+    long end = measureStart + (long) (durationSeconds * 1e9);
+    long arrival = start;
+    long offered = 0;
+    int maxBacklog = 0;
+    while (true) {
+      // Exponentially distributed gaps between arrivals
+      arrival += (long) (-Math.log(1 - random.nextDouble()) / rate * 1e9);
+      if (arrival >= end) {
+        break;
+      }
+      long delay = arrival - System.nanoTime();
+      if (delay > 0) {
+        LockSupport.parkNanos(delay);
+      }
+      boolean measured = arrival >= measureStart;
+      if (measured) {
+        offered++;
+        maxBacklog = Math.max(maxBacklog, executor.getQueue().size());
+      }
+      int operation = pick(cumulativeWeights, random);
+      executor.execute(generator.new Task(
+          operation,
+          fleet[random.nextInt(devices)],
+          arrival,
+          measured ? stats[operation] : warmupStats[operation]));
+    }
+    executor.shutdown();
+    executor.awaitTermination(1, TimeUnit.HOURS);
+
+    JsonReport report = new JsonReport("FleetLoadGenerator")
+        .put("devices", devices)
+        .put("threads", threads)
+        .put("offeredRate", rate)
+        .put("mix", mix)
+        .put("payloadSize", payloadSize)
+        .put("durationSeconds", durationSeconds)
+        .put("offeredOperations", offered)
+        .put("maxBacklog", maxBacklog)
+        .beginObject("operations");
+    for (int i = 0; i < OPERATIONS.length; i++) {
+      report.beginObject(OPERATIONS[i])
+          .put("completed", stats[i].latency.getTotalCount())
+          .put("errors", stats[i].errors.get())
+          .put("warmupErrors", warmupStats[i].errors.get())
+          .put("operationsPerSecond", stats[i].latency.getTotalCount() / durationSeconds)
+          .putLatency("latency", stats[i].latency)
+          .putLatency("serviceTime", stats[i].serviceTime)
+          .endObject();
+    }
+    report.endObject().write(options.getString("output", null));
+  }
+
+  /**
+   * @return the running totals of the weights in {@code mix}, in the order of {@link #OPERATIONS}
+   */
+  private static int[] parseMix(String mix) {
+    int[] weights = new int[OPERATIONS.length];
+    for (String entry : mix.split(",")) {
+      String[] nameAndWeight = entry.trim().split(":");
+      int operation = Arrays.asList(OPERATIONS).indexOf(nameAndWeight[0]);
+      if ((nameAndWeight.length != 2) || (operation < 0)) {
+        throw new IllegalArgumentException("Expected operation:weight, but got: " + entry);
+      }
+      weights[operation] = Integer.parseInt(nameAndWeight[1]);
+      if (weights[operation] < 0) {
+        throw new IllegalArgumentException("Invalid weight: " + entry);
+      }
+    }
+    for (int i = 1; i < weights.length; i++) {
+      weights[i] += weights[i - 1];
+    }
+    if (weights[weights.length - 1] == 0) {
+      throw new IllegalArgumentException("No operations in the mix");
+    }
+    return weights;
+  }
+
+  private static int pick(int[] cumulativeWeights, Random random) {
+    int choice = random.nextInt(cumulativeWeights[cumulativeWeights.length - 1]);
+    int i = 0;
+    while (cumulativeWeights[i] <= choice) {
+      i++;
+    }
+    return i;
+  }
+
+  private Device[] setUpFleet(int devices, ExecutorService executor) throws Exception {
+    final Device[] fleet = new Device[devices];
+    List<Future<?>> setUps = new ArrayList<>();
+    for (int i = 0; i < devices; i++) {
+      final int index = i;
+      setUps.add(executor.submit(new Callable<Void>() {
+        @Override
+        public Void call() throws Exception {
+          Device device = new Device(index);
+          enroll(device);
+          handshake(device);
+          fleet[index] = device;
+          return null;
+        }
+      }));
+    }
+    for (Future<?> setUp : setUps) {
+      setUp.get();
+    }
+    return fleet;
+  }
+
+  /**
+   * A virtual device, along with the server's state for it. Operations on one device are run one
+   * at a time, as a real device (and its D2D sessions) would.
+   */
+  private static final class Device {
+    final byte[] keyHandle;
+    final KeyPair userKeyPair;
+    final long deviceId;
+    SecretKey masterKey;
+    ClientMessageVerifier serverVerifier;
+    D2DConnectionContext deviceContext;
+    D2DConnectionContext serverContext;
+
+    Device(int index) throws Exception {
+      deviceId = index;
+      userKeyPair = KeyEncoding.isLegacyCryptoRequired()
+          ? PublicKeyProtoUtil.generateRSA2048KeyPair()
+          : PublicKeyProtoUtil.generateEcP256KeyPair();
+      keyHandle = EnrollmentCryptoOps.sha256(
+          PublicKeyProtoUtil.encodePublicKey(userKeyPair.getPublic()).toByteArray());
+    }
+  }
+
+  /**
+   * The latency and service time histograms of one kind of operation.
+   */
+  private static final class OperationStats {
+    final Histogram latency = new ConcurrentHistogram(JsonReport.MAX_RECORDED_NANOS, 3);
+    final Histogram serviceTime = new ConcurrentHistogram(JsonReport.MAX_RECORDED_NANOS, 3);
+    final AtomicLong errors = new AtomicLong();
+  }
+
+  private final class Task implements Runnable {
+    private final int operation;
+    private final Device device;
+    private final long arrival;
+    private final OperationStats stats;
+
+    /**
+     * @param stats where to record the outcome; warm-up operations get their own, unreported
+     *     histograms so that their errors are still counted
+     */
+    Task(int operation, Device device, long arrival, OperationStats stats) {
+      this.operation = operation;
+      this.device = device;
+      this.arrival = arrival;
+      this.stats = stats;
+    }
+
+    @Override
+    public void run() {
+      long start = System.nanoTime();
+      try {
+        synchronized (device) {
+          runOperation(operation, device);
+        }
+      } catch (Exception e) {
+        if (stats.errors.getAndIncrement() == 0) {
+          e.printStackTrace();
+        }
+        return;
+      }
+      long now = System.nanoTime();
+      stats.latency.recordValue(Math.min(now - arrival, JsonReport.MAX_RECORDED_NANOS));
+      stats.serviceTime.recordValue(Math.min(now - start, JsonReport.MAX_RECORDED_NANOS));
+    }
+  }
+
+  private void runOperation(int operation, Device device) throws Exception {
+    switch (operation) {
+      case 0:
+        enroll(device);
+        break;
+      case 1:
+        handshake(device);
+        break;
+      case 2:
+        byte[] request = device.deviceContext.encodeMessageToPeer(payload);
+        device.serverContext.decodeMessageFromPeer(request);
+        byte[] response = device.serverContext.encodeMessageToPeer(payload);
+        device.deviceContext.decodeMessageFromPeer(response);
+        break;
+      case 3:
+        device.serverContext =
+            D2DConnectionContext.fromSavedSession(device.serverContext.saveSession());
+        break;
+      case 4:
+        byte[] serverMessage = TransportCryptoOps.signcryptServerMessage(
+            new Payload(PayloadType.DEVICE_TO_DEVICE_MESSAGE, payload),
+            masterKeyStore.getMasterKey(ByteString.copyFrom(device.keyHandle)),
+            device.keyHandle);
+        TransportCryptoOps.verifydecryptServerMessage(serverMessage, device.masterKey);
+        break;
+      case 5:
+        byte[] clientMessage = TransportCryptoOps.signcryptClientMessage(
+            new Payload(PayloadType.DEVICE_TO_DEVICE_MESSAGE, payload),
+            device.userKeyPair,
+            device.masterKey);
+        device.serverVerifier.verifydecrypt(clientMessage);
+        break;
+      default:
+        throw new IllegalArgumentException("Unknown operation: " + operation);
+    }
+  }
+
+  /**
+   * Runs both sides of an enrollment, and installs the new master key.
+   */
+  private void enroll(Device device) throws Exception {
+    boolean isLegacy = KeyEncoding.isLegacyCryptoRequired();
+    KeyPair serverKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    KeyPair deviceKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+
+    SecretKey deviceMasterKey = EnrollmentCryptoOps.doKeyAgreement(
+        deviceKeyPair.getPrivate(), serverKeyPair.getPublic());
+    GcmDeviceInfo deviceInfo = GcmDeviceInfo.newBuilder()
+        .setAndroidDeviceId(device.deviceId)
+        .setDeviceMasterKeyHash(
+            ByteString.copyFrom(EnrollmentCryptoOps.getMasterKeyHash(deviceMasterKey)))
+        .setUserPublicKey(ByteString.copyFrom(
+            KeyEncoding.encodeUserPublicKey(device.userKeyPair.getPublic())))
+        .setDeviceModel(DEVICE_MODEL)
+        .setKeyHandle(ByteString.copyFrom(device.keyHandle))
+        .build();
+    byte[] enrollmentMessage = EnrollmentCryptoOps.encryptEnrollmentMessage(
+        deviceInfo, deviceMasterKey, device.userKeyPair.getPrivate());
+
+    SecretKey serverMasterKey = EnrollmentCryptoOps.doKeyAgreement(
+        serverKeyPair.getPrivate(), deviceKeyPair.getPublic());
+    GcmDeviceInfo serverInfo =
+        EnrollmentCryptoOps.decryptEnrollmentMessage(enrollmentMessage, serverMasterKey, isLegacy);
+    masterKeyStore.put(serverInfo.getKeyHandle().toByteArray(), serverMasterKey);
+    device.serverVerifier = new ClientMessageVerifier(
+        KeyEncoding.parseUserPublicKey(serverInfo.getUserPublicKey().toByteArray()),
+        serverMasterKey);
+    device.masterKey = deviceMasterKey;
+  }
+
+  /**
+   * Runs both sides of a UKEY2 handshake, and replaces the D2D session.
+   */
+  private static void handshake(Device device) throws Exception {
+    D2DConnectionContext[] contexts = D2DSessionBenchmark.handshake();
+    device.deviceContext = contexts[0];
+    device.serverContext = contexts[1];
+  }
+}
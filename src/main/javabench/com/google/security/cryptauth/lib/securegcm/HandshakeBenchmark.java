@@ -0,0 +1,281 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.security.cryptauth.lib.securegcm.Ukey2Handshake.HandshakeCipher;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
+import com.google.security.cryptauth.lib.securemessage.EcP256Provider;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.TimeUnit;
+import org.HdrHistogram.Histogram;
+
+/**
+ * Measures complete in-memory handshakes per second, for {@link Ukey2Handshake} and {@link
+ * D2DDiffieHellmanKeyExchangeHandshake}, and how the time splits between the phases of each.
+ *
+ * <p>Every handshake starts from nothing (including key generation) and ends with both sides
+ * holding a {@link D2DConnectionContext}. Each protocol in {@code --protocols} ({@code ukey2},
+ * {@code d2d}) is run with each thread count in {@code --threads} for {@code --duration} seconds,
+ * after {@code --warmup} seconds. {@code --ecProvider=EcP256} routes the P-256 operations through
+ * {@link EcP256Provider} instead of the platform default. Results are reported as JSON (also
+ * written to {@code --output}, if given), together with the JVM they came from.
+ *
+ * <pre>
+ * gradle harness -Pharness=HandshakeBenchmark -Pharness.args='--threads=1,8 --ecProvider=EcP256'
+ * </pre>
+ */
+public final class HandshakeBenchmark {
+
+  private HandshakeBenchmark() {}
+
+  public static void main(String[] args) throws Exception {
+    HarnessOptions options = new HarnessOptions(args);
+    String protocols = options.getString("protocols", "ukey2,d2d");
+    String threadCounts =
+        options.getString("threads", "1," + Runtime.getRuntime().availableProcessors());
+    String ecProvider = options.getString("ecProvider", "default");
+    double warmupSeconds = options.getDouble("warmup", 5);
+    double durationSeconds = options.getDouble("duration", 10);
+    if (ecProvider.equals("EcP256")) {
+      CryptoOps.setEcProvider(new EcP256Provider());
+    } else if (!ecProvider.equals("default")) {
+      throw new IllegalArgumentException("Unknown EC provider: " + ecProvider);
+    }
+
+    JsonReport report = new JsonReport("HandshakeBenchmark")
+        .put("ecProvider", ecProvider)
+        .put("warmupSeconds", warmupSeconds)
+        .put("durationSeconds", durationSeconds)
+        .beginObject("results");
+    for (String protocolName : protocols.split(",")) {
+      Protocol protocol = Protocol.forName(protocolName.trim());
+      for (String threads : threadCounts.split(",")) {
+        run(protocol, Integer.parseInt(threads.trim()), warmupSeconds, durationSeconds, report);
+      }
+    }
+    report.endObject().write(options.getString("output", null));
+  }
+
+  private static void run(
+      Protocol protocol,
+      int threads,
+      double warmupSeconds,
+      double durationSeconds,
+      JsonReport report)
+      throws Exception {
+    Run run = new Run();
+    List<Worker> workers = new ArrayList<>();
+    List<Thread> workerThreads = new ArrayList<>();
+    for (int i = 0; i < threads; i++) {
+      Worker worker = new Worker(protocol, run);
+      Thread thread = new Thread(worker, "handshake-benchmark-" + i);
+      workers.add(worker);
+      workerThreads.add(thread);
+      thread.start();
+    }
+    TimeUnit.MILLISECONDS.sleep((long) (warmupSeconds * 1000));
+    long start = System.nanoTime();
+    run.phase = Run.MEASURE;
+    TimeUnit.MILLISECONDS.sleep((long) (durationSeconds * 1000));
+    run.phase = Run.STOP;
+    double seconds = (System.nanoTime() - start) / 1e9;
+
+    Histogram total = JsonReport.newLatencyHistogram();
+    Histogram[] phases = new Histogram[protocol.phases.length];
+    for (int i = 0; i < phases.length; i++) {
+      phases[i] = JsonReport.newLatencyHistogram();
+    }
+    for (int i = 0; i < threads; i++) {
+      workerThreads.get(i).join();
+      Worker worker = workers.get(i);
+      if (worker.failure != null) {
+        throw new IllegalStateException("Worker failed", worker.failure);
+      }
+      total.add(worker.total);
+      for (int j = 0; j < phases.length; j++) {
+        phases[j].add(worker.phases[j]);
+      }
+    }
+
+    long handshakes = total.getTotalCount();
+    report.beginObject(protocol.name + "-" + threads + "-threads")
+        .put("protocol", protocol.name)
+        .put("threads", threads)
+        .put("handshakes", handshakes)
+        .put("handshakesPerSecond", handshakes / seconds)
+        .put("handshakesPerSecondPerThread", handshakes / seconds / threads)
+        .putLatency("latency", total)
+        .beginObject("phases");
+    for (int i = 0; i < phases.length; i++) {
+      report.putLatency(protocol.phases[i], phases[i]);
+    }
+    report.endObject().endObject();
+  }
+
+  /**
+   * Shared state of one measurement run.
+   */
+  private static final class Run {
+    static final int WARMUP = 0;
+    static final int MEASURE = 1;
+    static final int STOP = 2;
+
+    volatile int phase = WARMUP;
+  }
+
+  /**
+   * Records the time since the previous mark against each phase of a handshake.
+   */
+  private static final class Laps {
+    final long[] nanos;
+    private long last;
+
+    Laps(int phases) {
+      nanos = new long[phases];
+    }
+
+    void start() {
+      last = System.nanoTime();
+    }
+
+    void mark(int phase) {
+      long now = System.nanoTime();
+      nanos[phase] = now - last;
+      last = now;
+    }
+  }
+
+  /**
+   * A handshake protocol, run in full by {@link #handshake(Laps)}.
+   */
+  private abstract static class Protocol {
+    final String name;
+    final String[] phases;
+
+    Protocol(String name, String... phases) {
+      this.name = name;
+      this.phases = phases;
+    }
+
+    abstract void handshake(Laps laps) throws Exception;
+
+    static Protocol forName(String name) {
+      if (name.equals("ukey2")) {
+        return new Protocol(
+            "ukey2",
+            "keyGeneration",
+            "clientInit",
+            "serverInit",
+            "clientFinished",
+            "serverFinished",
+            "verification",
+            "toConnectionContext") {
+          @Override
+          void handshake(Laps laps) throws Exception {
+            laps.start();
+            Ukey2Handshake initiator = Ukey2Handshake.forInitiator(HandshakeCipher.P256_SHA512);
+            Ukey2Handshake responder = Ukey2Handshake.forResponder(HandshakeCipher.P256_SHA512);
+            laps.mark(0);
+            byte[] clientInit = initiator.getNextHandshakeMessage();
+            laps.mark(1);
+            responder.parseHandshakeMessage(clientInit);
+            byte[] serverInit = responder.getNextHandshakeMessage();
+            laps.mark(2);
+            initiator.parseHandshakeMessage(serverInit);
+            byte[] clientFinished = initiator.getNextHandshakeMessage();
+            laps.mark(3);
+            responder.parseHandshakeMessage(clientFinished);
+            laps.mark(4);
+            initiator.getVerificationString(32);
+            responder.getVerificationString(32);
+            initiator.verifyHandshake();
+            responder.verifyHandshake();
+            laps.mark(5);
+            initiator.toConnectionContext();
+            responder.toConnectionContext();
+            laps.mark(6);
+          }
+        };
+      } else if (name.equals("d2d")) {
+        return new Protocol(
+            "d2d",
+            "keyGeneration",
+            "initiatorHello",
+            "responderHello",
+            "initiatorFinished",
+            "toConnectionContext") {
+          @Override
+          void handshake(Laps laps) throws Exception {
+            laps.start();
+            D2DHandshakeContext initiator = D2DDiffieHellmanKeyExchangeHandshake.forInitiator();
+            D2DHandshakeContext responder = D2DDiffieHellmanKeyExchangeHandshake.forResponder();
+            laps.mark(0);
+            byte[] initiatorHello = initiator.getNextHandshakeMessage();
+            laps.mark(1);
+            responder.parseHandshakeMessage(initiatorHello);
+            byte[] responderHello = responder.getNextHandshakeMessage();
+            laps.mark(2);
+            initiator.parseHandshakeMessage(responderHello);
+            laps.mark(3);
+            initiator.toConnectionContext();
+            responder.toConnectionContext();
+            laps.mark(4);
+          }
+        };
+      }
+      throw new IllegalArgumentException("Unknown protocol: " + name);
+    }
+  }
+
+  private static final class Worker implements Runnable {
+    private final Protocol protocol;
+    private final Run run;
+    private final Laps laps;
+    final Histogram total = JsonReport.newLatencyHistogram();
+    final Histogram[] phases;
+    Exception failure = null;
+
+    Worker(Protocol protocol, Run run) {
+      this.protocol = protocol;
+      this.run = run;
+      this.laps = new Laps(protocol.phases.length);
+      this.phases = new Histogram[protocol.phases.length];
+      for (int i = 0; i < phases.length; i++) {
+        phases[i] = JsonReport.newLatencyHistogram();
+      }
+    }
+
+    @Override
+    public void run() {
+      try {
+        int current;
+        while ((current = run.phase) != Run.STOP) {
+          protocol.handshake(laps);
+          if (current == Run.MEASURE) {
+            long sum = 0;
+            for (int i = 0; i < phases.length; i++) {
+              phases[i].recordValue(Math.min(laps.nanos[i], JsonReport.MAX_RECORDED_NANOS));
+              sum += laps.nanos[i];
+            }
+            total.recordValue(Math.min(sum, JsonReport.MAX_RECORDED_NANOS));
+          }
+        }
+      } catch (Exception e) {
+        failure = e;
+      }
+    }
+  }
+}
@@ -0,0 +1,51 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * Command line options of the benchmark harnesses, given as {@code --name=value}.
+ */
+final class HarnessOptions {
+
+  private final Map<String, String> values = new HashMap<>();
+
+  HarnessOptions(String[] args) {
+    for (String arg : args) {
+      int separator = arg.indexOf('=');
+      if (!arg.startsWith("--") || (separator < 0)) {
+        throw new IllegalArgumentException("Expected --name=value, but got: " + arg);
+      }
+      values.put(arg.substring(2, separator), arg.substring(separator + 1));
+    }
+  }
+
+  String getString(String name, String defaultValue) {
+    String value = values.get(name);
+    return (value != null) ? value : defaultValue;
+  }
+
+  int getInt(String name, int defaultValue) {
+    String value = values.get(name);
+    return (value != null) ? Integer.parseInt(value) : defaultValue;
+  }
+
+  double getDouble(String name, double defaultValue) {
+    String value = values.get(name);
+    return (value != null) ? Double.parseDouble(value) : defaultValue;
+  }
+}
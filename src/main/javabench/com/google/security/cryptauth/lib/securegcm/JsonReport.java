@@ -0,0 +1,157 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStreamWriter;
+import java.io.Writer;
+import java.util.Locale;
+import java.util.concurrent.TimeUnit;
+import javax.annotation.Nullable;
+import org.HdrHistogram.Histogram;
+
+/**
+ * Builds the JSON results of a benchmark harness, so that runs can be compared by tools. Values
+ * are written in the order they are added.
+ */
+final class JsonReport {
+
+  /**
+   * Histograms record nanoseconds, up to this many.
+   */
+  static final long MAX_RECORDED_NANOS = TimeUnit.MINUTES.toNanos(1);
+
+  private final StringBuilder json = new StringBuilder("{");
+  private boolean needsComma = false;
+  private int depth = 1;
+
+  /**
+   * Starts a report that records the JVM (and so the default providers) that the results came
+   * from.
+   */
+  JsonReport(String benchmark) {
+    put("benchmark", benchmark);
+    put("javaVersion", System.getProperty("java.version"));
+    put("javaVendor", System.getProperty("java.vendor"));
+    put("availableProcessors", Runtime.getRuntime().availableProcessors());
+  }
+
+  /**
+   * @return a histogram suitable for {@link #putLatency(String, Histogram)}
+   */
+  static Histogram newLatencyHistogram() {
+    return new Histogram(MAX_RECORDED_NANOS, 3);
+  }
+
+  JsonReport put(String name, String value) {
+    appendName(name);
+    appendString(value);
+    return this;
+  }
+
+  JsonReport put(String name, long value) {
+    appendName(name);
+    json.append(value);
+    return this;
+  }
+
+  JsonReport put(String name, double value) {
+    appendName(name);
+    json.append(String.format(Locale.ROOT, "%.3f", value));
+    return this;
+  }
+
+  JsonReport beginObject(String name) {
+    appendName(name);
+    json.append('{');
+    needsComma = false;
+    depth++;
+    return this;
+  }
+
+  JsonReport endObject() {
+    if (depth == 1) {
+      throw new IllegalStateException("No object to end");
+    }
+    json.append('}');
+    needsComma = true;
+    depth--;
+    return this;
+  }
+
+  /**
+   * Adds the count, mean and percentiles of a histogram of nanoseconds, in microseconds.
+   */
+  JsonReport putLatency(String name, Histogram nanos) {
+    return beginObject(name)
+        .put("count", nanos.getTotalCount())
+        .put("meanMicros", nanos.getMean() / 1000)
+        .put("p50Micros", nanos.getValueAtPercentile(50) / 1000.0)
+        .put("p99Micros", nanos.getValueAtPercentile(99) / 1000.0)
+        .put("p999Micros", nanos.getValueAtPercentile(99.9) / 1000.0)
+        .put("maxMicros", nanos.getMaxValue() / 1000.0)
+        .endObject();
+  }
+
+  /**
+   * Prints the report, and also writes it to {@code path} if it isn't null.
+   */
+  void write(@Nullable String path) throws IOException {
+    String report = toString();
+    System.out.println(report);
+    if (path != null) {
+      Writer writer = new OutputStreamWriter(new FileOutputStream(path), "UTF-8");
+      try {
+        writer.write(report);
+        writer.write('\n');
+      } finally {
+        writer.close();
+      }
+    }
+  }
+
+  @Override
+  public String toString() {
+    if (depth != 1) {
+      throw new IllegalStateException("Unterminated object");
+    }
+    return json.toString() + "}";
+  }
+
+  private void appendName(String name) {
+    if (needsComma) {
+      json.append(',');
+    }
+    appendString(name);
+    json.append(':');
+    needsComma = true;
+  }
+
+  private void appendString(String value) {
+    json.append('"');
+    for (int i = 0; i < value.length(); i++) {
+      char c = value.charAt(i);
+      if ((c == '"') || (c == '\\')) {
+        json.append('\\').append(c);
+      } else if (c < 0x20) {
+        json.append(String.format(Locale.ROOT, "\\u%04x", (int) c));
+      } else {
+        json.append(c);
+      }
+    }
+    json.append('"');
+  }
+}
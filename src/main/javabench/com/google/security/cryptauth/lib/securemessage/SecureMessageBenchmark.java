@@ -0,0 +1,153 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.HeaderAndBody;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.SecureMessage;
+import java.security.Key;
+import java.security.KeyPair;
+import java.security.SecureRandom;
+import java.util.concurrent.TimeUnit;
+import javax.crypto.KeyGenerator;
+import javax.crypto.SecretKey;
+import org.openjdk.jmh.annotations.AuxCounters;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.Warmup;
+
+/**
+ * Benchmarks for {@link SecureMessageBuilder} and {@link SecureMessageParser}, over every {@link
+ * SigType} and {@link EncType}, a range of body sizes, and with or without associated data.
+ *
+ * <p>{@link EncType#NONE} measures the signed cleartext methods, and {@link EncType#AES_256_CBC}
+ * the signcrypted ones. Besides operations per second, the {@code bytes} counter reports body bytes
+ * per second, and running with {@code -prof gc} (as {@code gradle jmh} does) reports the bytes
+ * allocated per operation as {@code gc.alloc.rate.norm}.
+ */
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+@State(Scope.Thread)
+public class SecureMessageBenchmark {
+
+  private static final byte[] KEY_ID = {1, 2, 3, 4};
+  private static final byte[] ASSOCIATED_DATA = {5, 6, 7, 8, 9, 10, 11, 12};
+
+  @Param({"HMAC_SHA256", "ECDSA_P256_SHA256", "RSA2048_SHA256"})
+  public SigType sigType;
+
+  @Param({"NONE", "AES_256_CBC"})
+  public EncType encType;
+
+  @Param({"16", "1024", "65536", "1048576", "16777216"})
+  public int bodySize;
+
+  @Param({"false", "true"})
+  public boolean withAssociatedData;
+
+  private Key signingKey;
+  private Key verificationKey;
+  private SecretKey encryptionKey;
+  private byte[] body;
+  private byte[] associatedData;
+  private SecureMessageBuilder builder;
+  private SecureMessage message;
+
+  /**
+   * Counts the body bytes processed, which JMH reports as a rate.
+   */
+  @State(Scope.Thread)
+  @AuxCounters(AuxCounters.Type.OPERATIONS)
+  public static class Bytes {
+    public long bytes;
+
+    @Setup(Level.Iteration)
+    public void reset() {
+      bytes = 0;
+    }
+  }
+
+  @Setup(Level.Trial)
+  public void setUp() throws Exception {
+    switch (sigType) {
+      case HMAC_SHA256:
+        signingKey = makeAesKey();
+        verificationKey = signingKey;
+        break;
+      case ECDSA_P256_SHA256:
+        KeyPair ecKeyPair = PublicKeyProtoUtil.generateEcP256KeyPair();
+        signingKey = ecKeyPair.getPrivate();
+        verificationKey = ecKeyPair.getPublic();
+        break;
+      case RSA2048_SHA256:
+        KeyPair rsaKeyPair = PublicKeyProtoUtil.generateRSA2048KeyPair();
+        signingKey = rsaKeyPair.getPrivate();
+        verificationKey = rsaKeyPair.getPublic();
+        break;
+      default:
+        throw new IllegalArgumentException("Unsupported SigType: " + sigType);
+    }
+    encryptionKey = makeAesKey();
+    body = new byte[bodySize];
+    new SecureRandom().nextBytes(body);
+    associatedData = withAssociatedData ? ASSOCIATED_DATA : null;
+
+    builder = new SecureMessageBuilder().setAssociatedData(associatedData);
+    if (encType != EncType.NONE) {
+      // Required for public key signatures, and cheap enough to always set
+      builder.setVerificationKeyId(KEY_ID);
+    }
+    message = build(new Bytes());
+  }
+
+  @Benchmark
+  public SecureMessage build(Bytes bytes) throws Exception {
+    bytes.bytes += bodySize;
+    if (encType == EncType.NONE) {
+      return builder.buildSignedCleartextMessage(signingKey, sigType, body);
+    }
+    return builder.buildSignCryptedMessage(signingKey, sigType, encryptionKey, encType, body);
+  }
+
+  @Benchmark
+  public HeaderAndBody parse(Bytes bytes) throws Exception {
+    bytes.bytes += bodySize;
+    if (encType == EncType.NONE) {
+      return SecureMessageParser.parseSignedCleartextMessage(
+          message, verificationKey, sigType, associatedData);
+    }
+    return SecureMessageParser.parseSignCryptedMessage(
+        message, verificationKey, sigType, encryptionKey, encType, associatedData);
+  }
+
+  private static SecretKey makeAesKey() throws Exception {
+    KeyGenerator generator = KeyGenerator.getInstance("AES");
+    generator.init(256);
+    return generator.generateKey();
+  }
+}
@@ -0,0 +1,170 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import com.google.security.cryptauth.lib.securegcm.Ukey2Handshake.HandshakeCipher;
+import java.io.InputStream;
+import java.lang.management.ManagementFactory;
+import java.util.Properties;
+import java.util.Random;
+import javax.crypto.SecretKey;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/**
+ * Checks that common operations allocate no more than the budgets in {@code
+ * allocation_budgets.properties}. Allocations are counted per thread, with {@link
+ * com.sun.management.ThreadMXBean#getThreadAllocatedBytes(long)}; the test does nothing on JVMs
+ * that can't count them.
+ */
+public class AllocationBudgetTest extends TestCase {
+
+  private static final int WARMUP_ITERATIONS = 200;
+  private static final int MEASURED_ITERATIONS = 100;
+  private static final byte[] KEY_HANDLE = {1, 2, 3, 4};
+
+  /**
+   * An operation whose allocations are measured.
+   */
+  private interface Operation {
+    void run() throws Exception;
+  }
+
+  private com.sun.management.ThreadMXBean threadBean;
+  private Properties budgets;
+  private byte[] payload;
+
+  @Override
+  protected void setUp() throws Exception {
+    KeyEncodingTest.installSunEcSecurityProviderIfNecessary();
+    if (ManagementFactory.getThreadMXBean() instanceof com.sun.management.ThreadMXBean) {
+      threadBean = (com.sun.management.ThreadMXBean) ManagementFactory.getThreadMXBean();
+      if (threadBean.isThreadAllocatedMemorySupported()) {
+        threadBean.setThreadAllocatedMemoryEnabled(true);
+      } else {
+        threadBean = null;
+      }
+    }
+    budgets = new Properties();
+    InputStream in = AllocationBudgetTest.class.getResourceAsStream(
+        "allocation_budgets.properties");
+    assertNotNull("allocation_budgets.properties is missing", in);
+    try {
+      budgets.load(in);
+    } finally {
+      in.close();
+    }
+    payload = new byte[1024];
+    new Random(0).nextBytes(payload);
+    super.setUp();
+  }
+
+  public void testD2DMessages() throws Exception {
+    if (KeyEncoding.isLegacyCryptoRequired()) {
+      return;
+    }
+    final D2DConnectionContext[] contexts = handshake();
+    final byte[][] encoded = new byte[WARMUP_ITERATIONS + MEASURED_ITERATIONS][];
+    assertWithinBudget("d2d.encode", new Operation() {
+      int i = 0;
+
+      @Override
+      public void run() {
+        encoded[i++] = contexts[0].encodeMessageToPeer(payload);
+      }
+    });
+    assertWithinBudget("d2d.decode", new Operation() {
+      int i = 0;
+
+      @Override
+      public void run() throws Exception {
+        contexts[1].decodeMessageFromPeer(encoded[i++]);
+      }
+    });
+  }
+
+  public void testServerMessages() throws Exception {
+    final SecretKey masterKey = new SecretKeySpec(new byte[32], "AES");
+    final Payload message = new Payload(PayloadType.DEVICE_TO_DEVICE_MESSAGE, payload);
+    final byte[] signcrypted =
+        TransportCryptoOps.signcryptServerMessage(message, masterKey, KEY_HANDLE);
+    assertWithinBudget("transport.signcrypt", new Operation() {
+      @Override
+      public void run() throws Exception {
+        TransportCryptoOps.signcryptServerMessage(message, masterKey, KEY_HANDLE);
+      }
+    });
+    assertWithinBudget("transport.verifydecrypt", new Operation() {
+      @Override
+      public void run() throws Exception {
+        TransportCryptoOps.verifydecryptServerMessage(signcrypted, masterKey);
+      }
+    });
+  }
+
+  public void testUkey2Handshake() throws Exception {
+    if (KeyEncoding.isLegacyCryptoRequired()) {
+      return;
+    }
+    assertWithinBudget("ukey2.handshake", new Operation() {
+      @Override
+      public void run() throws Exception {
+        handshake();
+      }
+    });
+  }
+
+  /**
+   * Runs {@code operation} {@link #WARMUP_ITERATIONS} times, then checks the average number of
+   * bytes allocated over another {@link #MEASURED_ITERATIONS} runs against its budget.
+   */
+  private void assertWithinBudget(String name, Operation operation) throws Exception {
+    String budget = budgets.getProperty(name);
+    assertNotNull("No allocation budget for " + name, budget);
+    if (threadBean == null) {
+      return;
+    }
+    for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+      operation.run();
+    }
+    long threadId = Thread.currentThread().getId();
+    long before = threadBean.getThreadAllocatedBytes(threadId);
+    for (int i = 0; i < MEASURED_ITERATIONS; i++) {
+      operation.run();
+    }
+    long perOperation =
+        (threadBean.getThreadAllocatedBytes(threadId) - before) / MEASURED_ITERATIONS;
+    assertTrue(
+        name + " allocated " + perOperation + " bytes per operation, over its budget of " + budget,
+        perOperation <= Long.parseLong(budget.trim()));
+  }
+
+  private static D2DConnectionContext[] handshake() throws Exception {
+    Ukey2Handshake initiator = Ukey2Handshake.forInitiator(HandshakeCipher.P256_SHA512);
+    Ukey2Handshake responder = Ukey2Handshake.forResponder(HandshakeCipher.P256_SHA512);
+    responder.parseHandshakeMessage(initiator.getNextHandshakeMessage());
+    initiator.parseHandshakeMessage(responder.getNextHandshakeMessage());
+    responder.parseHandshakeMessage(initiator.getNextHandshakeMessage());
+    initiator.getVerificationString(32);
+    responder.getVerificationString(32);
+    initiator.verifyHandshake();
+    responder.verifyHandshake();
+    return new D2DConnectionContext[] {
+      initiator.toConnectionContext(), responder.toConnectionContext()
+    };
+  }
+}
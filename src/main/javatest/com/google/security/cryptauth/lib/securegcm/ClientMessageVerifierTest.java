@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
+import java.security.KeyPair;
+import java.security.SignatureException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import javax.crypto.SecretKey;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/** Tests for the ClientMessageVerifier class. */
+public class ClientMessageVerifierTest extends TestCase {
+
+  private SecretKey masterKey;
+
+  @Override
+  protected void setUp() throws Exception {
+    KeyEncodingTest.installSunEcSecurityProviderIfNecessary();
+    masterKey = new SecretKeySpec(new byte[32], "AES");
+    super.setUp();
+  }
+
+  public void testEcMessages() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    doTestMessagesFrom(PublicKeyProtoUtil.generateEcP256KeyPair());
+  }
+
+  public void testRsaMessages() throws Exception {
+    doTestMessagesFrom(PublicKeyProtoUtil.generateRSA2048KeyPair());
+  }
+
+  public void testRejectsOtherClients() throws Exception {
+    KeyPair userKeyPair = PublicKeyProtoUtil.generateRSA2048KeyPair();
+    KeyPair otherKeyPair = PublicKeyProtoUtil.generateRSA2048KeyPair();
+    ClientMessageVerifier verifier =
+        new ClientMessageVerifier(userKeyPair.getPublic(), masterKey);
+    byte[] good = signcrypt(userKeyPair, 1);
+    byte[] bad = signcrypt(otherKeyPair, 2);
+
+    verifier.verifydecrypt(good);
+    try {
+      verifier.verifydecrypt(bad);
+      fail();
+    } catch (SignatureException expected) {
+    }
+    // Still usable after a failure
+    assertTrue(Arrays.equals(new byte[] {1}, verifier.verifydecrypt(good).getMessage()));
+  }
+
+  private void doTestMessagesFrom(KeyPair userKeyPair) throws Exception {
+    final ClientMessageVerifier verifier =
+        new ClientMessageVerifier(userKeyPair.getPublic(), masterKey);
+    assertEquals(userKeyPair.getPublic(), verifier.getUserPublicKey());
+
+    List<Callable<byte[]>> tasks = new ArrayList<>();
+    for (int i = 0; i < 20; i++) {
+      final byte[] message = signcrypt(userKeyPair, i);
+      tasks.add(new Callable<byte[]>() {
+        @Override
+        public byte[] call() throws Exception {
+          Payload payload = verifier.verifydecrypt(message);
+          assertEquals(PayloadType.TICKLE, payload.getPayloadType());
+          return payload.getMessage();
+        }
+      });
+    }
+    ExecutorService executor = Executors.newFixedThreadPool(4);
+    try {
+      List<Future<byte[]>> results = executor.invokeAll(tasks);
+      for (int i = 0; i < results.size(); i++) {
+        assertTrue(Arrays.equals(new byte[] {(byte) i}, results.get(i).get()));
+      }
+    } finally {
+      executor.shutdown();
+    }
+  }
+
+  private byte[] signcrypt(KeyPair userKeyPair, int value) throws Exception {
+    return TransportCryptoOps.signcryptClientMessage(
+        new Payload(PayloadType.TICKLE, new byte[] {(byte) value}), userKeyPair, masterKey);
+  }
+}
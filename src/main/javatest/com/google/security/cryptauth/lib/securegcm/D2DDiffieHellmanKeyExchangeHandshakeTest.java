@@ -416,6 +416,43 @@ public class D2DDiffieHellmanKeyExchangeHandshakeTest extends TestCase {
     assertEquals(1, responderCtx.getSequenceNumberForDecoding());
   }
 
+  public void testResponderCompressesKeyOnlyIfInitiatorAccepts() throws Exception {
+    if (KeyEncoding.isLegacyCryptoRequired()) {
+      // this means we're running on an old SDK, which doesn't support the
+      // necessary crypto. Let's not test anything in this case.
+      return;
+    }
+
+    D2DHandshakeContext initiatorHandshakeContext =
+        D2DDiffieHellmanKeyExchangeHandshake.forInitiator();
+    byte[] initiatorHello = initiatorHandshakeContext.getNextHandshakeMessage();
+    assertTrue(InitiatorHello.parseFrom(initiatorHello).getAcceptsCompressedPublicKey());
+    assertTrue(InitiatorHello.parseFrom(initiatorHello)
+        .getPublicDhKey().getEcP256PublicKey().hasY());
+
+    D2DHandshakeContext responderHandshakeContext =
+        D2DDiffieHellmanKeyExchangeHandshake.forResponder();
+    responderHandshakeContext.parseHandshakeMessage(initiatorHello);
+    byte[] responderHello = responderHandshakeContext.getNextHandshakeMessage();
+    assertFalse(D2DCryptoOps.parseAndValidateResponderHello(responderHello)
+        .getPublicDhKey().getEcP256PublicKey().hasY());
+    initiatorHandshakeContext.parseHandshakeMessage(responderHello);
+    checkInitializedConnectionContexts(
+        initiatorHandshakeContext.toConnectionContext(),
+        responderHandshakeContext.toConnectionContext());
+
+    // An initiator that doesn't advertise support gets an uncompressed key
+    byte[] oldInitiatorHello = InitiatorHello.parseFrom(initiatorHello).toBuilder()
+        .clearAcceptsCompressedPublicKey()
+        .build()
+        .toByteArray();
+    responderHandshakeContext = D2DDiffieHellmanKeyExchangeHandshake.forResponder();
+    responderHandshakeContext.parseHandshakeMessage(oldInitiatorHello);
+    responderHello = responderHandshakeContext.getNextHandshakeMessage();
+    assertTrue(D2DCryptoOps.parseAndValidateResponderHello(responderHello)
+        .getPublicDhKey().getEcP256PublicKey().hasY());
+  }
+
   private void checkInitializedConnectionContexts(
       D2DConnectionContext initiatorCtx, D2DConnectionContext responderCtx) {
     assertNotNull(initiatorCtx);
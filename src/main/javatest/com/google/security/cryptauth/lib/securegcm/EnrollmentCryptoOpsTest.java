@@ -113,6 +113,45 @@ public class EnrollmentCryptoOpsTest extends TestCase {
     testSimulatedEnrollment();
   }
 
+  public void testDeviceInfoKeysMatch() throws Exception {
+    boolean isLegacy = KeyEncoding.isLegacyCryptoRequired();
+    KeyPair userKeyPair = isLegacy ? PublicKeyProtoUtil.generateRSA2048KeyPair()
+        : PublicKeyProtoUtil.generateEcP256KeyPair();
+    SecretKey masterKey = EnrollmentCryptoOps.doKeyAgreement(
+        EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy).getPrivate(),
+        EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy).getPublic());
+    GcmDeviceInfo info = createGcmDeviceInfo(userKeyPair.getPublic(), masterKey);
+    ByteString userPublicKey = info.getUserPublicKey();
+    byte[] masterKeyHash = EnrollmentCryptoOps.getMasterKeyHash(masterKey);
+
+    assertTrue(EnrollmentCryptoOps.deviceInfoKeysMatch(
+        info.toByteString(), userPublicKey, masterKeyHash));
+    assertFalse(EnrollmentCryptoOps.deviceInfoKeysMatch(
+        info.toByteString(), userPublicKey, new byte[masterKeyHash.length]));
+    assertFalse(EnrollmentCryptoOps.deviceInfoKeysMatch(
+        info.toBuilder().clearDeviceMasterKeyHash().build().toByteString(),
+        userPublicKey,
+        masterKeyHash));
+    assertFalse(EnrollmentCryptoOps.deviceInfoKeysMatch(
+        info.toBuilder().clearUserPublicKey().buildPartial().toByteString(),
+        userPublicKey,
+        masterKeyHash));
+
+    // As when parsing, the last occurrence of a field is the one that counts
+    ByteString otherKey = ByteString.copyFrom(new byte[] {1, 2, 3});
+    ByteString overridden =
+        info.toByteString().concat(GcmDeviceInfo.newBuilder()
+            .setUserPublicKey(otherKey)
+            .buildPartial()
+            .toByteString());
+    assertEquals(otherKey, GcmDeviceInfo.parseFrom(overridden).getUserPublicKey());
+    assertFalse(EnrollmentCryptoOps.deviceInfoKeysMatch(overridden, userPublicKey, masterKeyHash));
+    assertTrue(EnrollmentCryptoOps.deviceInfoKeysMatch(overridden, otherKey, masterKeyHash));
+
+    ByteString truncated = info.toByteString().substring(0, info.getSerializedSize() - 1);
+    assertFalse(EnrollmentCryptoOps.deviceInfoKeysMatch(truncated, userPublicKey, masterKeyHash));
+  }
+
   private GcmDeviceInfo createGcmDeviceInfo(PublicKey userPublicKey, SecretKey masterKey) {
     // One possible method of generating a key handle:
     GenericPublicKey encodedUserPublicKey = PublicKeyProtoUtil.encodePublicKey(userPublicKey);
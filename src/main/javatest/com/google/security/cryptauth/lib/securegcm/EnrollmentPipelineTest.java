@@ -0,0 +1,178 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.util.concurrent.ListenableFuture;
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securegcm.EnrollmentPipeline.Stage;
+import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.GcmDeviceInfo;
+import com.google.security.cryptauth.lib.securemessage.CryptoOps;
+import com.google.security.cryptauth.lib.securemessage.JcaCryptoBackend;
+import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
+import java.security.KeyPair;
+import java.security.Provider;
+import java.security.SignatureException;
+import java.util.ArrayList;
+import java.util.EnumMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.TimeUnit;
+import javax.crypto.SecretKey;
+import junit.framework.TestCase;
+
+/** Tests for the EnrollmentPipeline class. */
+public class EnrollmentPipelineTest extends TestCase {
+
+  private static final int MESSAGES = 20;
+
+  private boolean isLegacy;
+  private SecretKey masterKey;
+  private KeyPair userKeyPair;
+  private GcmDeviceInfo deviceInfo;
+  private byte[] enrollmentMessage;
+
+  @Override
+  protected void setUp() throws Exception {
+    KeyEncodingTest.installSunEcSecurityProviderIfNecessary();
+    isLegacy = KeyEncoding.isLegacyCryptoRequired();
+    KeyPair serverKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    KeyPair clientKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    masterKey = EnrollmentCryptoOps.doKeyAgreement(
+        clientKeyPair.getPrivate(), serverKeyPair.getPublic());
+    userKeyPair = isLegacy ? PublicKeyProtoUtil.generateRSA2048KeyPair()
+        : PublicKeyProtoUtil.generateEcP256KeyPair();
+    deviceInfo = GcmDeviceInfo.newBuilder()
+        .setAndroidDeviceId(1234567890L)
+        .setDeviceMasterKeyHash(
+            ByteString.copyFrom(EnrollmentCryptoOps.getMasterKeyHash(masterKey)))
+        .setUserPublicKey(
+            ByteString.copyFrom(KeyEncoding.encodeUserPublicKey(userKeyPair.getPublic())))
+        .build();
+    enrollmentMessage = EnrollmentCryptoOps.encryptEnrollmentMessage(
+        deviceInfo, masterKey, userKeyPair.getPrivate());
+    super.setUp();
+  }
+
+  public void testDecryptsLikeEnrollmentCryptoOps() throws Exception {
+    Map<Stage, Integer> workers = new EnumMap<>(Stage.class);
+    workers.put(Stage.SIGNATURE_VERIFY, 3);
+    EnrollmentPipeline pipeline = new EnrollmentPipeline(4, workers);
+    try {
+      List<ListenableFuture<GcmDeviceInfo>> results = new ArrayList<>();
+      for (int i = 0; i < MESSAGES; i++) {
+        results.add(pipeline.submit(enrollmentMessage, masterKey, isLegacy));
+      }
+      for (ListenableFuture<GcmDeviceInfo> result : results) {
+        assertEquals(deviceInfo, result.get(10, TimeUnit.SECONDS));
+      }
+      for (Stage stage : Stage.values()) {
+        assertEquals(MESSAGES, pipeline.getMetrics(stage).getProcessedCount());
+        assertEquals(0, pipeline.getMetrics(stage).getFailureCount());
+        assertEquals(0, pipeline.getMetrics(stage).getQueueSize());
+      }
+      assertTrue(pipeline.getMetrics(Stage.SIGNATURE_VERIFY).getMessagesPerWorkerSecond() > 0);
+    } finally {
+      pipeline.close();
+    }
+  }
+
+  public void testReportsFailuresPerMessage() throws Exception {
+    byte[] tampered = enrollmentMessage.clone();
+    tampered[tampered.length - 1] ^= 1;
+    byte[] garbage = {1, 2, 3};
+
+    EnrollmentPipeline pipeline = new EnrollmentPipeline(2, 2);
+    try {
+      ListenableFuture<GcmDeviceInfo> good =
+          pipeline.submit(enrollmentMessage, masterKey, isLegacy);
+      ListenableFuture<GcmDeviceInfo> bad = pipeline.submit(tampered, masterKey, isLegacy);
+      ListenableFuture<GcmDeviceInfo> unparseable = pipeline.submit(garbage, masterKey, isLegacy);
+
+      assertEquals(deviceInfo, good.get(10, TimeUnit.SECONDS));
+      assertFailsWithSignatureException(bad);
+      assertFailsWithSignatureException(unparseable);
+      assertEquals(1, pipeline.getMetrics(Stage.PARSE).getFailureCount());
+      assertEquals(1, pipeline.getMetrics(Stage.OUTER_VERIFY_AND_DECRYPT).getFailureCount());
+      assertEquals(1, pipeline.getMetrics(Stage.DEVICE_INFO_DECODE).getProcessedCount());
+    } finally {
+      pipeline.close();
+    }
+  }
+
+  public void testSurvivesErrorsFromProviders() throws Exception {
+    EnrollmentPipeline pipeline = new EnrollmentPipeline(1, 1);
+    try {
+      CryptoOps.setBackend(JcaCryptoBackend.DEFAULT.withPinnedProvider(
+          JcaCryptoBackend.MAC, "HmacSHA256", new ErrorThrowingProvider()));
+      ListenableFuture<GcmDeviceInfo> broken =
+          pipeline.submit(enrollmentMessage, masterKey, isLegacy);
+      try {
+        broken.get(10, TimeUnit.SECONDS);
+        fail();
+      } catch (ExecutionException expected) {
+        assertTrue(expected.getCause() instanceof AssertionError);
+      }
+      assertEquals(1, pipeline.getMetrics(Stage.OUTER_VERIFY_AND_DECRYPT).getFailureCount());
+
+      // The stage's only worker is still running
+      CryptoOps.setBackend(JcaCryptoBackend.DEFAULT);
+      assertEquals(deviceInfo,
+          pipeline.submit(enrollmentMessage, masterKey, isLegacy).get(10, TimeUnit.SECONDS));
+    } finally {
+      CryptoOps.setBackend(JcaCryptoBackend.DEFAULT);
+      pipeline.close();
+    }
+  }
+
+  public void testRejectsSubmissionsAfterClose() throws Exception {
+    EnrollmentPipeline pipeline = new EnrollmentPipeline(1, 1);
+    pipeline.close();
+    try {
+      pipeline.submit(enrollmentMessage, masterKey, isLegacy);
+      fail();
+    } catch (RejectedExecutionException expected) {
+    }
+  }
+
+  /**
+   * Throws an {@link Error} whenever an HMAC-SHA256 engine is created, like a broken provider.
+   */
+  private static final class ErrorThrowingProvider extends Provider {
+    private static final long serialVersionUID = 1L;
+
+    @SuppressWarnings("deprecation")  // Provider(String, String, String) needs Java 9
+    ErrorThrowingProvider() {
+      super("ErrorThrowing", 1.0, "Throws an Error for HmacSHA256");
+      putService(new Service(this, "Mac", "HmacSHA256", "ErrorThrowing", null, null) {
+        @Override
+        public Object newInstance(Object constructorParameter) {
+          throw new AssertionError("Broken provider");
+        }
+      });
+    }
+  }
+
+  private static void assertFailsWithSignatureException(ListenableFuture<GcmDeviceInfo> result)
+      throws Exception {
+    try {
+      result.get(10, TimeUnit.SECONDS);
+      fail();
+    } catch (ExecutionException expected) {
+      assertTrue(expected.getCause() instanceof SignatureException);
+    }
+  }
+}
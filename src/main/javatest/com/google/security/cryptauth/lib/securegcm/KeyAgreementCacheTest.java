@@ -0,0 +1,104 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.testing.FakeTicker;
+import java.security.KeyPair;
+import java.util.Arrays;
+import java.util.concurrent.TimeUnit;
+import javax.crypto.SecretKey;
+import junit.framework.TestCase;
+
+/** Tests for the KeyAgreementCache class. */
+public class KeyAgreementCacheTest extends TestCase {
+
+  private KeyPair serverKeyPair;
+  private KeyPair deviceKeyPair;
+  private KeyPair otherDeviceKeyPair;
+
+  @Override
+  protected void setUp() throws Exception {
+    KeyEncodingTest.installSunEcSecurityProviderIfNecessary();
+    boolean isLegacy = KeyEncoding.isLegacyCryptoRequired();
+    serverKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    deviceKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    otherDeviceKeyPair = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(isLegacy);
+    super.setUp();
+  }
+
+  @Override
+  protected void tearDown() throws Exception {
+    EnrollmentCryptoOps.setKeyAgreementCache(null);
+    super.tearDown();
+  }
+
+  public void testRepeatedAgreementIsCached() throws Exception {
+    KeyAgreementCache cache = new KeyAgreementCache(10, 1, TimeUnit.HOURS);
+    EnrollmentCryptoOps.setKeyAgreementCache(cache);
+
+    SecretKey first = agree(serverKeyPair, deviceKeyPair);
+    SecretKey second = agree(serverKeyPair, deviceKeyPair);
+    assertEquals(first, second);
+    assertEquals(1, cache.getMissCount());
+    assertEquals(1, cache.getHitCount());
+
+    // Still agrees with the other side, which isn't using a cache
+    EnrollmentCryptoOps.setKeyAgreementCache(null);
+    assertEquals(first, agree(deviceKeyPair, serverKeyPair));
+  }
+
+  public void testDifferentPeersAreNotConfused() throws Exception {
+    KeyAgreementCache cache = new KeyAgreementCache(10, 1, TimeUnit.HOURS);
+    EnrollmentCryptoOps.setKeyAgreementCache(cache);
+
+    SecretKey withDevice = agree(serverKeyPair, deviceKeyPair);
+    SecretKey withOtherDevice = agree(serverKeyPair, otherDeviceKeyPair);
+    assertFalse(withDevice.equals(withOtherDevice));
+    assertEquals(2, cache.size());
+    assertEquals(withOtherDevice, agree(serverKeyPair, otherDeviceKeyPair));
+  }
+
+  public void testEvictedKeysRemainUsableByCallers() throws Exception {
+    KeyAgreementCache cache = new KeyAgreementCache(1, 1, TimeUnit.HOURS);
+    EnrollmentCryptoOps.setKeyAgreementCache(cache);
+
+    SecretKey withDevice = agree(serverKeyPair, deviceKeyPair);
+    byte[] expected = withDevice.getEncoded();
+    agree(serverKeyPair, otherDeviceKeyPair);  // Evicts the first entry
+    assertEquals(1, cache.size());
+    assertTrue(Arrays.equals(expected, withDevice.getEncoded()));
+
+    cache.invalidateAll();
+    assertEquals(0, cache.size());
+    assertEquals(withDevice, agree(serverKeyPair, deviceKeyPair));
+    assertEquals(3, cache.getMissCount());
+  }
+
+  public void testExpiry() throws Exception {
+    FakeTicker ticker = new FakeTicker();
+    KeyAgreementCache cache = new KeyAgreementCache(10, 1, TimeUnit.MINUTES, ticker);
+    EnrollmentCryptoOps.setKeyAgreementCache(cache);
+
+    SecretKey first = agree(serverKeyPair, deviceKeyPair);
+    ticker.advance(2, TimeUnit.MINUTES);
+    assertEquals(first, agree(serverKeyPair, deviceKeyPair));
+    assertEquals(2, cache.getMissCount());
+    assertEquals(0, cache.getHitCount());
+  }
+
+  private static SecretKey agree(KeyPair ours, KeyPair theirs) throws Exception {
+    return EnrollmentCryptoOps.doKeyAgreement(ours.getPrivate(), theirs.getPublic());
+  }
+}
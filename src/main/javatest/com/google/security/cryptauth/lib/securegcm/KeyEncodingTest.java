@@ -14,6 +14,7 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.security.cryptauth.lib.securemessage.PublicKeyCache;
 import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
 import java.security.Key;
 import java.security.KeyPair;
@@ -27,6 +28,7 @@ import java.security.interfaces.RSAPrivateKey;
 import java.security.interfaces.RSAPublicKey;
 import java.security.spec.InvalidKeySpecException;
 import java.util.Arrays;
+import java.util.concurrent.TimeUnit;
 import javax.crypto.interfaces.DHPrivateKey;
 import javax.crypto.interfaces.DHPublicKey;
 import junit.framework.TestCase;
@@ -55,6 +57,7 @@ public class KeyEncodingTest extends TestCase {
   @Override
   protected void tearDown() throws Exception {
     KeyEncoding.setSimulateLegacyCrypto(false);
+    KeyEncoding.setPublicKeyCache(null);
     isLegacy = PublicKeyProtoUtil.isLegacyCryptoRequired();
     super.tearDown();
   }
@@ -87,6 +90,23 @@ public class KeyEncodingTest extends TestCase {
     assertKeysEqual(pk, decodedPk);
   }
 
+  public void testUserPublicKeyCache() throws InvalidKeySpecException {
+    PublicKeyCache cache = new PublicKeyCache(16, 1, TimeUnit.MINUTES);
+    KeyEncoding.setPublicKeyCache(cache);
+    PublicKey pk = userKeyPair.getPublic();
+    byte[] encodedPk = KeyEncoding.encodeUserPublicKey(pk);
+
+    PublicKey first = KeyEncoding.parseUserPublicKey(encodedPk);
+    assertEquals(1, cache.getMissCount());
+    assertEquals(0, cache.getHitCount());
+
+    PublicKey second = KeyEncoding.parseUserPublicKey(encodedPk);
+    assertEquals(1, cache.getMissCount());
+    assertEquals(1, cache.getHitCount());
+    assertKeysEqual(pk, first);
+    assertSame(first, second);
+  }
+
   public void testUserPrivateKeyEncoding() throws InvalidKeySpecException {
     PrivateKey sk = userKeyPair.getPrivate();
     byte[] encodedSk = KeyEncoding.encodeUserPrivateKey(sk);
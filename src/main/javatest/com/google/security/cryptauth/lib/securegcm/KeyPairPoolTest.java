@@ -0,0 +1,172 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.base.Supplier;
+import com.google.common.util.concurrent.MoreExecutors;
+import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
+import java.security.KeyPair;
+import java.util.ArrayList;
+import java.util.IdentityHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.Executor;
+import java.util.concurrent.atomic.AtomicInteger;
+import javax.crypto.SecretKey;
+import junit.framework.TestCase;
+
+/** Tests for the KeyPairPool class. */
+public class KeyPairPoolTest extends TestCase {
+
+  private final AtomicInteger generated = new AtomicInteger();
+
+  private final Supplier<KeyPair> generator = new Supplier<KeyPair>() {
+    @Override
+    public KeyPair get() {
+      generated.incrementAndGet();
+      return PublicKeyProtoUtil.generateDh2048KeyPair();
+    }
+  };
+
+  @Override
+  protected void tearDown() throws Exception {
+    EnrollmentCryptoOps.setLegacyKeyPairPool(null);
+    EnrollmentCryptoOps.setEcKeyPairPool(null);
+    super.tearDown();
+  }
+
+  public void testPoolIsFilledAndRefilled() {
+    KeyPairPool pool = new KeyPairPool(generator, 3, MoreExecutors.directExecutor());
+    assertEquals(3, pool.size());
+    assertEquals(3, generated.get());
+
+    pool.take();
+    assertEquals(3, pool.size());
+    assertEquals(4, generated.get());
+    assertEquals(1, pool.getHitCount());
+    assertEquals(0, pool.getMissCount());
+  }
+
+  public void testKeyPairsAreNeverReused() {
+    KeyPairPool pool = new KeyPairPool(generator, 2, MoreExecutors.directExecutor());
+    Map<KeyPair, Boolean> seen = new IdentityHashMap<>();
+    for (int i = 0; i < 10; i++) {
+      assertNull(seen.put(pool.take(), true));
+    }
+  }
+
+  public void testFallsBackToInlineGenerationWhenEmpty() {
+    final List<Runnable> pending = new ArrayList<>();
+    Executor queueingExecutor = new Executor() {
+      @Override
+      public void execute(Runnable command) {
+        pending.add(command);
+      }
+    };
+    KeyPairPool pool = new KeyPairPool(generator, 2, queueingExecutor);
+    assertEquals(0, pool.size());
+    assertNotNull(pool.take());
+    assertEquals(1, pool.getMissCount());
+    assertEquals(1, pending.size());  // Only one refill is ever scheduled at a time
+
+    pending.remove(0).run();
+    assertEquals(2, pool.size());
+    pool.take();
+    assertEquals(1, pool.getHitCount());
+  }
+
+  public void testRefillsOnlyBelowLowWatermark() {
+    KeyPairPool pool = new KeyPairPool(generator, 2, 4, MoreExecutors.directExecutor());
+    assertEquals(4, pool.size());
+    assertEquals(4, pool.getCapacity());
+
+    pool.take();
+    pool.take();
+    assertEquals(2, pool.size());
+    assertEquals(4, generated.get());
+
+    pool.take();  // Drops below the low watermark
+    assertEquals(4, pool.size());
+    assertEquals(7, generated.get());
+    assertEquals(3, pool.getHitCount());
+  }
+
+  public void testRefillsOnceEmptyWithLowWatermarkOfOne() {
+    KeyPairPool pool = new KeyPairPool(generator, 1, 2, MoreExecutors.directExecutor());
+    pool.take();
+    assertEquals(1, pool.size());
+    assertEquals(2, generated.get());
+
+    pool.take();  // Empties the pool
+    assertEquals(2, pool.size());
+    assertEquals(4, generated.get());
+    pool.take();
+    assertEquals(3, pool.getHitCount());
+    assertEquals(0, pool.getMissCount());
+  }
+
+  public void testInvalidWatermarks() {
+    try {
+      new KeyPairPool(generator, 3, 2, MoreExecutors.directExecutor());
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+    try {
+      new KeyPairPool(generator, 0, 2, MoreExecutors.directExecutor());
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+    try {
+      new KeyPairPool(generator, -1, 2, MoreExecutors.directExecutor());
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+  }
+
+  public void testEcEnrollmentUsesPool() throws Exception {
+    if (KeyEncoding.isLegacyCryptoRequired()) {
+      return;
+    }
+    KeyPairPool pool = EnrollmentCryptoOps.newEnrollmentKeyPairPool(
+        false, 1, 2, MoreExecutors.directExecutor());
+    EnrollmentCryptoOps.setEcKeyPairPool(pool);
+    KeyPair first = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(false);
+    KeyPair second = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(false);
+    assertEquals(2, pool.getHitCount());
+    assertEquals(0, pool.getMissCount());
+    assertEquals(
+        EnrollmentCryptoOps.doKeyAgreement(first.getPrivate(), second.getPublic()),
+        EnrollmentCryptoOps.doKeyAgreement(second.getPrivate(), first.getPublic()));
+
+    // The legacy pool is separate
+    assertTrue(KeyEncoding.isLegacyPrivateKey(
+        EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(true).getPrivate()));
+    assertEquals(2, pool.getHitCount());
+  }
+
+  public void testLegacyEnrollmentUsesPool() throws Exception {
+    KeyPairPool pool = new KeyPairPool(generator, 2, MoreExecutors.directExecutor());
+    EnrollmentCryptoOps.setLegacyKeyPairPool(pool);
+    KeyPair first = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(true);
+    KeyPair second = EnrollmentCryptoOps.generateEnrollmentKeyAgreementKeyPair(true);
+    assertEquals(2, pool.getHitCount());
+
+    SecretKey firstShared =
+        EnrollmentCryptoOps.doKeyAgreement(first.getPrivate(), second.getPublic());
+    SecretKey secondShared =
+        EnrollmentCryptoOps.doKeyAgreement(second.getPrivate(), first.getPublic());
+    assertEquals(firstShared, secondShared);
+  }
+}
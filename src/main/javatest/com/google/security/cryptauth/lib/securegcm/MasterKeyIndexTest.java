@@ -0,0 +1,167 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.concurrent.atomic.AtomicBoolean;
+import java.util.concurrent.atomic.AtomicReference;
+import javax.crypto.SecretKey;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/** Tests for the MasterKeyIndex class. */
+public class MasterKeyIndexTest extends TestCase {
+
+  public void testPutGetRemove() {
+    MasterKeyIndex index = new MasterKeyIndex(10);
+    SecretKey key = masterKey(1);
+    byte[] hash = EnrollmentCryptoOps.getMasterKeyHash(key);
+    assertNull(index.get(hash));
+
+    index.put(key, new byte[] {1, 2});
+    MasterKeyIndex.Entry entry = index.get(hash);
+    assertEquals(key, entry.getMasterKey());
+    assertTrue(Arrays.equals(new byte[] {1, 2}, entry.getKeyHandle()));
+    assertEquals(1, index.size());
+
+    // Replacing an entry
+    index.put(key, new byte[] {3});
+    assertTrue(Arrays.equals(new byte[] {3}, index.get(hash).getKeyHandle()));
+    assertEquals(1, index.size());
+
+    assertTrue(index.remove(hash));
+    assertFalse(index.remove(hash));
+    assertNull(index.get(hash));
+    assertEquals(0, index.size());
+  }
+
+  public void testGrows() {
+    MasterKeyIndex index = new MasterKeyIndex(0);
+    for (int i = 0; i < 2000; i++) {
+      index.put(masterKey(i), handle(i));
+      if (i % 3 == 0) {
+        assertTrue(index.remove(EnrollmentCryptoOps.getMasterKeyHash(masterKey(i))));
+      }
+    }
+    assertEquals(2000 - 667, index.size());
+    for (int i = 0; i < 2000; i++) {
+      MasterKeyIndex.Entry entry = index.get(EnrollmentCryptoOps.getMasterKeyHash(masterKey(i)));
+      if (i % 3 == 0) {
+        assertNull(entry);
+      } else {
+        assertEquals(masterKey(i), entry.getMasterKey());
+        assertTrue(Arrays.equals(handle(i), entry.getKeyHandle()));
+      }
+    }
+  }
+
+  public void testSnapshot() throws Exception {
+    MasterKeyIndex index = new MasterKeyIndex(100);
+    for (int i = 0; i < 300; i++) {
+      index.put(masterKey(i), handle(i));
+    }
+    index.remove(EnrollmentCryptoOps.getMasterKeyHash(masterKey(0)));
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    index.writeTo(out);
+    byte[] snapshot = out.toByteArray();
+
+    MasterKeyIndex loaded = MasterKeyIndex.readFrom(new ByteArrayInputStream(snapshot));
+    assertEquals(299, loaded.size());
+    assertNull(loaded.get(EnrollmentCryptoOps.getMasterKeyHash(masterKey(0))));
+    for (int i = 1; i < 300; i++) {
+      MasterKeyIndex.Entry entry = loaded.get(EnrollmentCryptoOps.getMasterKeyHash(masterKey(i)));
+      assertTrue(Arrays.equals(handle(i), entry.getKeyHandle()));
+    }
+    // The loaded index is still writable
+    loaded.put(masterKey(0), handle(0));
+    assertEquals(300, loaded.size());
+
+    for (byte[] corrupt : Arrays.asList(
+        new byte[0],
+        Arrays.copyOf(snapshot, snapshot.length - 1),
+        Arrays.copyOfRange(snapshot, 1, snapshot.length))) {
+      try {
+        MasterKeyIndex.readFrom(new ByteArrayInputStream(corrupt));
+        fail();
+      } catch (IOException expected) {
+      }
+    }
+  }
+
+  public void testRejectsInvalidEntries() {
+    MasterKeyIndex index = new MasterKeyIndex(1);
+    try {
+      index.put(new SecretKeySpec(new byte[16], "AES"), handle(0));
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+    try {
+      index.put(masterKey(0), new byte[MasterKeyIndex.MAX_KEY_HANDLE_LENGTH + 1]);
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+    try {
+      index.get(new byte[16]);
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+  }
+
+  public void testConcurrentReadsAndWrites() throws Exception {
+    final MasterKeyIndex index = new MasterKeyIndex(0);
+    final SecretKey stableKey = masterKey(-1);
+    final byte[] stableHash = EnrollmentCryptoOps.getMasterKeyHash(stableKey);
+    index.put(stableKey, handle(-1));
+    final AtomicBoolean done = new AtomicBoolean();
+    final AtomicReference<String> failure = new AtomicReference<>();
+    Thread reader = new Thread() {
+      @Override
+      public void run() {
+        while (!done.get()) {
+          MasterKeyIndex.Entry entry = index.get(stableHash);
+          if ((entry == null) || !stableKey.equals(entry.getMasterKey())) {
+            failure.set("Lost or corrupted entry");
+          }
+        }
+      }
+    };
+    reader.start();
+    try {
+      for (int i = 0; i < 3000; i++) {
+        index.put(masterKey(i), handle(i));
+      }
+    } finally {
+      done.set(true);
+      reader.join();
+    }
+    assertNull(failure.get());
+  }
+
+  private static SecretKey masterKey(int i) {
+    byte[] key = new byte[32];
+    key[0] = (byte) i;
+    key[1] = (byte) (i >> 8);
+    key[2] = (byte) (i >> 16);
+    key[3] = (byte) (i >> 24);
+    return new SecretKeySpec(key, "AES");
+  }
+
+  private static byte[] handle(int i) {
+    return Arrays.copyOf(new byte[] {(byte) i, (byte) (i >> 8)}, 1 + Math.abs(i) % 8);
+  }
+}
@@ -0,0 +1,195 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import com.google.common.testing.FakeTicker;
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import java.security.SignatureException;
+import java.util.concurrent.TimeUnit;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/** Tests for the ReplayGuard class. */
+public class ReplayGuardTest extends TestCase {
+
+  private static final ByteString KEY_ID = ByteString.copyFrom(new byte[] {1, 2, 3});
+  private static final ByteString OTHER_KEY_ID = ByteString.copyFrom(new byte[] {4, 5, 6});
+
+  private final FakeTicker ticker = new FakeTicker();
+
+  @Override
+  protected void tearDown() throws Exception {
+    TransportCryptoOps.setReplayGuard(null);
+    super.tearDown();
+  }
+
+  public void testDetectsReplays() {
+    ReplayGuard guard = newGuard(100);
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(1)));
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(1)));
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(2)));
+    assertTrue(guard.checkAndRecord(OTHER_KEY_ID, nonce(1)));
+    assertEquals(1, guard.getReplayCount());
+
+    // The length of the key id is part of the fingerprint
+    assertFalse(ReplayGuard.fingerprint(KEY_ID.concat(nonce(1)), ByteString.EMPTY)
+        .equals(ReplayGuard.fingerprint(KEY_ID, nonce(1))));
+  }
+
+  public void testRemembersMessagesForTheWindow() {
+    ReplayGuard guard = newGuard(100);
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(1)));
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(2)));
+
+    ticker.advance(3, TimeUnit.MINUTES);
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(1)));  // Held exactly
+    ticker.advance(2, TimeUnit.MINUTES);
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(2)));  // Held in a Bloom filter
+    assertEquals(1, guard.getCompactedBucketCount());
+
+    ticker.advance(15, TimeUnit.MINUTES);
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(1)));
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(2)));
+    assertEquals(0, guard.getCompactedBucketCount());
+  }
+
+  public void testBoundsExactBuckets() {
+    ReplayGuard guard = newGuard(2);
+    for (int i = 0; i < 10; i++) {
+      assertTrue(guard.checkAndRecord(KEY_ID, nonce(i)));
+    }
+    // The overflowing buckets of one interval share a single filter
+    assertEquals(1, guard.getCompactedBucketCount());
+    for (int i = 0; i < 10; i++) {
+      assertFalse(guard.checkAndRecord(KEY_ID, nonce(i)));
+    }
+    assertEquals(10, guard.getReplayCount());
+  }
+
+  public void testBoundsFiltersUnderFlood() {
+    ReplayGuard guard = newGuard(2);
+    int message = 0;
+    for (int minute = 0; minute < 3 * ReplayGuard.BUCKETS_PER_WINDOW; minute++) {
+      // Four times as many messages as fit in a bucket, which is what the filters are sized for
+      for (int i = 0; i < 8; i++) {
+        assertTrue(guard.checkAndRecord(KEY_ID, nonce(message++)));
+      }
+      assertTrue(guard.getCompactedBucketCount() <= ReplayGuard.MAX_FILTERS);
+      ticker.advance(1, TimeUnit.MINUTES);
+    }
+    // The most recent messages are all still remembered
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(message - 1)));
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(message - 30)));
+    assertEquals(2, guard.getReplayCount());
+  }
+
+  public void testReplaysAreNotRecorded() {
+    ReplayGuard guard = newGuard(2);
+    for (int i = 0; i < 3; i++) {
+      assertTrue(guard.checkAndRecord(KEY_ID, nonce(i)));
+    }
+    // Replays of a message in the previous bucket would otherwise fill the newest one
+    for (int i = 0; i < 10; i++) {
+      assertFalse(guard.checkAndRecord(KEY_ID, nonce(0)));
+    }
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(3)));
+    assertEquals(0, guard.getCompactedBucketCount());
+    assertEquals(10, guard.getReplayCount());
+  }
+
+  public void testFalsePositivesStayWithinBudget() {
+    int entriesPerBucket = 100;
+    double falsePositiveProbability = 0.01;
+    ReplayGuard guard = new ReplayGuard(
+        ReplayGuard.BUCKETS_PER_WINDOW,
+        TimeUnit.MINUTES,
+        entriesPerBucket,
+        falsePositiveProbability,
+        ticker);
+    int messages = 10 * entriesPerBucket;
+    int rejected = 0;
+    for (int i = 0; i < messages; i++) {
+      if (!guard.checkAndRecord(KEY_ID, nonce(i))) {
+        rejected++;
+      }
+    }
+    assertTrue(
+        rejected + " fresh messages rejected", rejected <= falsePositiveProbability * messages);
+    assertEquals(0, guard.getOverflowCount());
+    for (int i = 0; i < messages; i++) {
+      assertFalse(guard.checkAndRecord(KEY_ID, nonce(i)));
+    }
+  }
+
+  public void testFailsClosedWhenFiltersAreFull() {
+    ReplayGuard guard = newGuard(2);
+    // Two exact buckets, and MAX_FILTERS filters of FILTER_CAPACITY_BUCKETS buckets each
+    int capacity = 2 * (2 + ReplayGuard.MAX_FILTERS * ReplayGuard.FILTER_CAPACITY_BUCKETS);
+    for (int i = 0; i < capacity; i++) {
+      assertTrue(guard.checkAndRecord(KEY_ID, nonce(i)));
+    }
+    assertEquals(ReplayGuard.MAX_FILTERS, guard.getCompactedBucketCount());
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(capacity)));
+    assertFalse(guard.checkAndRecord(KEY_ID, nonce(0)));
+    assertEquals(2, guard.getOverflowCount());
+
+    // Everything recorded has left the window
+    ticker.advance(ReplayGuard.BUCKETS_PER_WINDOW + 1, TimeUnit.MINUTES);
+    assertTrue(guard.checkAndRecord(KEY_ID, nonce(capacity)));
+    assertEquals(0, guard.getCompactedBucketCount());
+  }
+
+  public void testInvalidArguments() {
+    try {
+      new ReplayGuard(0, TimeUnit.MINUTES, 10, 0.01);
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+    try {
+      new ReplayGuard(1, TimeUnit.MINUTES, 10, 1.0);
+      fail();
+    } catch (IllegalArgumentException expected) {
+    }
+  }
+
+  public void testRejectsReplayedServerMessages() throws Exception {
+    TransportCryptoOps.setReplayGuard(newGuard(100));
+    SecretKeySpec masterKey = new SecretKeySpec(new byte[32], "AES");
+    byte[] message = TransportCryptoOps.signcryptServerMessage(
+        new Payload(PayloadType.TICKLE, new byte[] {7}), masterKey, new byte[] {9});
+    byte[] otherMessage = TransportCryptoOps.signcryptServerMessage(
+        new Payload(PayloadType.TICKLE, new byte[] {7}), masterKey, new byte[] {9});
+
+    TransportCryptoOps.verifydecryptServerMessage(message, masterKey);
+    TransportCryptoOps.verifydecryptServerMessage(otherMessage, masterKey);
+    try {
+      TransportCryptoOps.verifydecryptServerMessage(message, masterKey);
+      fail();
+    } catch (SignatureException expected) {
+    }
+  }
+
+  private ReplayGuard newGuard(int entriesPerBucket) {
+    // One minute buckets
+    return new ReplayGuard(
+        ReplayGuard.BUCKETS_PER_WINDOW, TimeUnit.MINUTES, entriesPerBucket, 1e-9, ticker);
+  }
+
+  private static ByteString nonce(int value) {
+    return ByteString.copyFrom(new byte[] {(byte) value, (byte) (value >>> 8), 0, 0});
+  }
+}
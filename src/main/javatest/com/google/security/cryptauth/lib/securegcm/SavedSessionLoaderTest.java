@@ -0,0 +1,166 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securegcm;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import javax.crypto.SecretKey;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/** Tests for the SavedSessionLoader class. */
+public class SavedSessionLoaderTest extends TestCase {
+
+  /**
+   * Collects what the loader reports.
+   */
+  private static class RecordingListener implements SavedSessionLoader.Listener {
+    final Map<Long, D2DConnectionContext> restored = new ConcurrentHashMap<>();
+    final Map<Long, Exception> corrupt = new ConcurrentHashMap<>();
+
+    @Override
+    public void onSessionRestored(long index, D2DConnectionContext context) {
+      assertNull(restored.put(index, context));
+    }
+
+    @Override
+    public void onCorruptRecord(long index, Exception cause) {
+      assertNull(corrupt.put(index, cause));
+    }
+  }
+
+  public void testRestoresAllVersions() throws Exception {
+    List<D2DConnectionContext> contexts = new ArrayList<>();
+    for (int i = 0; i < 3 * SavedSessionLoader.RECORDS_PER_TASK + 5; i++) {
+      contexts.add((i % 2 == 0)
+          ? new D2DConnectionContextV0(key(i), i)
+          : new D2DConnectionContextV1(key(i), key(-i), i, -i));
+    }
+    byte[] stream = write(contexts);
+
+    RecordingListener listener = new RecordingListener();
+    assertEquals(contexts.size(), SavedSessionLoader.restore(
+        new ByteArrayInputStream(stream), listener));
+    assertRestored(contexts, listener);
+
+    ExecutorService executor = Executors.newFixedThreadPool(4);
+    try {
+      listener = new RecordingListener();
+      assertEquals(contexts.size(), SavedSessionLoader.restore(
+          new ByteArrayInputStream(stream), listener, executor));
+      assertRestored(contexts, listener);
+    } finally {
+      executor.shutdown();
+    }
+  }
+
+  public void testSkipsCorruptRecords() throws Exception {
+    D2DConnectionContext context = new D2DConnectionContextV1(key(1), key(2), 3, 4);
+    byte[] savedSession = context.saveSession();
+    byte[] unknownVersion = savedSession.clone();
+    unknownVersion[0] = 7;
+
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    writeRecord(savedSession, out);
+    writeRecord(unknownVersion, out);
+    writeRecord(Arrays.copyOf(savedSession, savedSession.length - 1), out);
+    writeRecord(new byte[0], out);
+    writeRecord(savedSession, out);
+
+    RecordingListener listener = new RecordingListener();
+    assertEquals(2, SavedSessionLoader.restore(
+        new ByteArrayInputStream(out.toByteArray()), listener));
+    assertEquals(2, listener.restored.size());
+    assertTrue(Arrays.equals(savedSession, listener.restored.get(4L).saveSession()));
+    assertEquals(3, listener.corrupt.size());
+    for (long i = 1; i <= 3; i++) {
+      assertTrue(listener.corrupt.get(i) instanceof IllegalArgumentException);
+    }
+  }
+
+  public void testStopsAtUnusableLengths() throws Exception {
+    byte[] savedSession = new D2DConnectionContextV0(key(1), 1).saveSession();
+
+    // A truncated record
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    writeRecord(savedSession, out);
+    writeRecord(savedSession, out);
+    byte[] truncated = Arrays.copyOf(out.toByteArray(), out.size() - 1);
+    RecordingListener listener = new RecordingListener();
+    assertEquals(1, SavedSessionLoader.restore(new ByteArrayInputStream(truncated), listener));
+    assertTrue(listener.corrupt.containsKey(1L));
+
+    // A truncated record length
+    listener = new RecordingListener();
+    assertEquals(1, SavedSessionLoader.restore(
+        new ByteArrayInputStream(Arrays.copyOf(truncated, savedSession.length + 6)), listener));
+    assertTrue(listener.corrupt.containsKey(1L));
+
+    // A record length that is too long to be right
+    out.write(D2DConnectionContext.signedIntToBytes(SavedSessionLoader.MAX_RECORD_LENGTH + 1));
+    writeRecord(savedSession, out);
+    listener = new RecordingListener();
+    assertEquals(2, SavedSessionLoader.restore(
+        new ByteArrayInputStream(out.toByteArray()), listener));
+    assertEquals(1, listener.corrupt.size());
+    assertTrue(listener.corrupt.containsKey(2L));
+  }
+
+  public void testFromSavedSessionWithOffset() throws Exception {
+    byte[] savedSession = new D2DConnectionContextV1(key(1), key(2), 3, 4).saveSession();
+    byte[] buffer = new byte[savedSession.length + 10];
+    System.arraycopy(savedSession, 0, buffer, 5, savedSession.length);
+    D2DConnectionContext context =
+        D2DConnectionContext.fromSavedSession(buffer, 5, savedSession.length);
+    assertTrue(Arrays.equals(savedSession, context.saveSession()));
+  }
+
+  private static void assertRestored(
+      List<D2DConnectionContext> expected, RecordingListener listener) {
+    assertTrue(listener.corrupt.isEmpty());
+    assertEquals(expected.size(), listener.restored.size());
+    for (int i = 0; i < expected.size(); i++) {
+      assertTrue(Arrays.equals(
+          expected.get(i).saveSession(), listener.restored.get((long) i).saveSession()));
+    }
+  }
+
+  private static byte[] write(List<D2DConnectionContext> contexts) throws Exception {
+    ByteArrayOutputStream out = new ByteArrayOutputStream();
+    for (D2DConnectionContext context : contexts) {
+      SavedSessionLoader.writeSession(context, out);
+    }
+    return out.toByteArray();
+  }
+
+  private static void writeRecord(byte[] record, ByteArrayOutputStream out) throws Exception {
+    out.write(D2DConnectionContext.signedIntToBytes(record.length));
+    out.write(record);
+  }
+
+  private static SecretKey key(int seed) {
+    byte[] key = new byte[32];
+    Arrays.fill(key, (byte) seed);
+    key[0] = (byte) (seed >> 8);
+    return new SecretKeySpec(key, "AES");
+  }
+}
@@ -14,13 +14,20 @@
 
 package com.google.security.cryptauth.lib.securegcm;
 
+import com.google.protobuf.ByteString;
 import com.google.security.cryptauth.lib.securegcm.SecureGcmProto.Tickle;
 import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Payload;
 import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.PayloadType;
+import com.google.security.cryptauth.lib.securegcm.TransportCryptoOps.Recipient;
 import com.google.security.cryptauth.lib.securemessage.PublicKeyProtoUtil;
 import java.security.KeyPair;
 import java.security.PublicKey;
+import java.security.SignatureException;
+import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.List;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
 import javax.crypto.SecretKey;
 import javax.crypto.spec.SecretKeySpec;
 import junit.framework.TestCase;
@@ -66,6 +73,74 @@ public class TransportCryptoOpsTest extends TestCase {
     assertEquals(tickleExpiry, receivedTickle.getExpiryTime());
   }
 
+  public void testServerMessageWithKeyStore() throws Exception {
+    InMemoryMasterKeyStore keyStore = new InMemoryMasterKeyStore();
+    keyStore.put(KEY_HANDLE, masterKey);
+    keyStore.put(new byte[] { 8 }, new SecretKeySpec(new byte[32], "AES"));
+    assertEquals(2, keyStore.size());
+
+    Tickle tickle = Tickle.newBuilder().setExpiryTime(1L).build();
+    byte[] signcryptedMessage = TransportCryptoOps.signcryptServerMessage(
+        new Payload(PayloadType.TICKLE, tickle.toByteArray()), masterKey, KEY_HANDLE);
+    for (int i = 0; i < 2; i++) {
+      Payload received =
+          TransportCryptoOps.verifydecryptServerMessage(signcryptedMessage, keyStore);
+      assertEquals(PayloadType.TICKLE, received.getPayloadType());
+      assertEquals(1L, Tickle.parseFrom(received.getMessage()).getExpiryTime());
+    }
+
+    // A key stored under the wrong handle doesn't verify
+    keyStore.put(KEY_HANDLE, new SecretKeySpec(new byte[32], "AES"));
+    try {
+      TransportCryptoOps.verifydecryptServerMessage(signcryptedMessage, keyStore);
+      fail();
+    } catch (SignatureException expected) {
+    }
+
+    keyStore.remove(KEY_HANDLE);
+    assertNull(keyStore.getMasterKey(ByteString.copyFrom(KEY_HANDLE)));
+    try {
+      TransportCryptoOps.verifydecryptServerMessage(signcryptedMessage, keyStore);
+      fail();
+    } catch (SignatureException expected) {
+    }
+  }
+
+  public void testServerMessageToManyRecipients() throws Exception {
+    InMemoryMasterKeyStore keyStore = new InMemoryMasterKeyStore();
+    List<Recipient> recipients = new ArrayList<>();
+    for (int i = 0; i < 70; i++) {
+      byte[] keyBytes = Arrays.copyOf(KEY_BYTES, KEY_BYTES.length);
+      keyBytes[0] = (byte) i;
+      SecretKey key = new SecretKeySpec(keyBytes, "AES");
+      byte[] keyHandle = { (byte) i };
+      keyStore.put(keyHandle, key);
+      recipients.add(new Recipient(key, keyHandle));
+    }
+    Payload payload = new Payload(
+        PayloadType.TICKLE, Tickle.newBuilder().setExpiryTime(2L).build().toByteArray());
+
+    ExecutorService executor = Executors.newFixedThreadPool(2);
+    try {
+      List<byte[]> parallel =
+          TransportCryptoOps.signcryptServerMessage(payload, recipients, executor);
+      List<byte[]> sequential = TransportCryptoOps.signcryptServerMessage(payload, recipients);
+      for (List<byte[]> messages : Arrays.asList(parallel, sequential)) {
+        assertEquals(recipients.size(), messages.size());
+        for (int i = 0; i < messages.size(); i++) {
+          byte[] message = messages.get(i);
+          assertTrue(Arrays.equals(recipients.get(i).getKeyHandle(),
+                                   TransportCryptoOps.getKeyHandleFor(message)));
+          Payload received = TransportCryptoOps.verifydecryptServerMessage(message, keyStore);
+          assertEquals(PayloadType.TICKLE, received.getPayloadType());
+          assertTrue(Arrays.equals(payload.getMessage(), received.getMessage()));
+        }
+      }
+    } finally {
+      executor.shutdown();
+    }
+  }
+
   public void testClientMessage() throws Exception {
     if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
       return;  // This test isn't for legacy crypto
@@ -18,6 +18,8 @@ import static org.junit.Assert.assertThrows;
 
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
 import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import java.security.KeyPair;
+import java.security.SecureRandom;
 import java.util.Arrays;
 import javax.crypto.KeyGenerator;
 import javax.crypto.SecretKey;
@@ -98,6 +100,40 @@ public class CryptoOpsTest extends TestCase {
                               CryptoOps.deriveAes256KeyFor(aesKey2, "A").getEncoded()));
   }
 
+  public void testPreparedSecretKey() throws Exception {
+    PreparedSecretKey prepared = new PreparedSecretKey(aesKey1);
+    assertSame(aesKey1, prepared.getMasterKey());
+    assertSame(aesKey1, new PreparedSecretKey(prepared).getMasterKey());
+    assertTrue(Arrays.equals(aesKey1.getEncoded(), prepared.getEncoded()));
+
+    SecretKey derived = CryptoOps.deriveAes256KeyFor(prepared, "A");
+    assertTrue(Arrays.equals(CryptoOps.deriveAes256KeyFor(aesKey1, "A").getEncoded(),
+                             derived.getEncoded()));
+    assertSame(derived, CryptoOps.deriveAes256KeyFor(prepared, "A"));
+    assertFalse(Arrays.equals(derived.getEncoded(),
+                              CryptoOps.deriveAes256KeyFor(prepared, "B").getEncoded()));
+  }
+
+  public void testPreparedPublicKey() throws Exception {
+    KeyPair keyPair = PublicKeyProtoUtil.generateRSA2048KeyPair();
+    PreparedPublicKey prepared =
+        new PreparedPublicKey(keyPair.getPublic(), SigType.RSA2048_SHA256);
+    assertSame(keyPair.getPublic(), prepared.getPublicKey());
+    assertTrue(Arrays.equals(keyPair.getPublic().getEncoded(), prepared.getEncoded()));
+
+    byte[] data = {1, 2, 3};
+    byte[] signature = CryptoOps.sign(
+        SigType.RSA2048_SHA256, keyPair.getPrivate(), new SecureRandom(), data);
+    for (int i = 0; i < 3; i++) {
+      assertTrue(CryptoOps.verify(prepared, SigType.RSA2048_SHA256, signature, data));
+      assertFalse(CryptoOps.verify(prepared, SigType.RSA2048_SHA256, signature, new byte[] {1}));
+    }
+
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> new PreparedPublicKey(keyPair.getPublic(), SigType.HMAC_SHA256));
+  }
+
   public void testHkdf() throws Exception {
     SecretKey inputKey = new SecretKeySpec(HKDF_CASE1_IKM, "AES");
     byte[] result = CryptoOps.hkdf(inputKey, HKDF_CASE1_SALT, HKDF_CASE1_INFO);
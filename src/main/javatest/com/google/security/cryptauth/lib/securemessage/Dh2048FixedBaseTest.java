@@ -0,0 +1,63 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.math.BigInteger;
+import java.util.Random;
+import junit.framework.TestCase;
+
+/** Tests for the Dh2048FixedBase class. */
+public class Dh2048FixedBaseTest extends TestCase {
+
+  private static final BigInteger P = PublicKeyProtoUtil.DH_P;
+  private static final BigInteger G = PublicKeyProtoUtil.DH_G;
+
+  public void testMatchesModPow() {
+    Random random = new Random(2048);
+    for (int i = 0; i < 50; i++) {
+      BigInteger x = new BigInteger(PublicKeyProtoUtil.DH_LEN, random);
+      assertEquals(G.modPow(x, P), Dh2048FixedBase.pow(x));
+    }
+  }
+
+  public void testEdgeCases() {
+    BigInteger max = BigInteger.ONE.shiftLeft(PublicKeyProtoUtil.DH_LEN).subtract(BigInteger.ONE);
+    BigInteger[] exponents = {
+      BigInteger.ZERO,
+      BigInteger.ONE,
+      BigInteger.valueOf(15),
+      BigInteger.valueOf(16),
+      BigInteger.ONE.shiftLeft(PublicKeyProtoUtil.DH_LEN - 1),
+      max,
+    };
+    for (BigInteger x : exponents) {
+      assertEquals(G.modPow(x, P), Dh2048FixedBase.pow(x));
+    }
+  }
+
+  public void testRejectsOutOfRangeExponents() {
+    BigInteger[] exponents = {
+      BigInteger.ONE.negate(),
+      BigInteger.ONE.shiftLeft(PublicKeyProtoUtil.DH_LEN),
+    };
+    for (BigInteger x : exponents) {
+      try {
+        Dh2048FixedBase.pow(x);
+        fail();
+      } catch (IllegalArgumentException expected) {
+      }
+    }
+  }
+}
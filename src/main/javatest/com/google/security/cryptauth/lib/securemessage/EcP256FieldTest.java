@@ -0,0 +1,172 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import java.math.BigInteger;
+import java.security.interfaces.ECPublicKey;
+import java.util.Random;
+import junit.framework.TestCase;
+
+/** Tests for the EcP256Field class. */
+public class EcP256FieldTest extends TestCase {
+
+  private static final BigInteger P = new BigInteger(
+      "ffffffff00000001000000000000000000000000ffffffffffffffffffffffff", 16);
+
+  private static final BigInteger B = new BigInteger(
+      "5ac635d8aa3a93e7b3ebbd55769886bc651d06b0cc53b0f63bce3c3e27d2604b", 16);
+
+  private static final BigInteger GX = new BigInteger(
+      "6b17d1f2e12c4247f8bce6e563a440f277037d812deb33a0f4a13945d898c296", 16);
+
+  private static final BigInteger GY = new BigInteger(
+      "4fe342e2fe1a7f9b8ee7eb4a7c0f9e162bce33576b315ececbb6406837bf51f5", 16);
+
+  public void testConstants() {
+    assertEquals(P, toBigInteger(EcP256Field.P));
+    assertEquals(B, toBigInteger(EcP256Field.B));
+  }
+
+  public void testMulMatchesBigInteger() {
+    Random random = new Random(0x256);
+    BigInteger[] edgeCases = {
+      BigInteger.ZERO,
+      BigInteger.ONE,
+      BigInteger.valueOf(2),
+      P.subtract(BigInteger.ONE),
+      P.subtract(BigInteger.valueOf(2)),
+      BigInteger.ONE.shiftLeft(255),
+      BigInteger.ONE.shiftLeft(224).subtract(BigInteger.ONE),
+    };
+    for (BigInteger a : edgeCases) {
+      for (BigInteger b : edgeCases) {
+        assertMul(a, b);
+      }
+    }
+    for (int i = 0; i < 2000; i++) {
+      assertMul(new BigInteger(256, random).mod(P), new BigInteger(256, random).mod(P));
+    }
+  }
+
+  public void testAddSubInvertMatchBigInteger() {
+    Random random = new Random(0x257);
+    long[] wide = new long[2 * EcP256Field.LIMBS];
+    int[] out = new int[EcP256Field.LIMBS];
+    BigInteger pMinusOne = P.subtract(BigInteger.ONE);
+    BigInteger[][] cases = {
+      {BigInteger.ZERO, BigInteger.ZERO},
+      {BigInteger.ZERO, BigInteger.ONE},
+      {pMinusOne, pMinusOne},
+      {pMinusOne, BigInteger.ONE},
+    };
+    for (BigInteger[] pair : cases) {
+      assertAddSub(pair[0], pair[1], out, wide);
+    }
+    for (int i = 0; i < 500; i++) {
+      BigInteger a = new BigInteger(256, random).mod(P);
+      assertAddSub(a, new BigInteger(256, random).mod(P), out, wide);
+      if (a.signum() != 0) {
+        EcP256Field.invert(fromBigInteger(a), out, wide);
+        assertEquals(a.modInverse(P), toBigInteger(out));
+      }
+    }
+    EcP256Field.invert(new int[EcP256Field.LIMBS], out, wide);
+    assertEquals(BigInteger.ZERO, toBigInteger(out));
+  }
+
+  public void testDecode() {
+    int[] out = new int[EcP256Field.LIMBS];
+    assertTrue(EcP256Field.decode(GX.toByteArray(), out));
+    assertEquals(GX, toBigInteger(out));
+    assertTrue(EcP256Field.decode(new byte[] {0x01, 0x02}, out));
+    assertEquals(BigInteger.valueOf(0x0102), toBigInteger(out));
+    assertTrue(EcP256Field.decode(P.subtract(BigInteger.ONE).toByteArray(), out));
+
+    assertFalse(EcP256Field.decode(new byte[0], out));
+    assertFalse(EcP256Field.decode(new byte[34], out));
+    assertFalse(EcP256Field.decode(new byte[] {(byte) 0x80}, out));
+    assertFalse(EcP256Field.decode(P.toByteArray(), out));
+    assertFalse(EcP256Field.decode(P.add(BigInteger.ONE).toByteArray(), out));
+    byte[] tooLarge = new byte[33];
+    tooLarge[0] = 1;
+    assertFalse(EcP256Field.decode(tooLarge, out));
+  }
+
+  public void testDecodePrefix() {
+    int[] out = new int[EcP256Field.LIMBS];
+    byte[] buffer = new byte[33];
+    buffer[0] = 0x01;
+    buffer[1] = 0x02;
+    buffer[2] = (byte) 0xff;  // Past the end of the encoding
+    assertTrue(EcP256Field.decode(buffer, 2, out));
+    assertEquals(BigInteger.valueOf(0x0102), toBigInteger(out));
+    assertFalse(EcP256Field.decode(buffer, 0, out));
+  }
+
+  public void testIsOnCurve() {
+    int[] x = new int[EcP256Field.LIMBS];
+    int[] y = new int[EcP256Field.LIMBS];
+    assertTrue(EcP256Field.decode(GX.toByteArray(), x));
+    assertTrue(EcP256Field.decode(GY.toByteArray(), y));
+    assertTrue(EcP256Field.isOnCurve(x, y));
+    assertTrue(EcP256Field.decode(P.subtract(GY).toByteArray(), y));
+    assertTrue(EcP256Field.isOnCurve(x, y));
+    assertTrue(EcP256Field.decode(GY.add(BigInteger.ONE).toByteArray(), y));
+    assertFalse(EcP256Field.isOnCurve(x, y));
+  }
+
+  public void testIsOnCurveForGeneratedKeys() {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    int[] x = new int[EcP256Field.LIMBS];
+    int[] y = new int[EcP256Field.LIMBS];
+    for (int i = 0; i < 10; i++) {
+      ECPublicKey pk = (ECPublicKey) PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+      assertTrue(EcP256Field.decode(pk.getW().getAffineX().toByteArray(), x));
+      assertTrue(EcP256Field.decode(pk.getW().getAffineY().toByteArray(), y));
+      assertTrue(EcP256Field.isOnCurve(x, y));
+    }
+  }
+
+  private static void assertMul(BigInteger a, BigInteger b) {
+    int[] out = new int[EcP256Field.LIMBS];
+    EcP256Field.mul(fromBigInteger(a), fromBigInteger(b), out, new long[2 * EcP256Field.LIMBS]);
+    assertEquals(a.multiply(b).mod(P), toBigInteger(out));
+  }
+
+  private static void assertAddSub(BigInteger a, BigInteger b, int[] out, long[] wide) {
+    EcP256Field.add(fromBigInteger(a), fromBigInteger(b), out, wide);
+    assertEquals(a.add(b).mod(P), toBigInteger(out));
+    EcP256Field.sub(fromBigInteger(a), fromBigInteger(b), out, wide);
+    assertEquals(a.subtract(b).mod(P), toBigInteger(out));
+  }
+
+  private static int[] fromBigInteger(BigInteger value) {
+    int[] limbs = new int[EcP256Field.LIMBS];
+    for (int i = 0; i < EcP256Field.LIMBS; i++) {
+      limbs[i] = value.shiftRight(32 * i).intValue();
+    }
+    return limbs;
+  }
+
+  private static BigInteger toBigInteger(int[] limbs) {
+    BigInteger result = BigInteger.ZERO;
+    for (int i = EcP256Field.LIMBS - 1; i >= 0; i--) {
+      result = result.shiftLeft(32).or(BigInteger.valueOf(limbs[i] & 0xffffffffL));
+    }
+    return result;
+  }
+}
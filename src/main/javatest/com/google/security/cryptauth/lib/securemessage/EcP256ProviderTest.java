@@ -0,0 +1,275 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.SigType;
+import java.math.BigInteger;
+import java.security.InvalidKeyException;
+import java.security.KeyPair;
+import java.security.KeyPairGenerator;
+import java.security.Provider;
+import java.security.SecureRandom;
+import java.security.Signature;
+import java.security.SignatureException;
+import java.security.interfaces.ECPrivateKey;
+import java.security.interfaces.ECPublicKey;
+import java.security.spec.ECGenParameterSpec;
+import java.security.spec.ECParameterSpec;
+import java.security.spec.ECPoint;
+import java.util.Arrays;
+import java.util.Random;
+import javax.crypto.KeyAgreement;
+import junit.framework.TestCase;
+
+/** Tests for the EcP256Provider class, checked against the platform's own EC implementation. */
+public class EcP256ProviderTest extends TestCase {
+
+  private static final byte[] MESSAGE = {1, 2, 3, 4, 5};
+
+  private final Provider provider = new EcP256Provider();
+
+  @Override
+  protected void tearDown() throws Exception {
+    CryptoOps.setEcProvider(null);
+    super.tearDown();
+  }
+
+  public void testParamsMatchPlatform() {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    ECPublicKey pk = (ECPublicKey) PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+    assertTrue(EcP256Spi.isP256(pk.getParams()));
+  }
+
+  public void testScalarMultiplicationMatchesPlatformKeys() {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    EcP256Curve curve = new EcP256Curve();
+    EcP256Curve.Point point = new EcP256Curve.Point();
+    int[] x = new int[EcP256Field.LIMBS];
+    int[] y = new int[EcP256Field.LIMBS];
+    for (int i = 0; i < 10; i++) {
+      KeyPair keyPair = PublicKeyProtoUtil.generateEcP256KeyPair();
+      byte[] s = EcP256Spi.toScalarBytes(((ECPrivateKey) keyPair.getPrivate()).getS());
+      ECPoint w = ((ECPublicKey) keyPair.getPublic()).getW();
+
+      curve.multiplyBase(s, point);
+      assertTrue(curve.toAffine(point, x, y));
+      assertEquals(w.getAffineX(), EcP256Spi.toBigInteger(x));
+      assertEquals(w.getAffineY(), EcP256Spi.toBigInteger(y));
+
+      // s * G computed with the variable base code path
+      curve.multiplyBase(EcP256Spi.toScalarBytes(BigInteger.ONE), point);
+      curve.multiply(s, point, point);
+      assertTrue(curve.toAffine(point, x, y));
+      assertEquals(w.getAffineX(), EcP256Spi.toBigInteger(x));
+    }
+  }
+
+  public void testScalarMultiplicationEdgeCases() {
+    EcP256Curve curve = new EcP256Curve();
+    EcP256Curve.Point point = new EcP256Curve.Point();
+    int[] x = new int[EcP256Field.LIMBS];
+    int[] y = new int[EcP256Field.LIMBS];
+    curve.multiplyBase(new byte[EcP256Curve.SCALAR_BYTES], point);
+    assertFalse(curve.toAffine(point, x, y));
+
+    // (n - 1) * G = -G
+    curve.multiplyBase(EcP256Spi.toScalarBytes(EcP256Curve.N.subtract(BigInteger.ONE)), point);
+    assertTrue(curve.toAffine(point, x, y));
+    assertTrue(Arrays.equals(EcP256Curve.GX, x));
+    int[] negY = new int[EcP256Field.LIMBS];
+    EcP256Field.neg(EcP256Curve.GY, negY, new long[EcP256Field.LIMBS]);
+    assertTrue(Arrays.equals(negY, y));
+
+    // G + (-G) = infinity, and n * G = infinity
+    EcP256Curve.Point g = new EcP256Curve.Point();
+    curve.multiplyBase(EcP256Spi.toScalarBytes(BigInteger.ONE), g);
+    curve.add(g, point, point);
+    assertFalse(curve.toAffine(point, x, y));
+    curve.multiply(EcP256Spi.toScalarBytes(EcP256Curve.N), g, point);
+    assertFalse(curve.toAffine(point, x, y));
+  }
+
+  public void testScalarArithmeticMatchesBigInteger() {
+    BigInteger n = EcP256Curve.N;
+    Random random = new Random(0);
+    int[] a = new int[EcP256Field.LIMBS];
+    int[] b = new int[EcP256Field.LIMBS];
+    int[] out = new int[EcP256Field.LIMBS];
+    long[] wide = new long[EcP256Field.LIMBS + 2];
+    for (int i = 0; i < 100; i++) {
+      BigInteger x = (i == 0) ? n.subtract(BigInteger.ONE) : new BigInteger(256, random).mod(n);
+      BigInteger y = (i == 0) ? n.subtract(BigInteger.ONE) : new BigInteger(256, random).mod(n);
+      EcP256Scalar.decode(EcP256Spi.toScalarBytes(x), a);
+      EcP256Scalar.decode(EcP256Spi.toScalarBytes(y), b);
+
+      EcP256Scalar.mul(a, b, out, wide);
+      assertEquals(x.multiply(y).mod(n), EcP256Spi.toBigInteger(out));
+      EcP256Scalar.add(a, b, out);
+      assertEquals(x.add(y).mod(n), EcP256Spi.toBigInteger(out));
+      EcP256Scalar.invert(a, out, wide);
+      assertEquals(x.modInverse(n), EcP256Spi.toBigInteger(out));
+    }
+
+    // Values of at least n are reduced
+    BigInteger big = BigInteger.ONE.shiftLeft(256).subtract(BigInteger.ONE);
+    EcP256Scalar.decode(EcP256Spi.toScalarBytes(big), a);
+    assertEquals(big.mod(n), EcP256Spi.toBigInteger(a));
+    assertFalse(EcP256Scalar.isValid(EcP256Spi.toScalarBytes(n)));
+    assertFalse(EcP256Scalar.isValid(new byte[EcP256Curve.SCALAR_BYTES]));
+    assertTrue(EcP256Scalar.isValid(EcP256Spi.toScalarBytes(n.subtract(BigInteger.ONE))));
+  }
+
+  public void testKeyAgreementMatchesPlatform() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    KeyPair ours = generateKeyPair();
+    KeyPair theirs = PublicKeyProtoUtil.generateEcP256KeyPair();
+
+    KeyAgreement agreement = KeyAgreement.getInstance("ECDH", provider);
+    agreement.init(ours.getPrivate());
+    agreement.doPhase(theirs.getPublic(), true);
+    byte[] secret = agreement.generateSecret();
+
+    KeyAgreement platformAgreement = KeyAgreement.getInstance("ECDH");
+    platformAgreement.init(theirs.getPrivate());
+    platformAgreement.doPhase(ours.getPublic(), true);
+    assertTrue(Arrays.equals(platformAgreement.generateSecret(), secret));
+
+    // The engine can be reused with the same private key
+    agreement.doPhase(theirs.getPublic(), true);
+    assertTrue(Arrays.equals(secret, agreement.generateSecret()));
+  }
+
+  public void testKeyAgreementRejectsPointsOffTheCurve() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    final ECPublicKey valid = (ECPublicKey) generateKeyPair().getPublic();
+    ECPublicKey invalid = new ECPublicKey() {
+      @Override
+      public ECPoint getW() {
+        ECPoint w = valid.getW();
+        return new ECPoint(w.getAffineX(), w.getAffineY().add(BigInteger.ONE));
+      }
+
+      @Override
+      public ECParameterSpec getParams() {
+        return valid.getParams();
+      }
+
+      @Override
+      public String getAlgorithm() {
+        return valid.getAlgorithm();
+      }
+
+      @Override
+      public String getFormat() {
+        return valid.getFormat();
+      }
+
+      @Override
+      public byte[] getEncoded() {
+        return valid.getEncoded();
+      }
+    };
+    KeyAgreement agreement = KeyAgreement.getInstance("ECDH", provider);
+    agreement.init(generateKeyPair().getPrivate());
+    try {
+      agreement.doPhase(invalid, true);
+      fail();
+    } catch (InvalidKeyException expected) {
+    }
+  }
+
+  public void testSignaturesInteroperateWithPlatform() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    KeyPair keyPair = generateKeyPair();
+
+    Signature signer = Signature.getInstance("SHA256withECDSA", provider);
+    signer.initSign(keyPair.getPrivate(), new SecureRandom());
+    signer.update(MESSAGE);
+    byte[] signature = signer.sign();
+    Signature platformVerifier = Signature.getInstance("SHA256withECDSA");
+    platformVerifier.initVerify(keyPair.getPublic());
+    platformVerifier.update(MESSAGE);
+    assertTrue(platformVerifier.verify(signature));
+
+    Signature platformSigner = Signature.getInstance("SHA256withECDSA");
+    platformSigner.initSign(keyPair.getPrivate());
+    platformSigner.update(MESSAGE);
+    signature = platformSigner.sign();
+    Signature verifier = Signature.getInstance("SHA256withECDSA", provider);
+    verifier.initVerify(keyPair.getPublic());
+    verifier.update(MESSAGE);
+    assertTrue(verifier.verify(signature));
+
+    verifier.update(new byte[] {0});
+    assertFalse(verifier.verify(signature));
+  }
+
+  public void testRejectsMalformedSignatures() throws Exception {
+    BigInteger r = BigInteger.valueOf(0x1234);
+    BigInteger s = EcP256Curve.N.subtract(BigInteger.ONE);
+    byte[] encoded = EcP256Spi.encodeSignature(r, s);
+    BigInteger[] decoded = EcP256Spi.decodeSignature(encoded);
+    assertEquals(r, decoded[0]);
+    assertEquals(s, decoded[1]);
+
+    byte[][] malformed = {
+      new byte[0],
+      Arrays.copyOf(encoded, encoded.length - 1),
+      Arrays.copyOf(encoded, encoded.length + 1),
+      {0x30, 0x06, 0x02, 0x01, (byte) 0x80, 0x02, 0x01, 0x01},  // Negative r
+      {0x30, 0x07, 0x02, 0x02, 0x00, 0x01, 0x02, 0x01, 0x01},  // Non-minimal r
+      {0x30, 0x06, 0x04, 0x01, 0x01, 0x02, 0x01, 0x01},  // Not an INTEGER
+    };
+    for (byte[] signature : malformed) {
+      try {
+        EcP256Spi.decodeSignature(signature);
+        fail();
+      } catch (SignatureException expected) {
+      }
+    }
+  }
+
+  public void testSetEcProvider() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    CryptoOps.setEcProvider(provider);
+    assertSame(provider, CryptoOps.getEcProvider());
+    KeyPair keyPair = PublicKeyProtoUtil.generateEcP256KeyPair();
+    assertTrue(EcP256Spi.isP256(((ECPublicKey) keyPair.getPublic()).getParams()));
+
+    byte[] signature = CryptoOps.sign(
+        SigType.ECDSA_P256_SHA256, keyPair.getPrivate(), new SecureRandom(), MESSAGE);
+    CryptoOps.setEcProvider(null);
+    assertTrue(
+        CryptoOps.verify(keyPair.getPublic(), SigType.ECDSA_P256_SHA256, signature, MESSAGE));
+  }
+
+  private KeyPair generateKeyPair() throws Exception {
+    KeyPairGenerator generator = KeyPairGenerator.getInstance("EC", provider);
+    generator.initialize(new ECGenParameterSpec("secp256r1"));
+    return generator.generateKeyPair();
+  }
+}
@@ -0,0 +1,169 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.security.cryptauth.lib.securemessage.CryptoOps.EncType;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
+import java.security.KeyFactory;
+import java.security.KeyPairGenerator;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.security.Provider;
+import java.security.SecureRandom;
+import java.security.Signature;
+import java.util.ArrayList;
+import java.util.List;
+import javax.crypto.Cipher;
+import javax.crypto.KeyAgreement;
+import javax.crypto.Mac;
+import javax.crypto.NoSuchPaddingException;
+import javax.crypto.spec.SecretKeySpec;
+import junit.framework.TestCase;
+
+/** Tests for the JcaCryptoBackend class, and its use by CryptoOps. */
+public class JcaCryptoBackendTest extends TestCase {
+
+  @Override
+  protected void tearDown() throws Exception {
+    CryptoOps.setBackend(JcaCryptoBackend.DEFAULT);
+    super.tearDown();
+  }
+
+  public void testDefaultUsesPlatformProviders() throws Exception {
+    JcaCryptoBackend backend = JcaCryptoBackend.DEFAULT;
+    assertNull(backend.getProvider(JcaCryptoBackend.MAC, "HmacSHA256"));
+    assertEquals(
+        Mac.getInstance("HmacSHA256").getProvider(), backend.getMac("HmacSHA256").getProvider());
+  }
+
+  public void testPinnedProvider() throws Exception {
+    Provider provider = Mac.getInstance("HmacSHA256").getProvider();
+    JcaCryptoBackend backend =
+        JcaCryptoBackend.DEFAULT.withPinnedProvider(JcaCryptoBackend.MAC, "hmacsha256", provider);
+    assertSame(provider, backend.getProvider(JcaCryptoBackend.MAC, "HmacSHA256"));
+    assertSame(provider, backend.getMac("HmacSHA256").getProvider());
+    assertNull(backend.getProvider(JcaCryptoBackend.MAC, "HmacSHA512"));
+    // The original is unchanged
+    assertNull(JcaCryptoBackend.DEFAULT.getProvider(JcaCryptoBackend.MAC, "HmacSHA256"));
+  }
+
+  public void testPreferredProvider() throws Exception {
+    Provider ecProvider = new EcP256Provider();
+    JcaCryptoBackend backend = JcaCryptoBackend.preferring(ecProvider);
+    assertSame(ecProvider, backend.getProvider(JcaCryptoBackend.SIGNATURE, "SHA256withECDSA"));
+    assertSame(ecProvider, backend.getSignature("SHA256withECDSA").getProvider());
+    assertNull(backend.getProvider(JcaCryptoBackend.MAC, "HmacSHA256"));
+
+    Provider aesProvider = Cipher.getInstance("AES/CBC/PKCS5Padding").getProvider();
+    backend = JcaCryptoBackend.preferring(aesProvider);
+    assertSame(aesProvider, backend.getProvider(JcaCryptoBackend.CIPHER, "AES/CBC/PKCS5Padding"));
+  }
+
+  public void testLoadConscryptProvider() throws Exception {
+    Provider conscrypt = JcaCryptoBackend.loadConscryptProvider();
+    boolean onClasspath;
+    try {
+      Class.forName("org.conscrypt.Conscrypt");
+      onClasspath = true;
+    } catch (ClassNotFoundException e) {
+      onClasspath = false;
+    }
+    if (!onClasspath) {
+      assertNull(conscrypt);
+      return;
+    }
+    if (conscrypt != null) {  // Null if its native library can't be loaded
+      JcaCryptoBackend backend = JcaCryptoBackend.preferring(conscrypt);
+      assertSame(conscrypt, backend.getMac("HmacSHA256").getProvider());
+    }
+  }
+
+  public void testCryptoOpsUsesBackend() throws Exception {
+    RecordingBackend recording = new RecordingBackend();
+    CryptoOps.setBackend(recording);
+    SecretKeySpec key = new SecretKeySpec(new byte[32], "AES");
+    byte[] iv = CryptoOps.generateIv(EncType.AES_256_CBC, new SecureRandom());
+    byte[] ciphertext = CryptoOps.encrypt(key, EncType.AES_256_CBC, null, iv, new byte[] {1, 2});
+    CryptoOps.decrypt(key, EncType.AES_256_CBC, iv, ciphertext);
+    assertTrue(recording.requests.contains("AES/CBC/PKCS5Padding"));
+    assertTrue(recording.requests.contains("HmacSHA256"));  // Key derivation
+  }
+
+  public void testPublicKeyParsingUsesBackend() throws Exception {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return;
+    }
+    GenericPublicKey encoded =
+        PublicKeyProtoUtil.encodePublicKey(PublicKeyProtoUtil.generateEcP256KeyPair().getPublic());
+    RecordingBackend recording = new RecordingBackend();
+    CryptoOps.setBackend(recording);
+    PublicKeyProtoUtil.parsePublicKey(encoded);
+    assertTrue(recording.requests.contains("EC"));
+  }
+
+  /**
+   * Records every algorithm requested, and otherwise behaves like the default backend.
+   */
+  private static final class RecordingBackend implements CryptoBackend {
+    final List<String> requests = new ArrayList<>();
+
+    @Override
+    public synchronized MessageDigest getMessageDigest(String algorithm)
+        throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getMessageDigest(algorithm);
+    }
+
+    @Override
+    public synchronized Mac getMac(String algorithm) throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getMac(algorithm);
+    }
+
+    @Override
+    public synchronized Cipher getCipher(String transformation)
+        throws NoSuchAlgorithmException, NoSuchPaddingException {
+      requests.add(transformation);
+      return JcaCryptoBackend.DEFAULT.getCipher(transformation);
+    }
+
+    @Override
+    public synchronized Signature getSignature(String algorithm) throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getSignature(algorithm);
+    }
+
+    @Override
+    public synchronized KeyAgreement getKeyAgreement(String algorithm)
+        throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getKeyAgreement(algorithm);
+    }
+
+    @Override
+    public synchronized KeyFactory getKeyFactory(String algorithm)
+        throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getKeyFactory(algorithm);
+    }
+
+    @Override
+    public synchronized KeyPairGenerator getKeyPairGenerator(String algorithm)
+        throws NoSuchAlgorithmException {
+      requests.add(algorithm);
+      return JcaCryptoBackend.DEFAULT.getKeyPairGenerator(algorithm);
+    }
+  }
+}
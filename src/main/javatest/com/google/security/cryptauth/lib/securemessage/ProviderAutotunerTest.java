@@ -0,0 +1,98 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.security.cryptauth.lib.securemessage.ProviderAutotuner.Measurement;
+import com.google.security.cryptauth.lib.securemessage.ProviderAutotuner.Report;
+import java.security.MessageDigest;
+import java.security.MessageDigestSpi;
+import java.security.Provider;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.concurrent.TimeUnit;
+import junit.framework.TestCase;
+
+/** Tests for the ProviderAutotuner class. */
+public class ProviderAutotunerTest extends TestCase {
+
+  private static final long MEASUREMENT_NANOS = TimeUnit.MILLISECONDS.toNanos(2);
+
+  @Override
+  protected void tearDown() throws Exception {
+    CryptoOps.setBackend(JcaCryptoBackend.DEFAULT);
+    super.tearDown();
+  }
+
+  public void testPinsACorrectProviderForEveryPrimitive() throws Exception {
+    Provider platformSha256 = MessageDigest.getInstance("SHA-256").getProvider();
+    Report report = new ProviderAutotuner(
+        Arrays.asList(platformSha256, new EcP256Provider()), MEASUREMENT_NANOS).run();
+
+    assertSame(platformSha256,
+        report.getBackend().getProvider(JcaCryptoBackend.MESSAGE_DIGEST, "SHA-256"));
+    boolean sawEcP256Provider = false;
+    for (Measurement measurement : report.getMeasurements()) {
+      if (measurement.getProviderName().equals(EcP256Provider.NAME)) {
+        sawEcP256Provider = true;
+        assertTrue(measurement.toString(), measurement.isCorrect());
+        assertTrue(measurement.getOpsPerSecond() > 0);
+      }
+    }
+    assertTrue(sawEcP256Provider);
+    assertTrue(report.toString().contains("(chosen)"));
+  }
+
+  public void testRejectsProvidersThatFailKnownAnswerTests() {
+    Report report = new ProviderAutotuner(
+        Collections.<Provider>singletonList(new BrokenProvider()), MEASUREMENT_NANOS).run();
+    assertEquals(1, report.getMeasurements().size());
+    Measurement measurement = report.getMeasurements().get(0);
+    assertFalse(measurement.isCorrect());
+    assertFalse(measurement.isChosen());
+    assertNull(report.getBackend().getProvider(JcaCryptoBackend.MESSAGE_DIGEST, "SHA-256"));
+  }
+
+  /**
+   * Offers a very fast, but wrong, SHA-256.
+   */
+  private static final class BrokenProvider extends Provider {
+    private static final long serialVersionUID = 1L;
+
+    @SuppressWarnings("deprecation")  // Provider(String, String, String) needs Java 9
+    BrokenProvider() {
+      super("Broken", 1.0, "Returns zeros for SHA-256");
+      putService(new Service(this, "MessageDigest", "SHA-256", "Broken", null, null) {
+        @Override
+        public Object newInstance(Object constructorParameter) {
+          return new MessageDigestSpi() {
+            @Override
+            protected void engineUpdate(byte input) {}
+
+            @Override
+            protected void engineUpdate(byte[] input, int offset, int len) {}
+
+            @Override
+            protected byte[] engineDigest() {
+              return new byte[32];
+            }
+
+            @Override
+            protected void engineReset() {}
+          };
+        }
+      });
+    }
+  }
+}
@@ -0,0 +1,113 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.protobuf.ByteString;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.EcP256PublicKey;
+import com.google.security.cryptauth.lib.securemessage.SecureMessageProto.GenericPublicKey;
+import java.security.PublicKey;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import junit.framework.TestCase;
+
+/** Tests for the PublicKeyBatchParser class. */
+public class PublicKeyBatchParserTest extends TestCase {
+
+  private ExecutorService executor;
+
+  @Override
+  public void setUp() {
+    executor = Executors.newFixedThreadPool(4);
+  }
+
+  @Override
+  public void tearDown() {
+    executor.shutdownNow();
+  }
+
+  public void testMatchesSequentialParsing() throws Exception {
+    List<byte[]> inputs = new ArrayList<>();
+    List<PublicKey> expected = new ArrayList<>();
+    for (int i = 0; i < 20; i++) {
+      PublicKey pk = generateKey();
+      inputs.add(PublicKeyProtoUtil.encodePublicKey(pk).toByteArray());
+      expected.add(pk);
+    }
+    inputs.add(new byte[] {1, 2, 3});
+    expected.add(null);
+    inputs.add(GenericPublicKey.getDefaultInstance().toByteArray());
+    expected.add(null);
+    if (!PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      inputs.add(offCurveKey().toByteArray());
+      expected.add(null);
+    }
+
+    List<PublicKeyBatchParser.Result> results =
+        PublicKeyBatchParser.parsePublicKeys(inputs, executor, 3);
+    assertEquals(inputs.size(), results.size());
+    for (int i = 0; i < inputs.size(); i++) {
+      PublicKeyBatchParser.Result result = results.get(i);
+      if (expected.get(i) == null) {
+        assertFalse(result.isValid());
+        assertNull(result.getPublicKey());
+        assertNotNull(result.getError());
+      } else {
+        assertTrue(result.isValid());
+        assertNull(result.getError());
+        assertEquals(expected.get(i), result.getPublicKey());
+      }
+    }
+  }
+
+  public void testDuplicatesAreParsedOnce() throws Exception {
+    byte[] encoded = PublicKeyProtoUtil.encodePublicKey(generateKey()).toByteArray();
+    List<byte[]> inputs = new ArrayList<>();
+    for (int i = 0; i < 10; i++) {
+      inputs.add(encoded.clone());
+    }
+    List<PublicKeyBatchParser.Result> results =
+        PublicKeyBatchParser.parsePublicKeys(inputs, executor);
+    for (PublicKeyBatchParser.Result result : results) {
+      assertSame(results.get(0), result);
+    }
+    assertTrue(results.get(0).isValid());
+  }
+
+  public void testEmptyInput() throws Exception {
+    assertTrue(
+        PublicKeyBatchParser.parsePublicKeys(Collections.<byte[]>emptyList(), executor).isEmpty());
+  }
+
+  private static PublicKey generateKey() {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return PublicKeyProtoUtil.generateRSA2048KeyPair().getPublic();
+    }
+    return PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+  }
+
+  private static GenericPublicKey offCurveKey() {
+    PublicKey pk = PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+    EcP256PublicKey valid = PublicKeyProtoUtil.encodeEcPublicKey(pk);
+    byte[] y = valid.getY().toByteArray();
+    y[y.length - 1] ^= 1;
+    return GenericPublicKey.newBuilder()
+        .setType(SecureMessageProto.PublicKeyType.EC_P256)
+        .setEcP256PublicKey(valid.toBuilder().setY(ByteString.copyFrom(y)))
+        .build();
+  }
+}
@@ -0,0 +1,99 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.security.cryptauth.lib.securemessage;
+
+import com.google.common.testing.FakeTicker;
+import java.security.PublicKey;
+import java.security.spec.InvalidKeySpecException;
+import java.util.concurrent.TimeUnit;
+import junit.framework.TestCase;
+
+/** Tests for the PublicKeyCache class. */
+public class PublicKeyCacheTest extends TestCase {
+
+  private byte[] encodedKey;
+  private byte[] otherEncodedKey;
+
+  @Override
+  public void setUp() {
+    encodedKey = encode(generateKey());
+    otherEncodedKey = encode(generateKey());
+  }
+
+  public void testHitsReturnSameKey() throws Exception {
+    PublicKeyCache cache = new PublicKeyCache(10, 1, TimeUnit.HOURS);
+    PublicKey first = cache.parsePublicKey(encodedKey);
+    PublicKey second = cache.parsePublicKey(encodedKey.clone());
+    assertSame(first, second);
+    assertEquals(first, PublicKeyProtoUtil.parsePublicKey(
+        SecureMessageProto.GenericPublicKey.parseFrom(encodedKey)));
+    assertEquals(1, cache.getMissCount());
+    assertEquals(1, cache.getHitCount());
+  }
+
+  public void testCallerMutationDoesNotPoisonCache() throws Exception {
+    PublicKeyCache cache = new PublicKeyCache(10, 1, TimeUnit.HOURS);
+    byte[] input = encodedKey.clone();
+    PublicKey parsed = cache.parsePublicKey(input);
+    System.arraycopy(otherEncodedKey, 0, input, 0, Math.min(input.length, otherEncodedKey.length));
+    assertSame(parsed, cache.parsePublicKey(encodedKey));
+  }
+
+  public void testInvalidKeysAreNotCached() throws Exception {
+    PublicKeyCache cache = new PublicKeyCache(10, 1, TimeUnit.HOURS);
+    byte[] garbage = {1, 2, 3};
+    for (int i = 0; i < 2; i++) {
+      try {
+        cache.parsePublicKey(garbage);
+        fail();
+      } catch (InvalidKeySpecException expected) {
+      }
+    }
+    assertEquals(0, cache.size());
+    assertEquals(2, cache.getMissCount());
+  }
+
+  public void testSizeLimit() throws Exception {
+    PublicKeyCache cache = new PublicKeyCache(1, 1, TimeUnit.HOURS);
+    cache.parsePublicKey(encodedKey);
+    cache.parsePublicKey(otherEncodedKey);
+    assertEquals(1, cache.size());
+    cache.parsePublicKey(encodedKey);
+    assertEquals(3, cache.getMissCount());
+  }
+
+  public void testExpiry() throws Exception {
+    FakeTicker ticker = new FakeTicker();
+    PublicKeyCache cache = new PublicKeyCache(10, 1, TimeUnit.MINUTES, ticker);
+    PublicKey first = cache.parsePublicKey(encodedKey);
+    ticker.advance(59, TimeUnit.SECONDS);
+    assertSame(first, cache.parsePublicKey(encodedKey));
+    ticker.advance(2, TimeUnit.SECONDS);
+    cache.parsePublicKey(encodedKey);
+    assertEquals(2, cache.getMissCount());
+    assertEquals(1, cache.getHitCount());
+  }
+
+  private static PublicKey generateKey() {
+    if (PublicKeyProtoUtil.isLegacyCryptoRequired()) {
+      return PublicKeyProtoUtil.generateRSA2048KeyPair().getPublic();
+    }
+    return PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+  }
+
+  private static byte[] encode(PublicKey key) {
+    return PublicKeyProtoUtil.encodePublicKey(key).toByteArray();
+  }
+}
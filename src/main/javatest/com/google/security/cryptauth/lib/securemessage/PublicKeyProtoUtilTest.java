@@ -244,6 +244,64 @@ public class PublicKeyProtoUtilTest extends TestCase {
             .build());
   }
 
+  public void testCompressedEcPublicKeyEncodeParse() throws Exception {
+    if (isAndroidOsWithoutEcSupport()) {
+      return;
+    }
+
+    for (int i = 0; i < 20; i++) {
+      ECPublicKey pk = (ECPublicKey) PublicKeyProtoUtil.generateEcP256KeyPair().getPublic();
+      EcP256PublicKey compressed = PublicKeyProtoUtil.encodeCompressedEcPublicKey(pk);
+      assertFalse(compressed.hasY());
+      assertEquals(pk.getW().getAffineY().testBit(0), compressed.getYIsOdd());
+      assertEquals(pk, PublicKeyProtoUtil.parseEcPublicKey(compressed));
+      assertEquals(
+          pk,
+          PublicKeyProtoUtil.parsePublicKey(PublicKeyProtoUtil.encodeCompressedPublicKey(pk)));
+    }
+
+    // Non-EC keys are encoded as usual
+    assertEquals(
+        PublicKeyProtoUtil.encodePublicKey(rsaPublicKey),
+        PublicKeyProtoUtil.encodeCompressedPublicKey(rsaPublicKey));
+  }
+
+  public void testCompressedEcPublicKeyInvalidEncoding() throws Exception {
+    if (isAndroidOsWithoutEcSupport()) {
+      return;
+    }
+
+    EcP256PublicKey validProto = PublicKeyProtoUtil.encodeCompressedEcPublicKey(ecPublicKey);
+
+    // Both compressed and uncompressed
+    checkParsingFailsFor(
+        EcP256PublicKey.newBuilder(validProto)
+            .setY(PublicKeyProtoUtil.encodeEcPublicKey(ecPublicKey).getY())
+            .build());
+
+    // Negative X coordinate
+    checkParsingFailsFor(
+        EcP256PublicKey.newBuilder(validProto)
+            .setX(ByteString.copyFrom(new byte[] {(byte) 0xff}))
+            .build());
+
+    // Roughly half of all x coordinates have no point on the curve
+    int failures = 0;
+    for (int x = 1; x <= 20; x++) {
+      try {
+        PublicKeyProtoUtil.parseEcPublicKey(
+            EcP256PublicKey.newBuilder()
+                .setX(ByteString.copyFrom(new byte[] {(byte) x}))
+                .setYIsOdd(false)
+                .build());
+      } catch (InvalidKeySpecException expected) {
+        failures++;
+      }
+    }
+    assertTrue(failures > 0);
+    assertTrue(failures < 20);
+  }
+
   private void checkParsingFailsFor(EcP256PublicKey invalid) {
     try {
       // Should fail to decode
@@ -363,6 +421,18 @@ public class PublicKeyProtoUtilTest extends TestCase {
     assertEquals(isAndroidOsWithoutEcSupport(), PublicKeyProtoUtil.isLegacyCryptoRequired());
   }
 
+  public void testWarmUp() throws Exception {
+    PublicKeyProtoUtil.warmUp();
+    PublicKeyProtoUtil.warmUp();
+    if (!isAndroidOsWithoutEcSupport()) {
+      ECPublicKey parsed =
+          PublicKeyProtoUtil.parseEcPublicKey(PublicKeyProtoUtil.encodeEcPublicKey(ecPublicKey));
+      assertEquals(ecPublicKey, parsed);
+      assertEquals(
+          ((ECPublicKey) ecPublicKey).getParams().getCurve(), parsed.getParams().getCurve());
+    }
+  }
+
   /** @return true if running on an Android OS that doesn't support Elliptic Curve algorithms */
   public static boolean isAndroidOsWithoutEcSupport() {
     try {
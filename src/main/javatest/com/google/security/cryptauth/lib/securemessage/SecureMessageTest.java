@@ -462,6 +462,81 @@ public class SecureMessageTest extends TestCase {
     }
   }
 
+  public void testNestedMessage() throws Exception {
+    SecureMessage inner = new SecureMessageBuilder()
+        .setVerificationKeyId(TEST_KEY_ID)
+        .buildSignedCleartextMessage(hmacKey, SigType.HMAC_SHA256, TEST_MESSAGE);
+    for (SecretKey outerSigningKey : Arrays.asList(hmacKey, aesEncryptionKey)) {
+      SecureMessage outer = new SecureMessageBuilder().buildSignCryptedMessage(
+          outerSigningKey, SigType.HMAC_SHA256, aesEncryptionKey, EncType.AES_256_CBC,
+          inner.toByteArray());
+      HeaderAndBody outerHeaderAndBody = SecureMessageParser.parseSignCryptedMessage(
+          SecureMessage.parseFrom(outer.toByteArray()),
+          outerSigningKey, SigType.HMAC_SHA256, aesEncryptionKey, EncType.AES_256_CBC);
+
+      SecureMessage parsedInner =
+          SecureMessageParser.parseNestedMessage(outerHeaderAndBody.getBody());
+      assertEquals(inner, parsedInner);
+      assertEquals(ByteString.copyFrom(TEST_KEY_ID),
+          SecureMessageParser.getUnverifiedHeader(parsedInner).getVerificationKeyId());
+      HeaderAndBody innerHeaderAndBody = SecureMessageParser.parseSignedCleartextMessage(
+          parsedInner, hmacKey, SigType.HMAC_SHA256);
+      assertTrue(Arrays.equals(TEST_MESSAGE, innerHeaderAndBody.getBody().toByteArray()));
+    }
+
+    try {
+      SecureMessageParser.parseNestedMessage(ByteString.copyFrom(new byte[] {1, 2, 3}));
+      fail();
+    } catch (InvalidProtocolBufferException expected) {
+    }
+  }
+
+  public void testSignCryptedWithKeyResolver() throws Exception {
+    final ByteString keyId = ByteString.copyFrom(TEST_KEY_ID);
+    final Header[] resolvedFrom = new Header[1];
+    SecureMessageParser.KeyResolver resolver = new SecureMessageParser.KeyResolver() {
+      @Override
+      public Key resolveKey(Header unverifiedHeader) {
+        resolvedFrom[0] = unverifiedHeader;
+        return keyId.equals(unverifiedHeader.getVerificationKeyId()) ? aesEncryptionKey : null;
+      }
+    };
+    SecureMessage signcrypted = SecureMessage.parseFrom(new SecureMessageBuilder()
+        .setVerificationKeyId(TEST_KEY_ID)
+        .buildSignCryptedMessage(
+            aesEncryptionKey, SigType.HMAC_SHA256, aesEncryptionKey, EncType.AES_256_CBC,
+            TEST_MESSAGE)
+        .toByteArray());
+    HeaderAndBody headerAndBody = SecureMessageParser.parseSignCryptedMessage(
+        signcrypted, resolver, SigType.HMAC_SHA256, EncType.AES_256_CBC);
+    assertTrue(Arrays.equals(TEST_MESSAGE, headerAndBody.getBody().toByteArray()));
+    // The header the key was chosen from is the one that was verified, so it was parsed once
+    assertSame(resolvedFrom[0], headerAndBody.getHeader());
+
+    SecureMessage unknownKey = new SecureMessageBuilder()
+        .setVerificationKeyId(new byte[] {1})
+        .buildSignCryptedMessage(
+            aesEncryptionKey, SigType.HMAC_SHA256, aesEncryptionKey, EncType.AES_256_CBC,
+            TEST_MESSAGE);
+    try {
+      SecureMessageParser.parseSignCryptedMessage(
+          unknownKey, resolver, SigType.HMAC_SHA256, EncType.AES_256_CBC);
+      fail();
+    } catch (SignatureException expected) {
+    }
+
+    SecureMessage wrongKey = new SecureMessageBuilder()
+        .setVerificationKeyId(TEST_KEY_ID)
+        .buildSignCryptedMessage(
+            hmacKey, SigType.HMAC_SHA256, hmacKey, EncType.AES_256_CBC, TEST_MESSAGE);
+    try {
+      SecureMessageParser.parseSignCryptedMessage(
+          wrongKey, resolver, SigType.HMAC_SHA256, EncType.AES_256_CBC);
+      fail();
+    } catch (SignatureException expected) {
+    }
+  }
+
   public void testSignCryptionRequiresEncryption() throws Exception {
     try {
       signCrypt(SigType.RSA2048_SHA256, EncType.NONE);